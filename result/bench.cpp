@@ -0,0 +1,444 @@
+// Benchmark suite for the sampling and rendering paths. Prints one JSON document so runs
+// can be diffed and checked for regressions.
+//
+//   bench [--children N] [--iterations N] [--rows N] [--out file.json]
+//
+// --children spawns N suspended copies of this program (in a kill-on-close job) before
+// measuring, for synthetic high-process-count runs. --rows sizes the synthetic tables used
+// by the history, list view and log benchmarks. Scratch files go to %TEMP%\process_monitor_bench.
+//
+// The sampler results come from two runs: sampler_fixed_* refreshes every process every
+// tick, sampler_* uses the default adaptive tiers, so idle processes skip most ticks.
+//
+// filter_view builds a filtered view over --rows synthetic processes with 200 distinct
+// names, as the list does each refresh when a filter expression is set.
+//
+// The history_stats results time the per-slot statistics kernels (scalar, and AVX2 when
+// the processor has it) over --rows full minute histories.
+//
+// Each result reports latency per iteration (mean, p50, p99, max in microseconds) and
+// items per second, where an item is a process, history record, list row or log record.
+#define _UNICODE
+#define UNICODE
+#include <windows.h>
+#include <commctrl.h>
+#include <strsafe.h>
+#include <cstdio>
+#include <vector>
+#include <string>
+
+#include "core/sampler.h"
+#include "core/process_view.h"
+#include "core/alloc_counter.h"
+
+#pragma comment(lib, "user32.lib")
+#pragma comment(lib, "gdi32.lib")
+#pragma comment(lib, "comctl32.lib")
+
+#define BENCH_DEFAULT_ITERATIONS 50
+#define BENCH_DEFAULT_ROWS 2000
+#define BENCH_LOG_CHANGED_PERCENT 10   // share of rows that change per logged sample
+#define BENCH_DIRECTORY L"process_monitor_bench"
+
+struct BenchResult {
+    const char* name;
+    LatencySummary latency;
+    double itemsPerSecond;
+    ULONGLONG itemsPerIteration;
+    double bytesPerSecond;          // only for benchmarks that write
+};
+
+static std::vector<BenchResult> results;
+
+static void AddResult(const char* name, const LatencyHistogram& histogram, ULONGLONG itemsPerIteration) {
+    BenchResult result = { name, histogram.Summarize(), 0.0, itemsPerIteration, 0.0 };
+    if (result.latency.meanUs > 0) result.itemsPerSecond = itemsPerIteration * 1000000.0 / result.latency.meanUs;
+    results.push_back(result);
+}
+
+// Suspended children never run, so they add process-table entries without adding load.
+static HANDLE SpawnIdleChildren(DWORD count) {
+    HANDLE hJob = CreateJobObjectW(NULL, NULL);
+    if (!hJob) return NULL;
+    JOBOBJECT_EXTENDED_LIMIT_INFORMATION limits = { 0 };
+    limits.BasicLimitInformation.LimitFlags = JOB_OBJECT_LIMIT_KILL_ON_JOB_CLOSE;
+    SetInformationJobObject(hJob, JobObjectExtendedLimitInformation, &limits, sizeof(limits));
+
+    WCHAR path[MAX_PATH];
+    if (!GetModuleFileNameW(NULL, path, MAX_PATH)) return hJob;
+    for (DWORD i = 0; i < count; i++) {
+        STARTUPINFOW si = { sizeof(si) };
+        PROCESS_INFORMATION pi;
+        WCHAR commandLine[] = L"bench --idle";
+        if (!CreateProcessW(path, commandLine, NULL, NULL, FALSE, CREATE_SUSPENDED | CREATE_NO_WINDOW, NULL, NULL, &si, &pi)) {
+            fwprintf(stderr, L"bench: spawned %lu of %lu children (error %lu)\n", i, count, GetLastError());
+            break;
+        }
+        if (!AssignProcessToJobObject(hJob, pi.hProcess)) TerminateProcess(pi.hProcess, 1);
+        CloseHandle(pi.hThread);
+        CloseHandle(pi.hProcess);
+    }
+    return hJob;
+}
+
+static size_t BenchCapture(DWORD iterations) {
+    NtProcessSnapshot snapshot;
+    NamePool names;
+    std::vector<ProcessInfo> out;
+    if (!snapshot.Capture(out, names)) return 0;
+    size_t processes = out.size();
+    LatencyHistogram histogram;
+    for (DWORD i = 0; i < iterations; i++) {
+        out.clear();
+        ScopedTimer timer(histogram);
+        snapshot.Capture(out, names);
+    }
+    AddResult("capture", histogram, processes);
+    return processes;
+}
+
+// Warm runs only: the first query opens every handle, later ones reuse the cache.
+static void BenchPerPid(const char* name, bool parallel, DWORD iterations) {
+    PerPidQuery query;
+    query.SetParallel(parallel);
+    NamePool names;
+    std::vector<ProcessInfo> out;
+    if (!query.Query(out, names)) return;
+    size_t processes = out.size();
+    LatencyHistogram histogram;
+    for (DWORD i = 0; i < iterations; i++) {
+        out.clear();
+        ScopedTimer timer(histogram);
+        query.Query(out, names);
+    }
+    AddResult(name, histogram, processes);
+}
+
+// One iteration records a sample for every slot and reads its average back, as a refresh does.
+static void BenchHistoryRing(DWORD iterations, DWORD rows) {
+    HistoryStore store;
+    std::vector<size_t> slots;
+    for (DWORD i = 0; i < rows; i++) slots.push_back(store.Allocate());
+    for (DWORD pass = 0; pass < MAX_HISTORY; pass++) {
+        for (size_t slot : slots) store.Record(slot, pass % 100, 1024 * 1024);
+    }
+
+    LatencyHistogram histogram;
+    volatile double sink = 0.0;   // keeps the reads from being optimised away
+    for (DWORD i = 0; i < iterations; i++) {
+        ScopedTimer timer(histogram);
+        for (size_t slot : slots) {
+            store.Record(slot, (i + slot) % 100, (SIZE_T)(slot + i) * 4096);
+            sink = sink + store.AverageCpu(slot);
+        }
+    }
+    AddResult("history_ring", histogram, rows);
+}
+
+// The history statistics for every slot in one sweep, once per kernel, so the JSON shows
+// what AVX2 buys on this machine; history_stats_dispatch uses the kernel refreshes use.
+static void BenchHistoryStats(const char* name, HistoryStatsFn kernel, DWORD iterations, DWORD rows) {
+    HistoryStore store;
+    std::vector<size_t> slots;
+    for (DWORD i = 0; i < rows; i++) slots.push_back(store.Allocate());
+    for (DWORD pass = 0; pass < MAX_HISTORY; pass++) {
+        for (size_t slot : slots) store.Record(slot, (pass * 7 + slot) % 100, (SIZE_T)(slot + pass) * 4096);
+    }
+
+    std::vector<HistoryStats> stats(rows);
+    LatencyHistogram histogram;
+    for (DWORD i = 0; i < iterations; i++) {
+        ScopedTimer timer(histogram);
+        store.SummarizeAll(slots.data(), slots.size(), stats.data(), kernel);
+    }
+    AddResult(name, histogram, rows);
+}
+
+static DWORD listRows = 0;
+
+static LRESULT CALLBACK BenchWndProc(HWND hwnd, UINT msg, WPARAM wParam, LPARAM lParam) {
+    if (msg == WM_NOTIFY && reinterpret_cast<NMHDR*>(lParam)->code == LVN_GETDISPINFOW) {
+        LVITEMW& item = reinterpret_cast<NMLVDISPINFOW*>(lParam)->item;
+        if ((item.mask & LVIF_TEXT) && item.iItem >= 0 && (DWORD)item.iItem < listRows) {
+            if (item.iSubItem == 0) StringCchPrintfW(item.pszText, item.cchTextMax, L"process_%d.exe", item.iItem);
+            else StringCchPrintfW(item.pszText, item.cchTextMax, L"%.2f", item.iItem * 0.01 * item.iSubItem);
+        }
+        return 0;
+    }
+    return DefWindowProcW(hwnd, msg, wParam, lParam);
+}
+
+static HWND CreateBenchList(HWND parent, DWORD style) {
+    HWND hList = CreateWindowW(WC_LISTVIEWW, L"", WS_CHILD | WS_VISIBLE | LVS_REPORT | style,
+        0, 0, 600, 400, parent, NULL, GetModuleHandleW(NULL), NULL);
+    ListView_SetExtendedListViewStyle(hList, LVS_EX_FULLROWSELECT | LVS_EX_DOUBLEBUFFER);
+    LVCOLUMNW column = { 0 };
+    column.mask = LVCF_TEXT | LVCF_WIDTH;
+    column.cx = 120;
+    const wchar_t* title = L"Column";
+    column.pszText = const_cast<LPWSTR>(title);
+    for (int i = 0; i < 4; i++) ListView_InsertColumn(hList, i, &column);
+    return hList;
+}
+
+// Renders the visible page into a memory DC; that is what pulls the cell text.
+static void PaintList(HWND hList, HDC hdc) {
+    SendMessageW(hList, WM_PRINTCLIENT, (WPARAM)hdc, PRF_CLIENT | PRF_ERASEBKGND);
+}
+
+// Owner-data population (what the monitor does) against inserting every row and cell.
+static void BenchListView(DWORD iterations, DWORD rows) {
+    INITCOMMONCONTROLSEX icex = { sizeof(INITCOMMONCONTROLSEX), ICC_LISTVIEW_CLASSES };
+    InitCommonControlsEx(&icex);
+    WNDCLASSEXW wc = { sizeof(WNDCLASSEXW) };
+    wc.lpfnWndProc = BenchWndProc;
+    wc.hInstance = GetModuleHandleW(NULL);
+    wc.lpszClassName = L"ProcessMonitorBench";
+    RegisterClassExW(&wc);
+    HWND hwnd = CreateWindowW(wc.lpszClassName, L"bench", WS_OVERLAPPEDWINDOW, 0, 0, 620, 450, NULL, NULL, wc.hInstance, NULL);
+    if (!hwnd) return;
+
+    HDC screen = GetDC(hwnd);
+    HDC hdc = CreateCompatibleDC(screen);
+    HBITMAP bitmap = CreateCompatibleBitmap(screen, 600, 400);
+    HGDIOBJ old = SelectObject(hdc, bitmap);
+    listRows = rows;
+
+    HWND ownerData = CreateBenchList(hwnd, LVS_OWNERDATA);
+    LatencyHistogram ownerHistogram;
+    for (DWORD i = 0; i < iterations; i++) {
+        ScopedTimer timer(ownerHistogram);
+        ListView_SetItemCountEx(ownerData, 0, LVSICF_NOSCROLL);
+        ListView_SetItemCountEx(ownerData, (int)rows, LVSICF_NOSCROLL);
+        PaintList(ownerData, hdc);
+    }
+    AddResult("list_view_owner_data", ownerHistogram, rows);
+
+    HWND inserted = CreateBenchList(hwnd, 0);
+    LatencyHistogram insertHistogram;
+    WCHAR text[64];
+    for (DWORD i = 0; i < iterations; i++) {
+        ScopedTimer timer(insertHistogram);
+        SendMessageW(inserted, WM_SETREDRAW, FALSE, 0);
+        ListView_DeleteAllItems(inserted);
+        for (DWORD row = 0; row < rows; row++) {
+            LVITEMW item = { 0 };
+            item.mask = LVIF_TEXT;
+            item.iItem = (int)row;
+            StringCchPrintfW(text, 64, L"process_%lu.exe", row);
+            item.pszText = text;
+            ListView_InsertItem(inserted, &item);
+            for (int column = 1; column < 4; column++) {
+                StringCchPrintfW(text, 64, L"%.2f", row * 0.01 * column);
+                ListView_SetItemText(inserted, (int)row, column, text);
+            }
+        }
+        SendMessageW(inserted, WM_SETREDRAW, TRUE, 0);
+        PaintList(inserted, hdc);
+    }
+    AddResult("list_view_insert", insertHistogram, rows);
+
+    SelectObject(hdc, old);
+    DeleteObject(bitmap);
+    DeleteDC(hdc);
+    ReleaseDC(hwnd, screen);
+    DestroyWindow(hwnd);
+}
+
+// One keyframe-sized first sample, then BENCH_LOG_CHANGED_PERCENT of the rows per sample.
+static void BenchLogWriter(DWORD iterations, DWORD rows) {
+    HistoryWriter writer;
+    DeleteFileW(L"bench_history.bin");
+    if (!writer.Open(L"bench_history.bin")) return;
+
+    NamePool names;
+    std::vector<LogRecord> records(rows);
+    for (DWORD row = 0; row < rows; row++) {
+        WCHAR name[32];
+        StringCchPrintfW(name, 32, L"process_%lu.exe", row % 200);
+        records[row] = { names.Intern(name), 130000000000000000ULL + row, 1024 * 1024ULL * (row % 64 + 1), 0.0,
+            4 * (row + 1), LOG_RECORD_PROCESS };
+    }
+    FILETIME ft;
+    GetSystemTimeAsFileTime(&ft);
+    ULONGLONG now = ((ULONGLONG)ft.dwHighDateTime << 32) | ft.dwLowDateTime;
+    LogRecord sample = { NULL, now, 0, 0.0, rows, LOG_RECORD_FULL_SAMPLE };
+    writer.WriteSample(sample, records.data(), records.size(), true);
+    writer.Flush();
+    ULONGLONG startBytes = writer.GetBytesWritten();
+
+    DWORD changed = rows * BENCH_LOG_CHANGED_PERCENT / 100;
+    if (changed == 0) changed = 1;
+    std::vector<LogRecord> delta(changed);
+    LatencyHistogram histogram;
+    for (DWORD i = 0; i < iterations; i++) {
+        for (DWORD k = 0; k < changed; k++) {
+            delta[k] = records[(i * changed + k) % rows];
+            delta[k].cpu = (i + k) % 100;
+        }
+        sample.time += 10000000ULL;
+        sample.kind = LOG_RECORD_SAMPLE;
+        sample.pid = changed;
+        ScopedTimer timer(histogram);
+        writer.WriteSample(sample, delta.data(), delta.size(), false);
+    }
+    // The closing flush is the only write to disk for small runs; it is counted as well.
+    LARGE_INTEGER flushStart;
+    QueryPerformanceCounter(&flushStart);
+    writer.Close();
+    LARGE_INTEGER flushEnd;
+    QueryPerformanceCounter(&flushEnd);
+    AddResult("log_writer", histogram, changed);
+
+    BenchResult& result = results.back();
+    double seconds = (result.latency.meanUs * result.latency.count + Profiler::QpcToUs(flushEnd.QuadPart - flushStart.QuadPart)) / 1000000.0;
+    if (seconds > 0) result.bytesPerSecond = (writer.GetBytesWritten() - startBytes) / seconds;
+    DeleteFileW(L"bench_history.bin");
+}
+
+// The first iteration fills the filter's per-name cache; later ones only test columns.
+static void BenchFilterView(DWORD iterations, DWORD rows) {
+    NamePool names;
+    Snapshot snap;
+    snap.processes.resize(rows);
+    for (DWORD row = 0; row < rows; row++) {
+        WCHAR name[32];
+        StringCchPrintfW(name, 32, L"process_%lu.exe", row % 200);
+        ProcessInfo& proc = snap.processes[row];
+        proc = ProcessInfo();
+        proc.pid = 4 * (row + 1);
+        proc.name = names.Intern(name);
+        proc.cpuUsage = row % 100 / 10.0;
+        proc.memoryUsage = 1024 * 1024 * (SIZE_T)(row % 512 + 1);
+    }
+
+    ProcessFilter filter;
+    std::wstring error;
+    if (!filter.Compile(L"name ~ \"_1\" && cpu > 5 || mem > 256MB", error)) return;
+    ViewOptions options;
+    options.filter = &filter;
+    ProcessView view;
+    LatencyHistogram histogram;
+    for (DWORD i = 0; i < iterations; i++) {
+        ScopedTimer timer(histogram);
+        view.Build(snap, options);
+    }
+    AddResult("filter_view", histogram, rows);
+}
+
+static HANDLE hBenchSnapshot = NULL;
+static ULONGLONG steadyAllocations = 0;  // sampler-thread allocations in the last snapshot
+
+static void OnBenchSnapshot(void*) {
+    SetEvent(hBenchSnapshot);
+}
+
+// The whole sampler at its minimum interval, logger and archive included; its own
+// profiler supplies the per-phase numbers. first_data runs from constructing the sampler
+// to taking its first snapshot.
+static void BenchSampler(DWORD iterations, bool adaptive) {
+    hBenchSnapshot = CreateEventW(NULL, FALSE, FALSE, NULL);
+    if (!hBenchSnapshot) return;
+    LARGE_INTEGER startQpc;
+    QueryPerformanceCounter(&startQpc);
+    Sampler sampler;
+    sampler.SetInterval(MIN_SAMPLE_INTERVAL_MS);
+    sampler.SetAdaptiveSampling(adaptive);
+    if (!sampler.Start(OnBenchSnapshot, NULL)) return;
+    size_t processes = 0;
+    for (DWORD taken = 0; taken < iterations;) {
+        if (WaitForSingleObject(hBenchSnapshot, 10000) != WAIT_OBJECT_0) break;
+        Snapshot* snap = sampler.TakeLatest();
+        if (!snap) continue;
+        if (taken == 0) sampler.GetProfiler().RecordSince(PROFILE_FIRST_DATA, startQpc.QuadPart);
+        processes = snap->processes.size();
+        if (adaptive) steadyAllocations = snap->allocations;
+        sampler.Recycle(snap);
+        taken++;
+    }
+    sampler.Stop();
+    CloseHandle(hBenchSnapshot);
+
+    static const struct { ProfilePhase phase; const char* name; const char* fixedName; } phases[] = {
+        { PROFILE_SAMPLE, "sampler_sample", "sampler_fixed_sample" }, { PROFILE_TRACK, "sampler_track", "sampler_fixed_track" },
+        { PROFILE_ENQUEUE, "sampler_enqueue", "sampler_fixed_enqueue" }, { PROFILE_WRITER, "sampler_writer", "sampler_fixed_writer" },
+        { PROFILE_FIRST_DATA, "sampler_first_data", "sampler_fixed_first_data" },
+    };
+    for (const auto& entry : phases) {
+        AddResult(adaptive ? entry.name : entry.fixedName, sampler.GetProfiler().Phase(entry.phase), processes);
+    }
+}
+
+static void WriteJson(FILE* out, DWORD children, DWORD iterations, DWORD rows, size_t processes) {
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    fprintf(out, "{\n  \"schema\": 1,\n  \"processors\": %lu,\n  \"processes\": %u,\n  \"children\": %lu,\n",
+        (unsigned long)GetActiveProcessorCount(ALL_PROCESSOR_GROUPS), (unsigned)processes, (unsigned long)children);
+    fprintf(out, "  \"iterations\": %lu,\n  \"rows\": %lu,\n  \"steady_state_allocations\": %llu,\n  \"results\": [\n",
+        (unsigned long)iterations, (unsigned long)rows, steadyAllocations);
+    for (size_t i = 0; i < results.size(); i++) {
+        const BenchResult& r = results[i];
+        fprintf(out, "    { \"name\": \"%s\", \"count\": %llu, \"items\": %llu, \"mean_us\": %.1f, \"p50_us\": %llu, "
+            "\"p99_us\": %llu, \"max_us\": %llu, \"items_per_second\": %.0f, \"bytes_per_second\": %.0f }%s\n",
+            r.name, r.latency.count, r.itemsPerIteration, r.latency.meanUs, r.latency.p50Us, r.latency.p99Us,
+            r.latency.maxUs, r.itemsPerSecond, r.bytesPerSecond, i + 1 < results.size() ? "," : "");
+    }
+    fprintf(out, "  ]\n}\n");
+}
+
+int wmain(int argc, wchar_t* argv[]) {
+    DWORD children = 0;
+    DWORD iterations = BENCH_DEFAULT_ITERATIONS;
+    DWORD rows = BENCH_DEFAULT_ROWS;
+    const wchar_t* outPath = NULL;
+
+    for (int i = 1; i < argc; i++) {
+        std::wstring arg = argv[i];
+        if (arg == L"--idle") return 0; // spawned suspended; never actually gets here
+        else if (arg == L"--children" && i + 1 < argc) children = (DWORD)_wtoi(argv[++i]);
+        else if (arg == L"--iterations" && i + 1 < argc) iterations = (DWORD)_wtoi(argv[++i]);
+        else if (arg == L"--rows" && i + 1 < argc) rows = (DWORD)_wtoi(argv[++i]);
+        else if (arg == L"--out" && i + 1 < argc) outPath = argv[++i];
+        else {
+            fwprintf(stderr, L"usage: bench [--children N] [--iterations N] [--rows N] [--out file.json]\n");
+            return 2;
+        }
+    }
+    if (iterations == 0) iterations = 1;
+    if (rows == 0) rows = 1;
+
+    FILE* out = stdout;
+    if (outPath && _wfopen_s(&out, outPath, L"w") != 0) {
+        fwprintf(stderr, L"bench: cannot open %ls\n", outPath);
+        return 1;
+    }
+
+    // The sampler and writer put their files in the working directory.
+    WCHAR scratch[MAX_PATH];
+    DWORD length = GetTempPathW(MAX_PATH, scratch);
+    if (length && SUCCEEDED(StringCchCatW(scratch, MAX_PATH, BENCH_DIRECTORY))) {
+        CreateDirectoryW(scratch, NULL);
+        SetCurrentDirectoryW(scratch);
+    }
+
+    HANDLE hJob = children ? SpawnIdleChildren(children) : NULL;
+    size_t processes = BenchCapture(iterations);
+    BenchPerPid("per_pid_serial", false, iterations);
+    BenchPerPid("per_pid_parallel", true, iterations);
+    BenchHistoryRing(iterations, rows);
+    BenchHistoryStats("history_stats_dispatch", HistoryStatsKernel(), iterations, rows);
+    BenchHistoryStats("history_stats_scalar", HistoryStatsScalar, iterations, rows);
+#ifdef HISTORY_STATS_AVX2
+    if (HistoryStatsUsesAvx2()) BenchHistoryStats("history_stats_avx2", HistoryStatsAvx2, iterations, rows);
+#endif
+    BenchListView(iterations, rows);
+    BenchLogWriter(iterations, rows);
+    BenchFilterView(iterations, rows);
+    BenchSampler(iterations, false);
+    BenchSampler(iterations, true);
+    if (hJob) CloseHandle(hJob);
+
+    WriteJson(out, children, iterations, rows, processes);
+    if (out != stdout) fclose(out);
+    return 0;
+}
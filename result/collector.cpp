@@ -0,0 +1,517 @@
+// Headless collector: runs the same sampling core as the GUI without creating a window,
+// so it can run on Server Core, from a scheduled task, or under a service wrapper.
+//
+//   collector [--collect] [--interval ms] [--duration seconds] [--background] [--quiet]
+//             [--top N] [--sort cpu|memory|name|pid|avgcpu|avgmemory|peakcpu|stddevcpu|p95cpu] [--changed-or-above pct]
+//             [--profile] [--extended] [--group tree|name|session] [--fixed-rate]
+//             [--filter expr] [--alert-filter expr]
+//             [--send host:port [--compress] [--batch samples]] [--no-export]
+//   collector --aggregate port [--interval ms] [--duration seconds] [--top N] [--sort key] [--filter expr]
+//   collector --read-shared [--top N]
+//   collector --fanout-bench refreshes
+//   collector --query pid seconds [create_time]
+//
+// --top, --sort and --changed-or-above print the selected processes after each sample
+// line; only the N rows printed are ordered, so the cost follows N, not the process count.
+// --filter prints only the processes matching an expression such as
+// 'name ~ "cl.exe" && cpu > 5' or 'mem > 1GB' (see core/process_filter.h), and rows are
+// dropped before anything is formatted (the --group totals still cover every process);
+// a matched= line adds up the matching processes. --alert-filter limits the per-process
+// alert rules the same way.
+// --extended adds private bytes, read/write bytes per second, handles, threads and page
+// faults per second to each printed row, and the private/read/write/handles/threads/faults
+// sort keys.
+// --group prints the process tree (each process with its descendants' CPU and memory
+// added in) or per-name or per-session totals after each sample; --top limits the tree's
+// roots or the groups, and --sort name|pid|memory changes their order from CPU.
+// Processes that stay idle are refreshed on a slow tier (see Sampler::SetAdaptiveSampling);
+// each summary line counts the processes refreshed this tick as sampled= and the rest as
+// slow=. --fixed-rate refreshes every process every tick.
+// --profile prints per-phase latency (count, mean, p50, p99, max in microseconds) after
+// each sample; the same table is printed once on exit either way. Its first_data phase is
+// the time from launch to the first snapshot.
+// --send streams every snapshot to an aggregator as wire_protocol.h deltas, reconnecting
+// whenever the connection drops; --compress XPRESS-compresses each frame and --batch sends
+// that many samples per frame. --aggregate listens for collectors and prints the fleet's
+// top N processes (by CPU unless --sort says otherwise) across all connected hosts.
+// Every snapshot is also published into a shared-memory section (core/shared_snapshot.h)
+// unless --no-export is given or another monitor already owns it. --read-shared prints
+// that section once, as any local consumer would read it, with the N busiest processes.
+// --query prints what the history archive holds for a PID over the last 'seconds': for the
+// process created at 'create_time' (a FILETIME, as printed), or else the newest one that
+// had the PID.
+// --fanout-bench times the EnumProcesses fallback serially and on the work-stealing
+// pool, cold (first refresh) and warm (handle cache populated), and prints the speedup.
+//
+// History goes to process_history.bin and alerts to alerts.log in the working directory.
+// Stop it with Ctrl+C or Ctrl+Break; everything queued is written before it exits.
+#define _UNICODE
+#define UNICODE
+#include <winsock2.h> // before windows.h; see core/remote_stream.h
+#include <windows.h>
+#include <cstdio>
+#include <cwchar>
+#include <algorithm>
+
+#include "core/sampler.h"
+#include "core/process_view.h"
+#include "core/process_tree.h"
+#include "core/remote_stream.h"
+#include "core/alloc_counter.h"
+
+#define COLLECTOR_TRIM_INTERVAL_MS 300000 // how often to hand unused pages back
+
+#ifndef PROCESS_MODE_BACKGROUND_BEGIN
+#define PROCESS_MODE_BACKGROUND_BEGIN 0x00100000
+#endif
+
+static HANDLE hStopEvent = NULL;
+static HANDLE hSnapshotEvent = NULL;
+
+static BOOL WINAPI OnConsoleCtrl(DWORD ctrlType) {
+    switch (ctrlType) {
+    case CTRL_C_EVENT:
+    case CTRL_BREAK_EVENT:
+    case CTRL_CLOSE_EVENT:
+    case CTRL_SHUTDOWN_EVENT:
+        SetEvent(hStopEvent);
+        return TRUE;
+    }
+    return FALSE;
+}
+
+static void OnSnapshotReady(void*) {
+    SetEvent(hSnapshotEvent);
+}
+
+static void TrimWorkingSet() {
+    SetProcessWorkingSetSize(GetCurrentProcess(), (SIZE_T)-1, (SIZE_T)-1);
+}
+
+static void PrintSnapshot(const Snapshot& snap, ProcessView& view, const ViewOptions& options, bool showRows) {
+    FILETIME ft;
+    ft.dwLowDateTime = (DWORD)snap.sampleTime;
+    ft.dwHighDateTime = (DWORD)(snap.sampleTime >> 32);
+    SYSTEMTIME st;
+    FileTimeToSystemTime(&ft, &st);
+    wprintf(L"%04u-%02u-%02uT%02u:%02u:%02uZ processes=%u cpu=%.2f%% kernel=%.2f%% cores=%u busiest=%.2f%% imbalance=%.2f memory=%.2fMB added=%u exited=%u self_cpu=%.2f%% self_ws=%.2fMB self_private=%.2fMB allocations=%llu sampled=%u slow=%u\n",
+        st.wYear, st.wMonth, st.wDay, st.wHour, st.wMinute, st.wSecond,
+        (unsigned)snap.processes.size(), snap.totalCpuUsage, snap.kernelCpuUsage, (unsigned)snap.coreUsage.size(),
+        snap.maxCoreUsage, snap.coreImbalance, snap.totalMemoryUsage / (1024.0 * 1024.0),
+        (unsigned)snap.addedRows.size(), (unsigned)snap.exited.size(), snap.selfCpuUsage,
+        snap.selfWorkingSet / (1024.0 * 1024.0), snap.selfPrivateBytes / (1024.0 * 1024.0), snap.allocations,
+        snap.sampledProcesses, snap.slowTierProcesses);
+    if (showRows) {
+        view.Build(snap, options);
+        WCHAR fields[512];
+        for (size_t i = 0; i < view.Size(); i++) {
+            const ProcessInfo& proc = snap.processes[view.Row(i)];
+            CollectorRowMetrics::FormatFields(proc, fields, ARRAYSIZE(fields));
+            wprintf(L"  pid=%lu name=%ls%ls\n", proc.pid, proc.name->c_str(), fields);
+            if (snap.extended) {
+                ExtendedMetrics::FormatFields(proc, fields, ARRAYSIZE(fields));
+                wprintf(L"   %ls\n", fields);
+            }
+        }
+        // What the filter kept, before --top cut it down.
+        if (options.filter && !options.filter->Empty()) {
+            CollectorRowMetrics::Totals totals;
+            for (const auto& proc : snap.processes) {
+                if (options.filter->Matches(proc)) CollectorRowMetrics::Add(totals, proc);
+            }
+            CollectorRowMetrics::FormatTotals(totals, fields, ARRAYSIZE(fields));
+            wprintf(L"  matched=%u%ls\n", (unsigned)totals.rows, fields);
+        }
+    }
+    for (const auto& proc : snap.transient) {
+        wprintf(L"  transient pid=%lu parent=%lu name=%ls lifetime_ms=%.1f exit_status=%ld\n", proc.pid, proc.parentPid,
+            proc.name->c_str(), (proc.exitTime - proc.startTime) / 10000.0, proc.exitStatus);
+    }
+    for (const auto& alert : snap.alerts) wprintf(L"ALERT %ls\n", alert.message.c_str());
+    fflush(stdout);
+}
+
+// The tree follows every snapshot it is given; a skipped one makes it rebuild.
+static void PrintGroups(const Snapshot& snap, ProcessTree& tree, GroupMode mode, const ViewOptions& options,
+                        std::vector<UINT>& changed) {
+    tree.Apply(snap);
+    tree.Refresh(mode, options, changed);
+    for (const auto& row : tree.Rows()) {
+        if (mode == GROUP_TREE) {
+            const TreeNode& node = tree.Node(row.node);
+            wprintf(L"  tree depth=%d pid=%lu parent=%lu name=%ls processes=%u cpu=%.2f%% memory=%.2fMB\n", row.depth,
+                node.key.pid, node.parentPid, node.name->c_str(), node.subtreeCount,
+                node.subtreeCpu > 0.0 ? node.subtreeCpu : 0.0, node.subtreeMemory / (1024.0 * 1024.0));
+        } else if (mode == GROUP_NAME) {
+            wprintf(L"  group name=%ls processes=%u cpu=%.2f%% memory=%.2fMB\n", row.group->name->c_str(),
+                row.group->count, row.group->cpu > 0.0 ? row.group->cpu : 0.0, row.group->memory / (1024.0 * 1024.0));
+        } else {
+            wprintf(L"  group session=%lu processes=%u cpu=%.2f%% memory=%.2fMB\n", row.group->sessionId,
+                row.group->count, row.group->cpu > 0.0 ? row.group->cpu : 0.0, row.group->memory / (1024.0 * 1024.0));
+        }
+    }
+    fflush(stdout);
+}
+
+// Phases that never ran (the per-PID fallback, the GUI's list views) are skipped.
+static void PrintProfile(const Profiler& profiler) {
+    for (int phase = 0; phase < PROFILE_PHASE_COUNT; phase++) {
+        LatencySummary summary = profiler.Summarize((ProfilePhase)phase);
+        if (summary.count == 0) continue;
+        wprintf(L"profile phase=%ls count=%llu mean_us=%.1f p50_us=%llu p99_us=%llu max_us=%llu\n",
+            ProfilePhaseName((ProfilePhase)phase), summary.count, summary.meanUs, summary.p50Us, summary.p99Us, summary.maxUs);
+    }
+    fflush(stdout);
+}
+
+static void PrintUsage() {
+    fwprintf(stderr, L"usage: collector [--collect] [--interval ms] [--duration seconds] [--background] [--quiet]\n");
+    fwprintf(stderr, L"                 [--top N] [--sort cpu|memory|name|pid|avgcpu|avgmemory|peakcpu|stddevcpu|p95cpu] [--changed-or-above pct]\n");
+    fwprintf(stderr, L"                 [--profile] [--extended] [--group tree|name|session] [--fixed-rate]\n");
+    fwprintf(stderr, L"                 [--filter expr] [--alert-filter expr]\n");
+    fwprintf(stderr, L"                 [--send host:port [--compress] [--batch samples]] [--no-export]\n");
+    fwprintf(stderr, L"       collector --aggregate port [--interval ms] [--duration seconds] [--top N] [--sort key] [--filter expr]\n");
+    fwprintf(stderr, L"       collector --read-shared [--top N]\n");
+    fwprintf(stderr, L"       collector --fanout-bench refreshes\n");
+    fwprintf(stderr, L"       collector --query pid seconds [create_time]\n");
+}
+
+// Reads the section the way an outside consumer would: no sampler, no files.
+static int RunSharedRead(size_t top) {
+    SharedSnapshotReader reader;
+    if (!reader.Open()) {
+        fwprintf(stderr, L"collector: no shared snapshot (is a monitor running?)\n");
+        return 1;
+    }
+    SharedSnapshotHeader totals;
+    std::vector<SharedProcessRecord> records;
+    if (!reader.Read(totals, records)) {
+        fwprintf(stderr, L"collector: the shared snapshot is not ready\n");
+        return 1;
+    }
+    FILETIME ft;
+    ft.dwLowDateTime = (DWORD)totals.sampleTime;
+    ft.dwHighDateTime = (DWORD)(totals.sampleTime >> 32);
+    SYSTEMTIME st;
+    FileTimeToSystemTime(&ft, &st);
+    wprintf(L"%04u-%02u-%02uT%02u:%02u:%02uZ writer=%lu sequence=%llu processes=%u exported=%u cpu=%.2f%% kernel=%.2f%% memory=%.2fMB\n",
+        st.wYear, st.wMonth, st.wDay, st.wHour, st.wMinute, st.wSecond, totals.writerPid, totals.snapshotSequence,
+        totals.totalProcesses, totals.processCount, totals.totalCpuUsage, totals.kernelCpuUsage,
+        totals.totalMemoryUsage / (1024.0 * 1024.0));
+    if (top && top < records.size()) {
+        std::partial_sort(records.begin(), records.begin() + top, records.end(),
+            [](const SharedProcessRecord& a, const SharedProcessRecord& b) { return a.cpuUsage > b.cpuUsage; });
+        records.resize(top);
+    }
+    for (const auto& record : records) {
+        wprintf(L"  pid=%lu parent=%lu name=%ls cpu=%.2f%% memory=%.2fMB avg_cpu=%.2f%% avg_memory=%.2fMB peak_cpu=%.2f%%\n",
+            record.pid, record.parentPid, record.name, record.cpuUsage, record.memoryUsage / (1024.0 * 1024.0),
+            record.avgCpuUsage, record.avgMemoryUsage / (1024.0 * 1024.0), record.peakCpuUsage);
+    }
+    return 0;
+}
+
+// 'createTime' 0 picks the newest process that had the pid in the range.
+static int RunArchiveQuery(DWORD pid, DWORD seconds, ULONGLONG createTime) {
+    FILETIME ftNow;
+    GetSystemTimeAsFileTime(&ftNow);
+    ULONGLONG t1 = ((ULONGLONG)ftNow.dwHighDateTime << 32) | ftNow.dwLowDateTime;
+    ULONGLONG span = (ULONGLONG)seconds * 10000000ULL;
+    ULONGLONG t0 = t1 > span ? t1 - span : 0;
+
+    HistoryArchiveReader reader;
+    reader.Open(ARCHIVE_DIRECTORY, t0, t1);
+    std::vector<const ArchiveRecord*> records;
+    ProcessKey process = { pid, createTime };
+    if (createTime || reader.FindProcess(pid, t1, process)) reader.QueryRange(process, t0, t1, records);
+    for (const ArchiveRecord* record : records) {
+        FILETIME ft;
+        ft.dwLowDateTime = (DWORD)record->timestamp;
+        ft.dwHighDateTime = (DWORD)(record->timestamp >> 32);
+        SYSTEMTIME st;
+        FileTimeToSystemTime(&ft, &st);
+        wprintf(L"%04u-%02u-%02uT%02u:%02u:%02uZ pid=%lu create_time=%llu cpu=%.2f%% memory=%.2fMB%ls\n",
+            st.wYear, st.wMonth, st.wDay, st.wHour, st.wMinute, st.wSecond, record->pid, record->createTime,
+            record->cpuUsage, record->workingSet / (1024.0 * 1024.0), (record->flags & ARCHIVE_RECORD_EXITED) ? L" exited" : L"");
+    }
+    wprintf(L"segments=%u records=%u\n", (unsigned)reader.SegmentCount(), (unsigned)records.size());
+    return 0;
+}
+
+static double ElapsedMs(const LARGE_INTEGER& start, const LARGE_INTEGER& frequency) {
+    LARGE_INTEGER now;
+    QueryPerformanceCounter(&now);
+    return (now.QuadPart - start.QuadPart) * 1000.0 / frequency.QuadPart;
+}
+
+// Returns false if EnumProcesses failed. 'warmMs' is the mean over 'refreshes' warm runs.
+static bool TimePerPid(bool parallel, DWORD refreshes, double& coldMs, double& warmMs, size_t& processes, size_t& workers) {
+    PerPidQuery query;
+    query.SetParallel(parallel);
+    NamePool names;
+    std::vector<ProcessInfo> out;
+    LARGE_INTEGER frequency, start;
+    QueryPerformanceFrequency(&frequency);
+
+    QueryPerformanceCounter(&start);
+    if (!query.Query(out, names)) return false;
+    coldMs = ElapsedMs(start, frequency);
+    processes = out.size();
+
+    QueryPerformanceCounter(&start);
+    for (DWORD i = 0; i < refreshes; i++) {
+        out.clear();
+        if (!query.Query(out, names)) return false;
+    }
+    warmMs = ElapsedMs(start, frequency) / refreshes;
+    workers = query.WorkerCount();
+    return true;
+}
+
+static int RunFanoutBench(DWORD refreshes) {
+    if (refreshes == 0) refreshes = 1;
+    double serialCold, serialWarm, parallelCold, parallelWarm;
+    size_t processes, workers;
+    if (!TimePerPid(false, refreshes, serialCold, serialWarm, processes, workers)
+        || !TimePerPid(true, refreshes, parallelCold, parallelWarm, processes, workers)) {
+        fwprintf(stderr, L"collector: EnumProcesses failed (error %lu)\n", GetLastError());
+        return 1;
+    }
+    wprintf(L"processes=%u workers=%u refreshes=%lu\n", (unsigned)processes, (unsigned)workers, refreshes);
+    wprintf(L"cold: serial=%.3fms parallel=%.3fms speedup=%.2fx\n", serialCold, parallelCold,
+        parallelCold > 0 ? serialCold / parallelCold : 0.0);
+    wprintf(L"warm: serial=%.3fms parallel=%.3fms speedup=%.2fx\n", serialWarm, parallelWarm,
+        parallelWarm > 0 ? serialWarm / parallelWarm : 0.0);
+    return 0;
+}
+
+// Prints the fleet once per interval; between prints it only waits on the sockets.
+static int RunAggregator(const wchar_t* port, DWORD intervalMs, DWORD durationSeconds, ViewOptions options) {
+    Aggregator aggregator;
+    if (!aggregator.Listen(port)) {
+        fwprintf(stderr, L"collector: cannot listen on port %ls (error %d)\n", port, WSAGetLastError());
+        return 1;
+    }
+    if (!options.topN) options.topN = 20;
+    if (options.key == SORT_NONE) options.key = SORT_CPU;
+    wprintf(L"aggregating on port %ls\n", port);
+
+    Snapshot fleet;
+    std::vector<const std::wstring*> hosts;
+    ProcessView view;
+    ULONGLONG startMs = GetTickCount64();
+    ULONGLONG nextPrintMs = startMs + intervalMs;
+    while (WaitForSingleObject(hStopEvent, 0) == WAIT_TIMEOUT) {
+        ULONGLONG nowMs = GetTickCount64();
+        if (durationSeconds && nowMs - startMs >= (ULONGLONG)durationSeconds * 1000) break;
+        if (nowMs < nextPrintMs) {
+            aggregator.Poll((DWORD)(nextPrintMs - nowMs));
+            continue;
+        }
+        nextPrintMs += intervalMs;
+        if (nextPrintMs <= nowMs) nextPrintMs = nowMs + intervalMs;
+
+        aggregator.BuildFleet(fleet, hosts);
+        view.Build(fleet, options);
+        wprintf(L"fleet hosts=%u processes=%u cpu=%.2f%% memory=%.2fMB received=%llu\n", (unsigned)aggregator.HostCount(),
+            (unsigned)fleet.processes.size(), fleet.totalCpuUsage, fleet.totalMemoryUsage / (1024.0 * 1024.0),
+            aggregator.BytesReceived());
+        for (size_t i = 0; i < view.Size(); i++) {
+            UINT row = view.Row(i);
+            const ProcessInfo& proc = fleet.processes[row];
+            wprintf(L"  host=%ls pid=%lu name=%ls cpu=%.2f%% memory=%.2fMB\n", hosts[row]->c_str(), proc.pid,
+                proc.name->c_str(), proc.cpuUsage, proc.memoryUsage / (1024.0 * 1024.0));
+        }
+        fflush(stdout);
+    }
+    return 0;
+}
+
+int wmain(int argc, wchar_t* argv[]) {
+    LARGE_INTEGER startQpc;
+    QueryPerformanceCounter(&startQpc);
+    DWORD intervalMs = DEFAULT_SAMPLE_INTERVAL_MS;
+    DWORD durationSeconds = 0; // 0 runs until stopped
+    bool background = false;
+    bool quiet = false;
+    bool showRows = false;
+    bool profile = false;
+    bool extended = false;
+    bool adaptive = true;
+    bool exportShared = true;
+    bool readShared = false;
+    const wchar_t* sendTarget = NULL;
+    const wchar_t* aggregatePort = NULL;
+    bool compress = false;
+    DWORD batch = 1;
+    GroupMode groupMode = GROUP_NONE;
+    ViewOptions viewOptions;
+    const wchar_t* filterText = NULL;
+    const wchar_t* alertFilterText = NULL;
+
+    for (int i = 1; i < argc; i++) {
+        std::wstring arg = argv[i];
+        if (arg == L"--collect") continue; // the only mode; accepted for symmetry with scripts
+        else if (arg == L"--interval" && i + 1 < argc) intervalMs = (DWORD)_wtoi(argv[++i]);
+        else if (arg == L"--duration" && i + 1 < argc) durationSeconds = (DWORD)_wtoi(argv[++i]);
+        else if (arg == L"--background") background = true;
+        else if (arg == L"--quiet") quiet = true;
+        else if (arg == L"--profile") profile = true;
+        else if (arg == L"--send" && i + 1 < argc) sendTarget = argv[++i];
+        else if (arg == L"--compress") compress = true;
+        else if (arg == L"--batch" && i + 1 < argc) batch = (DWORD)_wtoi(argv[++i]);
+        else if (arg == L"--aggregate" && i + 1 < argc) aggregatePort = argv[++i];
+        else if (arg == L"--top" && i + 1 < argc) {
+            int top = _wtoi(argv[++i]);
+            viewOptions.topN = top > 0 ? (size_t)top : 0;
+            showRows = true;
+        }
+        else if (arg == L"--extended") extended = true;
+        else if (arg == L"--fixed-rate") adaptive = false;
+        else if (arg == L"--no-export") exportShared = false;
+        else if (arg == L"--read-shared") readShared = true;
+        else if (arg == L"--filter" && i + 1 < argc) {
+            filterText = argv[++i];
+            showRows = true;
+        }
+        else if (arg == L"--alert-filter" && i + 1 < argc) alertFilterText = argv[++i];
+        else if (arg == L"--group" && i + 1 < argc && ParseGroupMode(argv[i + 1], groupMode)) i++;
+        else if (arg == L"--sort" && i + 1 < argc && ParseSortKey(argv[i + 1], viewOptions.key)) {
+            viewOptions.descending = viewOptions.key != SORT_NAME && viewOptions.key != SORT_PID;
+            showRows = true;
+            i++;
+        }
+        else if (arg == L"--changed-or-above" && i + 1 < argc) {
+            viewOptions.onlyInteresting = true;
+            viewOptions.cpuThreshold = _wtof(argv[++i]);
+            showRows = true;
+        }
+        else if (arg == L"--fanout-bench" && i + 1 < argc) return RunFanoutBench((DWORD)_wtoi(argv[++i]));
+        else if (arg == L"--query" && i + 2 < argc) {
+            ULONGLONG createTime = i + 3 < argc ? _wcstoui64(argv[i + 3], NULL, 10) : 0;
+            return RunArchiveQuery((DWORD)_wtoi(argv[i + 1]), (DWORD)_wtoi(argv[i + 2]), createTime);
+        }
+        else {
+            PrintUsage();
+            return 2;
+        }
+    }
+
+    if (readShared) return RunSharedRead(viewOptions.topN);
+
+    ProcessFilter rowFilter;
+    std::wstring filterError;
+    if (filterText) {
+        if (!rowFilter.Compile(filterText, filterError)) {
+            fwprintf(stderr, L"collector: --filter: %ls\n", filterError.c_str());
+            return 2;
+        }
+        viewOptions.filter = &rowFilter;
+    }
+
+    // Background mode also lowers I/O and memory priority; otherwise just stay out of the way.
+    if (!background || !SetPriorityClass(GetCurrentProcess(), PROCESS_MODE_BACKGROUND_BEGIN)) {
+        SetPriorityClass(GetCurrentProcess(), BELOW_NORMAL_PRIORITY_CLASS);
+    }
+
+    hStopEvent = CreateEventW(NULL, TRUE, FALSE, NULL);
+    hSnapshotEvent = CreateEventW(NULL, FALSE, FALSE, NULL);
+    if (!hStopEvent || !hSnapshotEvent) return 1;
+    SetConsoleCtrlHandler(OnConsoleCtrl, TRUE);
+
+    if (aggregatePort) return RunAggregator(aggregatePort, intervalMs ? intervalMs : DEFAULT_SAMPLE_INTERVAL_MS,
+        durationSeconds, viewOptions);
+
+    // A bare --top means the busiest processes.
+    if (viewOptions.topN && viewOptions.key == SORT_NONE) viewOptions.key = SORT_CPU;
+    ProcessView view;
+    ProcessTree tree;
+    std::vector<UINT> changedGroupRows;
+
+    Sampler sampler;
+    sampler.SetInterval(intervalMs);
+    sampler.SetExtendedCounters(extended);
+    sampler.SetAdaptiveSampling(adaptive);
+    sampler.SetSharedExport(exportShared);
+    if (alertFilterText && !sampler.SetAlertFilter(alertFilterText, filterError)) {
+        fwprintf(stderr, L"collector: --alert-filter: %ls\n", filterError.c_str());
+        return 2;
+    }
+    if (!quiet) {
+        const SystemTopology& topology = sampler.GetTopology();
+        wprintf(L"topology: processors=%lu groups=%u numa_nodes=%lu memory=%.2fMB\n", topology.logicalProcessors,
+            (unsigned)topology.groupSizes.size(), topology.numaNodes, topology.totalPhysicalMemory / (1024.0 * 1024.0));
+    }
+    if (!sampler.Start(OnSnapshotReady, NULL)) {
+        fwprintf(stderr, L"collector: cannot start the sampler (error %lu)\n", GetLastError());
+        return 1;
+    }
+    RemoteSender sender;
+    if (sendTarget && !sender.Start(sendTarget, compress, batch)) {
+        fwprintf(stderr, L"collector: cannot start sending to %ls\n", sendTarget);
+        return 1;
+    }
+    if (!quiet) {
+        wprintf(L"process_events=%ls shared_export=%ls\n", sampler.GetProcessEventStats().active ? L"etw" : L"polling",
+            sampler.IsSharedExportActive() ? SHARED_SNAPSHOT_NAME : L"off");
+    }
+
+    ULONGLONG startMs = GetTickCount64();
+    ULONGLONG lastTrimMs = 0;
+    bool trimmed = false;
+    bool first = true;
+    HANDLE waits[] = { hStopEvent, hSnapshotEvent };
+    for (;;) {
+        DWORD timeout = INFINITE;
+        if (durationSeconds) {
+            ULONGLONG elapsed = GetTickCount64() - startMs;
+            ULONGLONG limit = (ULONGLONG)durationSeconds * 1000;
+            if (elapsed >= limit) break;
+            timeout = (DWORD)(limit - elapsed);
+        }
+
+        DWORD result = WaitForMultipleObjects(2, waits, FALSE, timeout);
+        if (result != WAIT_OBJECT_0 + 1) break;
+
+        Snapshot* snap = sampler.TakeLatest();
+        if (!snap) continue;
+        if (first) {
+            sampler.GetProfiler().RecordSince(PROFILE_FIRST_DATA, startQpc.QuadPart);
+            first = false;
+        }
+        if (!quiet) PrintSnapshot(*snap, view, viewOptions, showRows);
+        if (!quiet && groupMode != GROUP_NONE) PrintGroups(*snap, tree, groupMode, viewOptions, changedGroupRows);
+        if (!quiet && profile) PrintProfile(sampler.GetProfiler());
+        if (sendTarget) sender.Send(*snap);
+        sampler.Recycle(snap);
+
+        // Startup touches pages that steady-state sampling never needs again.
+        ULONGLONG nowMs = GetTickCount64();
+        if (!trimmed || nowMs - lastTrimMs >= COLLECTOR_TRIM_INTERVAL_MS) {
+            TrimWorkingSet();
+            trimmed = true;
+            lastTrimMs = nowMs;
+        }
+    }
+
+    sampler.Stop();
+    sender.Stop();
+    LoggerStats stats = sampler.GetLoggerStats();
+    ProcessEventStats events = sampler.GetProcessEventStats();
+    if (!quiet) {
+        wprintf(L"samples=%llu dropped=%llu bytes=%llu alerts_dropped=%llu archive_skipped=%llu\n",
+            stats.samplesQueued, stats.samplesDropped, stats.bytesWritten, stats.alertsDropped, stats.archiveSkipped);
+        wprintf(L"process_events received=%llu dropped=%llu transient=%llu\n",
+            events.received, events.dropped, events.transient);
+        if (sendTarget) {
+            RemoteSenderStats remote = sender.GetStats();
+            wprintf(L"remote samples=%llu frames=%llu bytes=%llu bytes_per_sample=%.1f dropped=%llu connections=%llu\n",
+                remote.samplesSent, remote.framesSent, remote.bytesSent,
+                remote.samplesSent ? (double)remote.bytesSent / remote.samplesSent : 0.0, remote.framesDropped, remote.connections);
+        }
+        PrintProfile(sampler.GetProfiler());
+    }
+    CloseHandle(hSnapshotEvent);
+    CloseHandle(hStopEvent);
+    return 0;
+}
@@ -0,0 +1,167 @@
+// Alert rule evaluation and the alerts.log sink. Front ends decide how to show alerts.
+#pragma once
+
+#include <windows.h>
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <strsafe.h>
+
+#include "process_types.h"
+#include "process_filter.h"
+
+#define ALERT_CPU_HYSTERESIS 5.0        // percentage points below the threshold to re-arm
+#define ALERT_MEMORY_HYSTERESIS 0.05    // fraction of the threshold below it to re-arm
+#define ALERT_MIN_REPEAT_MS 60000       // per (process, rule)
+#define ALERT_BURST 5                   // global token bucket: burst size
+#define ALERT_REFILL_MS 10000           // ...and one token per this many ms
+
+// Evaluates alert rules against a complete snapshot. Each (process, rule) pair enters
+// the alerting state above its threshold and only re-arms after dropping a hysteresis
+// margin below it, fires at most once per ALERT_MIN_REPEAT_MS, and all rules share a
+// token bucket so a burst of offenders cannot flood the sinks.
+class AlertEngine {
+private:
+    struct AlertKey {
+        ProcessKey process;
+        AlertRule rule;
+
+        bool operator==(const AlertKey& other) const {
+            return process == other.process && rule == other.rule;
+        }
+    };
+
+    struct AlertKeyHash {
+        size_t operator()(const AlertKey& key) const {
+            return ProcessKeyHash()(key.process) * 31 + key.rule;
+        }
+    };
+
+    struct AlertState {
+        bool active = false;
+        ULONGLONG lastFiredMs = 0;
+        ULONGLONG lastSeen = 0;
+    };
+
+    std::unordered_map<AlertKey, AlertState, AlertKeyHash> states;
+    ULONGLONG generation = 0;
+    double tokens = ALERT_BURST;
+    ULONGLONG lastRefillMs = 0;
+    ULONGLONG fired = 0;
+    ULONGLONG suppressed = 0;
+
+    bool TakeToken(ULONGLONG nowMs) {
+        if (lastRefillMs) tokens += (double)(nowMs - lastRefillMs) / ALERT_REFILL_MS;
+        if (tokens > ALERT_BURST) tokens = ALERT_BURST;
+        lastRefillMs = nowMs;
+        if (tokens < 1.0) return false;
+        tokens -= 1.0;
+        return true;
+    }
+
+    // Returns true when the caller should raise an alert for this key now.
+    bool Update(const AlertKey& key, double value, double threshold, double rearmBelow, ULONGLONG nowMs) {
+        AlertState& state = states[key];
+        state.lastSeen = generation;
+        if (!state.active) {
+            if (value <= threshold) return false;
+            state.active = true;
+        } else if (value < rearmBelow) {
+            state.active = false;
+            return false;
+        }
+        if (state.lastFiredMs && nowMs - state.lastFiredMs < ALERT_MIN_REPEAT_MS) return false;
+        if (!TakeToken(nowMs)) {
+            suppressed++;
+            return false;
+        }
+        state.lastFiredMs = nowMs;
+        fired++;
+        return true;
+    }
+
+public:
+    // Per-process rules only cover processes that match 'filter', when one is given.
+    void Evaluate(const Snapshot& snap, double cpuThreshold, double memoryThreshold, ULONGLONG nowMs, std::vector<Alert>& out,
+                  ProcessFilter* filter = nullptr) {
+        generation++;
+
+        for (const auto& proc : snap.processes) {
+            if (filter && !filter->Matches(proc)) continue;
+            AlertKey key = { { proc.pid, proc.createTime }, ALERT_PROCESS_CPU };
+            if (!Update(key, proc.cpuUsage, cpuThreshold, cpuThreshold - ALERT_CPU_HYSTERESIS, nowMs)) continue;
+
+            Alert alert = { ALERT_PROCESS_CPU, proc.pid, *proc.name, proc.cpuUsage, cpuThreshold, L"" };
+            WCHAR alertMsg[256];
+            StringCchPrintfW(alertMsg, 256, L"%s (PID: %lu) - CPU: %.2f%% exceeds %.2f%%",
+                proc.name->c_str(), proc.pid, proc.cpuUsage, cpuThreshold);
+            alert.message = alertMsg;
+            out.push_back(alert);
+        }
+
+        double totalMemory = (double)snap.totalMemoryUsage;
+        AlertKey memoryKey = { { 0, 0 }, ALERT_SYSTEM_MEMORY };
+        if (Update(memoryKey, totalMemory, memoryThreshold, memoryThreshold * (1.0 - ALERT_MEMORY_HYSTERESIS), nowMs)) {
+            Alert alert = { ALERT_SYSTEM_MEMORY, 0, L"", totalMemory, memoryThreshold, L"" };
+            WCHAR alertMsg[256];
+            StringCchPrintfW(alertMsg, 256, L"Total Memory Usage: %.2f MB exceeds %.2f MB",
+                totalMemory / (1024.0 * 1024.0), memoryThreshold / (1024.0 * 1024.0));
+            alert.message = alertMsg;
+            out.push_back(alert);
+        }
+
+        // Forget processes that have exited so the state table tracks the live set.
+        for (auto it = states.begin(); it != states.end();) {
+            if (it->second.lastSeen != generation) it = states.erase(it);
+            else ++it;
+        }
+    }
+
+    ULONGLONG GetFiredCount() const {
+        return fired;
+    }
+
+    ULONGLONG GetSuppressedCount() const {
+        return suppressed;
+    }
+};
+
+// Appends alerts to alerts.log through one long-lived handle. Lines are formatted where
+// the alert fired and written elsewhere, so the sampler never waits on the disk; the
+// history logger's thread does the writing (see HistoryLogger::EnqueueAlert).
+class AlertLogSink {
+private:
+    HANDLE hFile = INVALID_HANDLE_VALUE;
+
+public:
+    ~AlertLogSink() {
+        Close();
+    }
+
+    bool Open(const wchar_t* path) {
+        hFile = CreateFileW(path, FILE_APPEND_DATA, FILE_SHARE_READ, NULL, OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+        return hFile != INVALID_HANDLE_VALUE;
+    }
+
+    void Close() {
+        if (hFile != INVALID_HANDLE_VALUE) CloseHandle(hFile);
+        hFile = INVALID_HANDLE_VALUE;
+    }
+
+    // The timestamped UTF-8 line for 'alert', without a terminator; 0 if it cannot be encoded.
+    static DWORD FormatLine(const Alert& alert, char* utf8, DWORD size) {
+        SYSTEMTIME st;
+        GetLocalTime(&st);
+        WCHAR line[384];
+        StringCchPrintfW(line, 384, L"%04u-%02u-%02u %02u:%02u:%02u %s\r\n",
+            st.wYear, st.wMonth, st.wDay, st.wHour, st.wMinute, st.wSecond, alert.message.c_str());
+        int bytes = WideCharToMultiByte(CP_UTF8, 0, line, -1, utf8, (int)size, NULL, NULL);
+        return bytes > 1 ? (DWORD)(bytes - 1) : 0;
+    }
+
+    void Write(const char* lines, size_t size) {
+        if (hFile == INVALID_HANDLE_VALUE || !size) return;
+        DWORD written;
+        WriteFile(hFile, lines, (DWORD)size, &written, NULL);
+    }
+};
@@ -0,0 +1,65 @@
+// Replaces the global operator new and delete with counting versions. Include it from
+// exactly one translation unit of a program (each front end is a single file); the
+// counters themselves live in profiler.h and stay at 0 in programs that do not.
+#pragma once
+
+#include <cstdlib>
+#include <new>
+
+#include "profiler.h"
+
+static struct AllocationCounterInstaller {
+    AllocationCounterInstaller() {
+        AllocationCountingEnabled() = true;
+    }
+} allocationCounterInstaller;
+
+inline void* CountedAllocate(std::size_t size) {
+    ThreadAllocationCount()++;
+    ProcessAllocationCount().fetch_add(1, std::memory_order_relaxed);
+    return std::malloc(size ? size : 1);
+}
+
+void* operator new(std::size_t size) {
+    void* block = CountedAllocate(size);
+    if (!block) throw std::bad_alloc();
+    return block;
+}
+
+void* operator new[](std::size_t size) {
+    void* block = CountedAllocate(size);
+    if (!block) throw std::bad_alloc();
+    return block;
+}
+
+void* operator new(std::size_t size, const std::nothrow_t&) noexcept {
+    return CountedAllocate(size);
+}
+
+void* operator new[](std::size_t size, const std::nothrow_t&) noexcept {
+    return CountedAllocate(size);
+}
+
+void operator delete(void* block) noexcept {
+    std::free(block);
+}
+
+void operator delete[](void* block) noexcept {
+    std::free(block);
+}
+
+void operator delete(void* block, std::size_t) noexcept {
+    std::free(block);
+}
+
+void operator delete[](void* block, std::size_t) noexcept {
+    std::free(block);
+}
+
+void operator delete(void* block, const std::nothrow_t&) noexcept {
+    std::free(block);
+}
+
+void operator delete[](void* block, const std::nothrow_t&) noexcept {
+    std::free(block);
+}
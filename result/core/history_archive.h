@@ -0,0 +1,490 @@
+// Memory-mapped, append-only archive of process samples that can be queried by process
+// and time range without parsing anything.
+//
+// The archive is a directory of segment files, each written through one mapped view:
+//
+//   ArchiveSegmentHeader
+//   ArchivePidSlot[pidSlots]       open-addressing table: pid -> newest record of that pid
+//   ArchiveTimeEntry[timeSlots]    sparse time index: one entry every timeStride samples
+//   ArchiveRecord[recordCapacity]  appended in time order
+//
+// Records are change points: a process gets a record when it first appears in a segment,
+// when its CPU or working set changes, and when it exits. Every segment starts with a
+// record for each live process, so it can be read on its own. Each record links to the
+// previous record of the same pid, which is how QueryRange walks one process; a reused
+// pid shares the chain, and the records' createTime tells the processes apart.
+//
+// A segment is closed and a new one started when it runs out of records, time-index or
+// pid slots, or after ARCHIVE_SEGMENT_MAX_AGE_MS. Its pid table is sized when it is
+// opened, to at least four slots per live process. Closed segments are truncated to
+// their used size and the oldest are deleted beyond ARCHIVE_MAX_SEGMENTS.
+#pragma once
+
+#include <windows.h>
+#include <vector>
+#include <string>
+#include <unordered_map>
+#include <algorithm>
+#include <strsafe.h>
+
+#include "process_types.h"
+#include "log_record.h"
+
+#define ARCHIVE_DIRECTORY L"history_archive"
+#define ARCHIVE_MAGIC 0x31414D50 // "PMA1"
+#define ARCHIVE_VERSION 1
+#define ARCHIVE_SEGMENT_RECORDS (1 << 19)          // 20 MB of records
+#define ARCHIVE_PID_SLOTS 8192                      // at least; power of two, kept at most half full
+#define ARCHIVE_TIME_SLOTS 8192
+#define ARCHIVE_TIME_STRIDE 4                       // samples per time-index entry
+#define ARCHIVE_SEGMENT_MAX_AGE_MS (60 * 60 * 1000)
+#define ARCHIVE_MAX_SEGMENTS 24
+#define ARCHIVE_NO_RECORD 0xFFFFFFFF
+#define ARCHIVE_RECORD_EXITED 0x1
+
+struct ArchiveSegmentHeader {
+    DWORD magic;
+    DWORD version;
+    DWORD recordSize;
+    DWORD recordCapacity;
+    DWORD pidSlots;
+    DWORD timeSlots;
+    DWORD timeStride;
+    volatile LONG recordCount;   // published after the records it covers are written
+    DWORD timeCount;
+    DWORD sampleCount;
+    ULONGLONG firstTime;         // FILETIME, UTC
+    ULONGLONG lastTime;
+    ULONGLONG pidTableOffset;    // byte offsets from the start of the file
+    ULONGLONG timeIndexOffset;
+    ULONGLONG recordsOffset;
+};
+
+struct ArchivePidSlot {
+    DWORD pidPlusOne;            // 0 marks an empty slot
+    DWORD newestRecord;
+};
+
+struct ArchiveTimeEntry {
+    ULONGLONG timestamp;
+    DWORD firstRecord;           // first record of the sample at 'timestamp'
+    DWORD reserved;
+};
+
+struct ArchiveRecord {
+    ULONGLONG timestamp;         // FILETIME, UTC
+    ULONGLONG createTime;        // with pid identifies the process
+    ULONGLONG workingSet;        // bytes
+    DWORD pid;
+    float cpuUsage;              // percent
+    DWORD previous;              // previous record of the same pid, or ARCHIVE_NO_RECORD
+    DWORD flags;
+};
+
+static_assert(sizeof(ArchiveSegmentHeader) == 80, "archive header layout");
+static_assert(sizeof(ArchivePidSlot) == 8, "archive pid slot layout");
+static_assert(sizeof(ArchiveTimeEntry) == 16, "archive time index layout");
+static_assert(sizeof(ArchiveRecord) == 40, "archive record layout");
+
+inline size_t ArchivePidHome(DWORD pid, DWORD slots) {
+    return (size_t)((pid * 0x9E3779B1u) >> 7) & (slots - 1);
+}
+
+// Logger thread only. Fed the same change lists as HistoryWriter.
+class HistoryArchive {
+private:
+    struct LiveValue {
+        float cpu;
+        ULONGLONG memory;
+    };
+
+    std::wstring directory;
+    std::wstring segmentPath;
+    HANDLE hFile = INVALID_HANDLE_VALUE;
+    HANDLE hMapping = NULL;
+    BYTE* view = nullptr;
+    ArchiveSegmentHeader* header = nullptr;
+    ArchivePidSlot* pidTable = nullptr;
+    ArchiveTimeEntry* timeIndex = nullptr;
+    ArchiveRecord* records = nullptr;
+    DWORD recordCount = 0;
+    DWORD pidCount = 0;
+    DWORD pidSlots = ARCHIVE_PID_SLOTS;
+    ULONGLONG openedMs = 0;
+    ULONGLONG skippedSamples = 0;
+    std::unordered_map<ProcessKey, LiveValue, ProcessKeyHash> live;
+
+    static ULONGLONG SegmentBytes(DWORD slots) {
+        return sizeof(ArchiveSegmentHeader) + (ULONGLONG)slots * sizeof(ArchivePidSlot)
+            + (ULONGLONG)ARCHIVE_TIME_SLOTS * sizeof(ArchiveTimeEntry) + (ULONGLONG)ARCHIVE_SEGMENT_RECORDS * sizeof(ArchiveRecord);
+    }
+
+    void PruneSegments() {
+        std::vector<std::wstring> names;
+        WIN32_FIND_DATAW found;
+        HANDLE hFind = FindFirstFileW((directory + L"\\segment-*.pma").c_str(), &found);
+        if (hFind == INVALID_HANDLE_VALUE) return;
+        do {
+            names.push_back(found.cFileName);
+        } while (FindNextFileW(hFind, &found));
+        FindClose(hFind);
+
+        // Names carry a zero-padded hex timestamp, so lexical order is age order.
+        std::sort(names.begin(), names.end());
+        for (size_t i = 0; i + ARCHIVE_MAX_SEGMENTS < names.size(); i++) {
+            DeleteFileW((directory + L"\\" + names[i]).c_str());
+        }
+    }
+
+    bool OpenSegment(ULONGLONG timestamp, DWORD slots) {
+        WCHAR name[64];
+        StringCchPrintfW(name, 64, L"\\segment-%016llX.pma", timestamp);
+        segmentPath = directory + name;
+        hFile = CreateFileW(segmentPath.c_str(), GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ, NULL, CREATE_ALWAYS,
+            FILE_ATTRIBUTE_NORMAL, NULL);
+        if (hFile == INVALID_HANDLE_VALUE) return false;
+
+        ULONGLONG bytes = SegmentBytes(slots);
+        hMapping = CreateFileMappingW(hFile, NULL, PAGE_READWRITE, (DWORD)(bytes >> 32), (DWORD)bytes, NULL);
+        if (hMapping) view = static_cast<BYTE*>(MapViewOfFile(hMapping, FILE_MAP_WRITE, 0, 0, (SIZE_T)bytes));
+        if (!view) {
+            CloseSegment();
+            return false;
+        }
+
+        // A fresh mapping is zero-filled, which already marks every pid slot empty.
+        header = reinterpret_cast<ArchiveSegmentHeader*>(view);
+        header->magic = ARCHIVE_MAGIC;
+        header->version = ARCHIVE_VERSION;
+        header->recordSize = sizeof(ArchiveRecord);
+        header->recordCapacity = ARCHIVE_SEGMENT_RECORDS;
+        header->pidSlots = slots;
+        header->timeSlots = ARCHIVE_TIME_SLOTS;
+        header->timeStride = ARCHIVE_TIME_STRIDE;
+        header->firstTime = timestamp;
+        header->lastTime = timestamp;
+        header->pidTableOffset = sizeof(ArchiveSegmentHeader);
+        header->timeIndexOffset = header->pidTableOffset + (ULONGLONG)slots * sizeof(ArchivePidSlot);
+        header->recordsOffset = header->timeIndexOffset + (ULONGLONG)ARCHIVE_TIME_SLOTS * sizeof(ArchiveTimeEntry);
+        pidTable = reinterpret_cast<ArchivePidSlot*>(view + header->pidTableOffset);
+        timeIndex = reinterpret_cast<ArchiveTimeEntry*>(view + header->timeIndexOffset);
+        records = reinterpret_cast<ArchiveRecord*>(view + header->recordsOffset);
+        recordCount = 0;
+        pidCount = 0;
+        pidSlots = slots;
+        openedMs = GetTickCount64();
+        PruneSegments();
+        return true;
+    }
+
+    void CloseSegment() {
+        ULONGLONG usedBytes = header ? header->recordsOffset + (ULONGLONG)recordCount * sizeof(ArchiveRecord) : 0;
+        if (view) {
+            FlushViewOfFile(view, 0);
+            UnmapViewOfFile(view);
+        }
+        if (hMapping) CloseHandle(hMapping);
+        if (hFile != INVALID_HANDLE_VALUE) {
+            // The unused tail of the record area is never read; give the disk space back.
+            LARGE_INTEGER end;
+            end.QuadPart = (LONGLONG)usedBytes;
+            if (usedBytes && SetFilePointerEx(hFile, end, NULL, FILE_BEGIN)) SetEndOfFile(hFile);
+            CloseHandle(hFile);
+        }
+        hFile = INVALID_HANDLE_VALUE;
+        hMapping = NULL;
+        view = nullptr;
+        header = nullptr;
+        pidTable = nullptr;
+        timeIndex = nullptr;
+        records = nullptr;
+    }
+
+    ArchivePidSlot& PidSlot(DWORD pid) {
+        size_t mask = pidSlots - 1;
+        size_t i = ArchivePidHome(pid, pidSlots);
+        while (pidTable[i].pidPlusOne && pidTable[i].pidPlusOne != pid + 1) i = (i + 1) & mask;
+        if (!pidTable[i].pidPlusOne) {
+            pidTable[i].pidPlusOne = pid + 1;
+            pidTable[i].newestRecord = ARCHIVE_NO_RECORD;
+            pidCount++;
+        }
+        return pidTable[i];
+    }
+
+    void AppendRecord(ULONGLONG timestamp, const ProcessKey& key, float cpu, ULONGLONG memory, DWORD flags) {
+        ArchivePidSlot& slot = PidSlot(key.pid);
+        ArchiveRecord& record = records[recordCount];
+        record.timestamp = timestamp;
+        record.createTime = key.createTime;
+        record.workingSet = memory;
+        record.pid = key.pid;
+        record.cpuUsage = cpu;
+        record.previous = slot.newestRecord;
+        record.flags = flags;
+        slot.newestRecord = recordCount++;
+    }
+
+    bool NeedsRotation(size_t incoming) const {
+        if (!header) return true;
+        if (GetTickCount64() - openedMs >= ARCHIVE_SEGMENT_MAX_AGE_MS) return true;
+        if (recordCount + incoming > ARCHIVE_SEGMENT_RECORDS) return true;
+        if ((pidCount + incoming) * 2 > pidSlots) return true;
+        return header->sampleCount % ARCHIVE_TIME_STRIDE == 0 && header->timeCount == ARCHIVE_TIME_SLOTS;
+    }
+
+public:
+    ~HistoryArchive() {
+        Close();
+    }
+
+    bool Open(const wchar_t* path) {
+        directory = path;
+        return CreateDirectoryW(path, NULL) || GetLastError() == ERROR_ALREADY_EXISTS;
+    }
+
+    void Append(const LogRecord& sample, const LogRecord* changes, size_t count, bool full) {
+        if (directory.empty()) return;
+        if (full) live.clear();
+        for (size_t i = 0; i < count; i++) {
+            ProcessKey key = { changes[i].pid, changes[i].time };
+            if (changes[i].kind == LOG_RECORD_EXITED) live.erase(key);
+            else live[key] = { (float)changes[i].cpu, changes[i].memory };
+        }
+
+        bool rotated = false;
+        if (NeedsRotation(count)) {
+            CloseSegment();
+            // A segment opened here starts with the whole table, and has room for as many
+            // new pids again before it has to rotate.
+            DWORD slots = ARCHIVE_PID_SLOTS;
+            while (slots < live.size() * 4) slots *= 2;
+            if (live.size() > ARCHIVE_SEGMENT_RECORDS || !OpenSegment(sample.time, slots)) {
+                skippedSamples++;
+                return;
+            }
+            rotated = true;
+        }
+
+        if (header->sampleCount % ARCHIVE_TIME_STRIDE == 0) {
+            timeIndex[header->timeCount].timestamp = sample.time;
+            timeIndex[header->timeCount].firstRecord = recordCount;
+            header->timeCount++;
+        }
+        if (rotated) {
+            for (const auto& entry : live) AppendRecord(sample.time, entry.first, entry.second.cpu, entry.second.memory, 0);
+        } else {
+            for (size_t i = 0; i < count; i++) {
+                const LogRecord& change = changes[i];
+                bool exited = change.kind == LOG_RECORD_EXITED;
+                AppendRecord(sample.time, { change.pid, change.time }, exited ? 0.0f : (float)change.cpu,
+                    exited ? 0 : change.memory, exited ? ARCHIVE_RECORD_EXITED : 0);
+            }
+        }
+        header->sampleCount++;
+        header->lastTime = sample.time;
+        InterlockedExchange(&header->recordCount, (LONG)recordCount);
+    }
+
+    void Close() {
+        CloseSegment();
+    }
+
+    // Samples that reached the archive but are not in it: no segment could be opened.
+    ULONGLONG SkippedSamples() const {
+        return skippedSamples;
+    }
+};
+
+// One segment mapped read-only. Pointers it returns stay valid while it is open.
+class ArchiveSegmentView {
+private:
+    HANDLE hFile = INVALID_HANDLE_VALUE;
+    HANDLE hMapping = NULL;
+    const BYTE* view = nullptr;
+    ULONGLONG size = 0;
+    const ArchiveSegmentHeader* header = nullptr;
+
+    bool Valid() const {
+        if (size < sizeof(ArchiveSegmentHeader)) return false;
+        if (header->magic != ARCHIVE_MAGIC || header->version != ARCHIVE_VERSION) return false;
+        if (header->recordSize != sizeof(ArchiveRecord) || header->pidSlots == 0) return false;
+        if ((header->pidSlots & (header->pidSlots - 1)) != 0) return false;
+        ULONGLONG pidEnd = header->pidTableOffset + (ULONGLONG)header->pidSlots * sizeof(ArchivePidSlot);
+        ULONGLONG timeEnd = header->timeIndexOffset + (ULONGLONG)header->timeSlots * sizeof(ArchiveTimeEntry);
+        return pidEnd <= size && timeEnd <= size && header->recordsOffset <= size;
+    }
+
+    // Published records that are also inside the mapped file.
+    DWORD RecordCount() const {
+        DWORD count = (DWORD)header->recordCount;
+        MemoryBarrier();
+        ULONGLONG fits = (size - header->recordsOffset) / sizeof(ArchiveRecord);
+        return count < fits ? count : (DWORD)fits;
+    }
+
+    const ArchiveRecord* Records() const {
+        return reinterpret_cast<const ArchiveRecord*>(view + header->recordsOffset);
+    }
+
+public:
+    ArchiveSegmentView() {}
+    ArchiveSegmentView(const ArchiveSegmentView&) = delete;
+    ArchiveSegmentView& operator=(const ArchiveSegmentView&) = delete;
+
+    ~ArchiveSegmentView() {
+        if (view) UnmapViewOfFile(view);
+        if (hMapping) CloseHandle(hMapping);
+        if (hFile != INVALID_HANDLE_VALUE) CloseHandle(hFile);
+    }
+
+    bool Open(const wchar_t* path) {
+        hFile = CreateFileW(path, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, NULL,
+            OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+        if (hFile == INVALID_HANDLE_VALUE) return false;
+        LARGE_INTEGER fileSize;
+        if (!GetFileSizeEx(hFile, &fileSize) || fileSize.QuadPart == 0) return false;
+        size = (ULONGLONG)fileSize.QuadPart;
+        hMapping = CreateFileMappingW(hFile, NULL, PAGE_READONLY, 0, 0, NULL);
+        if (!hMapping) return false;
+        view = static_cast<const BYTE*>(MapViewOfFile(hMapping, FILE_MAP_READ, 0, 0, 0));
+        if (!view) return false;
+        header = reinterpret_cast<const ArchiveSegmentHeader*>(view);
+        return Valid();
+    }
+
+    ULONGLONG FirstTime() const {
+        return header->firstTime;
+    }
+
+    ULONGLONG LastTime() const {
+        return header->lastTime;
+    }
+
+    // The newest record of 'pid', or ARCHIVE_NO_RECORD.
+    DWORD NewestRecord(DWORD pid) const {
+        const ArchivePidSlot* pidTable = reinterpret_cast<const ArchivePidSlot*>(view + header->pidTableOffset);
+        size_t mask = header->pidSlots - 1;
+        size_t i = ArchivePidHome(pid, header->pidSlots);
+        for (size_t probes = 0; pidTable[i].pidPlusOne != pid + 1; probes++, i = (i + 1) & mask) {
+            if (!pidTable[i].pidPlusOne || probes == mask) return ARCHIVE_NO_RECORD;
+        }
+        return pidTable[i].newestRecord;
+    }
+
+    // The creation time of the newest process with 'pid' that has a record at or before t1.
+    bool FindProcess(DWORD pid, ULONGLONG t1, ULONGLONG& createTime) const {
+        const ArchiveRecord* all = Records();
+        DWORD count = RecordCount();
+        for (DWORD index = NewestRecord(pid); index != ARCHIVE_NO_RECORD; index = all[index].previous) {
+            if (index >= header->recordCapacity) break;
+            if (index >= count || all[index].timestamp > t1) continue;
+            createTime = all[index].createTime;
+            return true;
+        }
+        return false;
+    }
+
+    // Appends, oldest first, the records of 'process' with timestamps in [t0, t1],
+    // preceded by the newest record before t0 (the process's state when the range starts).
+    void QueryRange(const ProcessKey& process, ULONGLONG t0, ULONGLONG t1, std::vector<const ArchiveRecord*>& out) const {
+        const ArchiveRecord* all = Records();
+        DWORD count = RecordCount();
+        size_t first = out.size();
+        for (DWORD index = NewestRecord(process.pid); index != ARCHIVE_NO_RECORD; index = all[index].previous) {
+            if (index >= header->recordCapacity) break;
+            if (index >= count) continue; // appended, not yet published
+            const ArchiveRecord& record = all[index];
+            if (record.timestamp > t1 || record.createTime != process.createTime) continue;
+            out.push_back(&record);
+            if (record.timestamp < t0) break;
+        }
+        std::reverse(out.begin() + first, out.end());
+    }
+
+    // Every record, of every process, from the samples in [t0, t1]: one contiguous run,
+    // located with the sparse time index.
+    const ArchiveRecord* TimeRange(ULONGLONG t0, ULONGLONG t1, size_t& count) const {
+        const ArchiveTimeEntry* times = reinterpret_cast<const ArchiveTimeEntry*>(view + header->timeIndexOffset);
+        const ArchiveRecord* all = Records();
+        DWORD total = RecordCount();
+        DWORD timeCount = header->timeCount < header->timeSlots ? header->timeCount : header->timeSlots;
+
+        const ArchiveTimeEntry* entry = std::upper_bound(times, times + timeCount, t0,
+            [](ULONGLONG t, const ArchiveTimeEntry& e) { return t < e.timestamp; });
+        DWORD begin = entry == times ? 0 : (entry - 1)->firstRecord;
+        if (begin > total) begin = total;
+        while (begin < total && all[begin].timestamp < t0) begin++;
+        DWORD end = begin;
+        while (end < total && all[end].timestamp <= t1) end++;
+        count = end - begin;
+        return all + begin;
+    }
+};
+
+// Opens every segment in an archive directory that overlaps a time range.
+class HistoryArchiveReader {
+private:
+    std::vector<ArchiveSegmentView*> segments; // oldest first
+
+    void Clear() {
+        for (ArchiveSegmentView* segment : segments) delete segment;
+        segments.clear();
+    }
+
+public:
+    ~HistoryArchiveReader() {
+        Clear();
+    }
+
+    size_t Open(const wchar_t* directory, ULONGLONG t0, ULONGLONG t1) {
+        Clear();
+        std::vector<std::wstring> names;
+        WIN32_FIND_DATAW found;
+        std::wstring base = directory;
+        HANDLE hFind = FindFirstFileW((base + L"\\segment-*.pma").c_str(), &found);
+        if (hFind == INVALID_HANDLE_VALUE) return 0;
+        do {
+            names.push_back(found.cFileName);
+        } while (FindNextFileW(hFind, &found));
+        FindClose(hFind);
+        std::sort(names.begin(), names.end());
+
+        for (const auto& name : names) {
+            ArchiveSegmentView* segment = new ArchiveSegmentView();
+            if (segment->Open((base + L"\\" + name).c_str()) && segment->FirstTime() <= t1 && segment->LastTime() >= t0) {
+                segments.push_back(segment);
+            } else {
+                delete segment;
+            }
+        }
+        return segments.size();
+    }
+
+    // Zero-copy: the pointers refer into the mapped segments and stay valid until the
+    // reader is reopened or destroyed. Each segment repeats the state at its start, so
+    // only the first segment's lead-in record before t0 is kept.
+    void QueryRange(const ProcessKey& process, ULONGLONG t0, ULONGLONG t1, std::vector<const ArchiveRecord*>& out) const {
+        size_t start = out.size();
+        for (const ArchiveSegmentView* segment : segments) {
+            size_t first = out.size();
+            segment->QueryRange(process, t0, t1, out);
+            if (first > start && out.size() > first && out[first]->timestamp < t0) out.erase(out.begin() + first);
+        }
+    }
+
+    // The newest process that had 'pid' by t1, for callers that know only the pid.
+    bool FindProcess(DWORD pid, ULONGLONG t1, ProcessKey& process) const {
+        for (size_t i = segments.size(); i-- > 0;) {
+            if (segments[i]->FindProcess(pid, t1, process.createTime)) {
+                process.pid = pid;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    size_t SegmentCount() const {
+        return segments.size();
+    }
+};
@@ -0,0 +1,74 @@
+// On-disk layout of process_history.bin, shared by the monitor and historyconv.
+//
+// The file is a HistoryFileHeader followed by a stream of blocks. Every block starts
+// with a HistoryBlockHeader whose 'size' is the number of payload bytes that follow,
+// so readers can skip kinds they do not know. All integers are little-endian.
+//
+//   HISTORY_BLOCK_SESSION  HistorySessionHeader. Starts a writer session and clears
+//                          the string table; name ids are only valid inside a session.
+//   HISTORY_BLOCK_STRING   DWORD id, DWORD length, then 'length' UTF-16 code units.
+//                          Always written before the first record that uses the id.
+//   HISTORY_BLOCK_SAMPLE   HistorySampleHeader, then processCount fixed-width
+//                          HistoryProcessRecords. Without HISTORY_SAMPLE_DELTA the
+//                          records are the complete process table (a keyframe); with
+//                          it they are only the processes that changed since their last
+//                          record, and HISTORY_RECORD_EXITED records remove a process.
+//                          Either kind may also carry a process that started and
+//                          exited within the sample, as its record then its
+//                          HISTORY_RECORD_EXITED record.
+//                          Every session starts with a keyframe, so readers rebuild
+//                          the table by applying samples in order.
+//
+// A crash can leave a truncated block at the end of the file; readers stop there.
+#pragma once
+
+#include <windows.h>
+
+#define HISTORY_FILE_MAGIC 0x31484D50 // "PMH1"
+#define HISTORY_FILE_VERSION 2
+
+#define HISTORY_BLOCK_SESSION 1
+#define HISTORY_BLOCK_STRING 2
+#define HISTORY_BLOCK_SAMPLE 3
+
+#define HISTORY_SAMPLE_DELTA 0x1    // HistorySampleHeader::flags
+#define HISTORY_RECORD_EXITED 0x1   // HistoryProcessRecord::flags
+
+struct HistoryFileHeader {
+    DWORD magic;
+    DWORD version;
+};
+
+struct HistoryBlockHeader {
+    DWORD kind;
+    DWORD size;
+};
+
+struct HistorySessionHeader {
+    ULONGLONG startTime;     // FILETIME, UTC
+    DWORD writerPid;
+    DWORD reserved;
+};
+
+struct HistorySampleHeader {
+    ULONGLONG timestamp;     // FILETIME, UTC
+    double totalCpuUsage;    // percent of all logical processors
+    ULONGLONG totalMemoryUsage;
+    DWORD processCount;
+    DWORD flags;
+};
+
+struct HistoryProcessRecord {
+    DWORD pid;
+    DWORD nameId;
+    ULONGLONG createTime;    // FILETIME, UTC; with pid identifies the process
+    float cpuUsage;          // percent
+    DWORD flags;
+    ULONGLONG workingSet;    // bytes
+};
+
+static_assert(sizeof(HistoryFileHeader) == 8, "history header layout");
+static_assert(sizeof(HistoryBlockHeader) == 8, "history block layout");
+static_assert(sizeof(HistorySessionHeader) == 16, "history session layout");
+static_assert(sizeof(HistorySampleHeader) == 32, "history sample layout");
+static_assert(sizeof(HistoryProcessRecord) == 32, "history record layout");
@@ -0,0 +1,460 @@
+// Write-behind logging of every sample to process_history.bin and the history archive.
+#pragma once
+
+#include <windows.h>
+#include <vector>
+#include <string>
+#include <unordered_map>
+#include <atomic>
+#include <memory>
+
+#include "process_types.h"
+#include "history_format.h"
+#include "log_record.h"
+#include "history_archive.h"
+#include "profiler.h"
+#include "name_pool.h"
+#include "spsc_queue.h"
+#include "alerts.h"
+
+#define HISTORY_FILE_NAME L"process_history.bin"
+#define HISTORY_WRITE_BUFFER (256 * 1024)
+#define HISTORY_FLUSH_INTERVAL_MS 5000
+#define HISTORY_KEYFRAME_INTERVAL 600   // samples between full (non-delta) samples
+#define LOG_QUEUE_CAPACITY 16384        // records to start with; must be a power of two
+#define ALERT_LOG_FILE_NAME L"alerts.log"
+#define ALERT_QUEUE_BYTES (64 * 1024)   // must be a power of two
+#define ALERT_LINE_BYTES 1024
+
+// Writes process_history.bin (layout in history_format.h) from the logger thread through
+// one handle kept open for the life of the logger. The sampler already hands over only
+// the processes that changed, which map directly onto delta records; every
+// HISTORY_KEYFRAME_INTERVAL samples, and after any sample the sampler dropped, the whole
+// table is written so readers can resynchronise.
+class HistoryWriter {
+private:
+    struct LastWritten {
+        float cpu;
+        ULONGLONG memory;
+        ULONGLONG generation;
+        DWORD nameId;
+    };
+
+    HANDLE hFile = INVALID_HANDLE_VALUE;
+    std::vector<BYTE> pending;
+    std::unordered_map<const std::wstring*, DWORD> nameIds;
+    std::unordered_map<ProcessKey, LastWritten, ProcessKeyHash> lastWritten;
+    std::vector<HistoryProcessRecord> staged;
+    ULONGLONG generation = 0;
+    DWORD samplesSinceKeyframe = 0;
+    ULONGLONG pendingSinceMs = 0;
+    ULONGLONG bytesWritten = 0;
+
+    void Append(const void* data, size_t size) {
+        const BYTE* bytes = static_cast<const BYTE*>(data);
+        pending.insert(pending.end(), bytes, bytes + size);
+    }
+
+    void AppendBlock(DWORD kind, size_t size) {
+        if (pending.empty()) pendingSinceMs = GetTickCount64();
+        HistoryBlockHeader block = { kind, (DWORD)size };
+        Append(&block, sizeof(block));
+    }
+
+    DWORD InternName(const std::wstring* name) {
+        auto it = nameIds.find(name);
+        if (it != nameIds.end()) return it->second;
+
+        DWORD id = (DWORD)nameIds.size();
+        DWORD length = (DWORD)name->size();
+        nameIds.emplace(name, id);
+        AppendBlock(HISTORY_BLOCK_STRING, 2 * sizeof(DWORD) + length * sizeof(WCHAR));
+        Append(&id, sizeof(id));
+        Append(&length, sizeof(length));
+        Append(name->data(), length * sizeof(WCHAR));
+        return id;
+    }
+
+    // Walks the block headers of an existing file and cuts off a block that a crash left
+    // half-written, so the session appended next is reachable by readers.
+    bool SeekToEndOfValidData(LONGLONG fileSize, bool& wrongFormat) {
+        HistoryFileHeader header;
+        DWORD read = 0;
+        wrongFormat = false;
+        if (!ReadFile(hFile, &header, sizeof(header), &read, NULL)) return false;
+        if (read != sizeof(header) || header.magic != HISTORY_FILE_MAGIC || header.version != HISTORY_FILE_VERSION) {
+            wrongFormat = true;
+            return false;
+        }
+
+        LARGE_INTEGER offset;
+        offset.QuadPart = sizeof(header);
+        while (offset.QuadPart + (LONGLONG)sizeof(HistoryBlockHeader) <= fileSize) {
+            HistoryBlockHeader block;
+            if (!SetFilePointerEx(hFile, offset, NULL, FILE_BEGIN)) return false;
+            if (!ReadFile(hFile, &block, sizeof(block), &read, NULL) || read != sizeof(block)) return false;
+            LONGLONG next = offset.QuadPart + sizeof(block) + block.size;
+            if (next > fileSize) break;
+            offset.QuadPart = next;
+        }
+        if (!SetFilePointerEx(hFile, offset, NULL, FILE_BEGIN)) return false;
+        return offset.QuadPart == fileSize || SetEndOfFile(hFile);
+    }
+
+    bool OpenFile(const wchar_t* path, bool& wrongFormat) {
+        wrongFormat = false;
+        hFile = CreateFileW(path, GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ, NULL, OPEN_ALWAYS,
+            FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+        if (hFile == INVALID_HANDLE_VALUE) return false;
+
+        LARGE_INTEGER size;
+        bool ok = GetFileSizeEx(hFile, &size) != FALSE;
+        if (ok && size.QuadPart == 0) {
+            HistoryFileHeader header = { HISTORY_FILE_MAGIC, HISTORY_FILE_VERSION };
+            Append(&header, sizeof(header));
+        } else if (ok) {
+            ok = SeekToEndOfValidData(size.QuadPart, wrongFormat);
+        }
+        if (!ok) {
+            CloseHandle(hFile);
+            hFile = INVALID_HANDLE_VALUE;
+        }
+        return ok;
+    }
+
+public:
+    ~HistoryWriter() {
+        Close();
+    }
+
+    bool Open(const wchar_t* path) {
+        bool wrongFormat;
+        if (!OpenFile(path, wrongFormat)) {
+            // An older or foreign file is kept aside rather than appended to.
+            if (!wrongFormat) return false;
+            std::wstring oldPath = std::wstring(path) + L".old";
+            if (!MoveFileExW(path, oldPath.c_str(), MOVEFILE_REPLACE_EXISTING)) return false;
+            if (!OpenFile(path, wrongFormat)) return false;
+        }
+
+        pending.reserve(HISTORY_WRITE_BUFFER * 2);
+        nameIds.clear();
+        lastWritten.clear();
+        samplesSinceKeyframe = 0;
+
+        HistorySessionHeader session = { 0 };
+        FILETIME now;
+        GetSystemTimeAsFileTime(&now);
+        session.startTime = ((ULONGLONG)now.dwHighDateTime << 32) | now.dwLowDateTime;
+        session.writerPid = GetCurrentProcessId();
+        AppendBlock(HISTORY_BLOCK_SESSION, sizeof(session));
+        Append(&session, sizeof(session));
+        return true;
+    }
+
+    // 'full' means the records are the complete table, which replaces the writer's own
+    // (the sampler sends one after a dropped sample); otherwise they are changes only.
+    void WriteSample(const LogRecord& sample, const LogRecord* records, size_t count, bool full) {
+        if (hFile == INVALID_HANDLE_VALUE) return;
+
+        bool keyframe = full || samplesSinceKeyframe == 0;
+        if (keyframe) samplesSinceKeyframe = 0;
+        if (++samplesSinceKeyframe >= HISTORY_KEYFRAME_INTERVAL) samplesSinceKeyframe = 0;
+        generation++;
+
+        // String blocks are appended here, ahead of the sample that references them.
+        staged.clear();
+        for (size_t i = 0; i < count; i++) {
+            const LogRecord& rec = records[i];
+            ProcessKey key = { rec.pid, rec.time };
+            if (rec.kind == LOG_RECORD_EXITED) {
+                auto it = lastWritten.find(key);
+                if (it == lastWritten.end()) continue;
+                // A process that appeared in this same sample (a transient one) is gone from
+                // the table a keyframe writes, so the keyframe carries the pair itself.
+                if (keyframe && it->second.generation == generation) {
+                    staged.push_back({ rec.pid, it->second.nameId, rec.time, it->second.cpu, 0, it->second.memory });
+                }
+                if (!keyframe || it->second.generation == generation) {
+                    staged.push_back({ rec.pid, 0, rec.time, 0.0f, HISTORY_RECORD_EXITED, 0 });
+                }
+                lastWritten.erase(it);
+                continue;
+            }
+
+            float cpu = (float)rec.cpu;
+            LastWritten& last = lastWritten[key];
+            bool changed = last.generation == 0 || last.cpu != cpu || last.memory != rec.memory;
+            if (last.generation == 0) last.nameId = InternName(rec.name);
+            last.generation = generation;
+            last.cpu = cpu;
+            last.memory = rec.memory;
+            if (changed && !keyframe) staged.push_back({ rec.pid, last.nameId, rec.time, cpu, 0, rec.memory });
+        }
+        if (full) {
+            for (auto it = lastWritten.begin(); it != lastWritten.end();) {
+                if (it->second.generation == generation) {
+                    ++it;
+                    continue;
+                }
+                if (!keyframe) staged.push_back({ it->first.pid, 0, it->first.createTime, 0.0f, HISTORY_RECORD_EXITED, 0 });
+                it = lastWritten.erase(it);
+            }
+        }
+        if (keyframe) {
+            for (const auto& entry : lastWritten) {
+                staged.push_back({ entry.first.pid, entry.second.nameId, entry.first.createTime,
+                    entry.second.cpu, 0, entry.second.memory });
+            }
+        }
+
+        HistorySampleHeader header = { sample.time, sample.cpu, sample.memory, (DWORD)staged.size(),
+            keyframe ? 0u : (DWORD)HISTORY_SAMPLE_DELTA };
+        AppendBlock(HISTORY_BLOCK_SAMPLE, sizeof(header) + staged.size() * sizeof(HistoryProcessRecord));
+        Append(&header, sizeof(header));
+        if (!staged.empty()) Append(staged.data(), staged.size() * sizeof(HistoryProcessRecord));
+
+        if (pending.size() >= HISTORY_WRITE_BUFFER) Flush();
+    }
+
+    bool FlushDue(ULONGLONG nowMs) const {
+        return !pending.empty() && nowMs - pendingSinceMs >= HISTORY_FLUSH_INTERVAL_MS;
+    }
+
+    void Flush() {
+        if (hFile != INVALID_HANDLE_VALUE && !pending.empty()) {
+            DWORD written = 0;
+            if (WriteFile(hFile, pending.data(), (DWORD)pending.size(), &written, NULL)) bytesWritten += written;
+        }
+        pending.clear();
+    }
+
+    void Close() {
+        Flush();
+        if (hFile != INVALID_HANDLE_VALUE) CloseHandle(hFile);
+        hFile = INVALID_HANDLE_VALUE;
+    }
+
+    ULONGLONG GetBytesWritten() const {
+        return bytesWritten;
+    }
+};
+
+struct LoggerStats {
+    size_t queueDepth;
+    size_t queueCapacity;
+    size_t queueHighWater;
+    ULONGLONG samplesQueued;
+    ULONGLONG samplesDropped;
+    ULONGLONG recordsDropped;
+    ULONGLONG bytesWritten;
+    ULONGLONG alertsDropped;    // alert lines that found the alert queue full
+    ULONGLONG archiveSkipped;   // written samples the history archive could not hold
+};
+
+// Write-behind logger: the sampler pushes each sample into an SPSC queue and returns;
+// a dedicated thread drains it into HistoryWriter and HistoryArchive. When the queue is full the whole
+// sample is dropped and counted instead of stalling the sampler, and the next sample is the
+// whole table. A table too large for the queue makes the logger thread grow it: the
+// sampler stops pushing and the thread replaces the queue once it has drained it, so the
+// resynchronising table always fits a queue that is at most half full. Alert lines take a second
+// queue to the same thread, which appends them to alerts.log.
+class HistoryLogger {
+private:
+    std::vector<std::unique_ptr<SpscQueue<LogRecord>>> queues; // consumer side; the last is current
+    std::atomic<SpscQueue<LogRecord>*> queue{ nullptr };       // earlier ones stay valid for GetStats
+    std::atomic<size_t> requestedCapacity{ 0 };               // nonzero: the sampler waits for growth
+    HistoryWriter writer;
+    HistoryArchive archive;
+    std::wstring path;
+    std::wstring alertPath;
+    SpscQueue<BYTE> alertQueue{ ALERT_QUEUE_BYTES }; // DWORD length, then the line
+    AlertLogSink alertLog;                // consumer side
+    std::vector<char> alertLines;         // consumer side
+    std::vector<LogRecord> staging;       // producer side
+    bool resync = true;                   // producer side: next sample must be a full table
+    std::vector<LogRecord> sampleRecords; // consumer side
+    HANDLE hThread = NULL;
+    HANDLE hStopEvent = NULL;
+    HANDLE hDataEvent = NULL;
+    LatencyHistogram* writeTimer = NULL;   // optional, recorded on the writer thread
+
+    std::atomic<size_t> queueHighWater{ 0 };
+    std::atomic<ULONGLONG> samplesQueued{ 0 };
+    std::atomic<ULONGLONG> samplesDropped{ 0 };
+    std::atomic<ULONGLONG> recordsDropped{ 0 };
+    std::atomic<ULONGLONG> bytesWritten{ 0 };
+    std::atomic<ULONGLONG> alertsDropped{ 0 };
+    std::atomic<ULONGLONG> archiveSkipped{ 0 };
+
+    // Whatever lines are queued go out in one write.
+    void DrainAlerts() {
+        DWORD length;
+        alertLines.clear();
+        while (alertQueue.Pop(reinterpret_cast<BYTE*>(&length), sizeof(length))) {
+            size_t offset = alertLines.size();
+            alertLines.resize(offset + length);
+            alertQueue.Pop(reinterpret_cast<BYTE*>(alertLines.data() + offset), length);
+        }
+        alertLog.Write(alertLines.data(), alertLines.size());
+    }
+
+    void Drain() {
+        SpscQueue<LogRecord>& q = *queue.load(std::memory_order_relaxed);
+        LogRecord record;
+        while (q.TryPop(record)) {
+            if (record.kind != LOG_RECORD_SAMPLE && record.kind != LOG_RECORD_FULL_SAMPLE) continue; // only reachable if a header was lost
+
+            // TryPush published the sample with its records, so they are all present.
+            LogRecord sample = record;
+            sampleRecords.clear();
+            for (DWORD i = 0; i < sample.pid && q.TryPop(record); i++) sampleRecords.push_back(record);
+            bool full = sample.kind == LOG_RECORD_FULL_SAMPLE;
+            ScopedTimer timer(writeTimer);
+            writer.WriteSample(sample, sampleRecords.data(), sampleRecords.size(), full);
+            archive.Append(sample, sampleRecords.data(), sampleRecords.size(), full);
+        }
+    }
+
+    void Run() {
+        writer.Open(path.c_str());
+        archive.Open(ARCHIVE_DIRECTORY);
+        alertLog.Open(alertPath.c_str());
+        HANDLE waits[] = { hStopEvent, hDataEvent };
+        for (;;) {
+            DWORD result = WaitForMultipleObjects(2, waits, FALSE, HISTORY_FLUSH_INTERVAL_MS);
+            DrainAlerts();
+            // Read before draining: everything the sampler pushed before asking is then
+            // visible to Drain, and it pushes nothing after, so the old queue ends up empty.
+            size_t capacity = requestedCapacity.load(std::memory_order_acquire);
+            Drain();
+            if (capacity) {
+                queues.emplace_back(new SpscQueue<LogRecord>(capacity));
+                queue.store(queues.back().get(), std::memory_order_release);
+                requestedCapacity.store(0, std::memory_order_release);
+            }
+            if (result == WAIT_OBJECT_0 || result == WAIT_FAILED) break;
+            if (writer.FlushDue(GetTickCount64())) writer.Flush();
+            bytesWritten.store(writer.GetBytesWritten(), std::memory_order_relaxed);
+            archiveSkipped.store(archive.SkippedSamples(), std::memory_order_relaxed);
+        }
+        writer.Close();
+        archive.Close();
+        alertLog.Close();
+        bytesWritten.store(writer.GetBytesWritten(), std::memory_order_relaxed);
+    }
+
+    static DWORD WINAPI ThreadProc(LPVOID param) {
+        static_cast<HistoryLogger*>(param)->Run();
+        return 0;
+    }
+
+public:
+    HistoryLogger() {
+        queues.emplace_back(new SpscQueue<LogRecord>(LOG_QUEUE_CAPACITY));
+        queue.store(queues.back().get(), std::memory_order_relaxed);
+    }
+
+    ~HistoryLogger() {
+        Stop();
+    }
+
+    bool Start(const wchar_t* filePath, const wchar_t* alertFilePath, LatencyHistogram* timer = NULL) {
+        path = filePath;
+        alertPath = alertFilePath;
+        writeTimer = timer;
+        hStopEvent = CreateEventW(NULL, TRUE, FALSE, NULL);
+        hDataEvent = CreateEventW(NULL, FALSE, FALSE, NULL);
+        if (!hStopEvent || !hDataEvent) return false;
+        hThread = CreateThread(NULL, 0, ThreadProc, this, 0, NULL);
+        if (hThread) SetThreadPriority(hThread, THREAD_PRIORITY_BELOW_NORMAL);
+        return hThread != NULL;
+    }
+
+    // Stops after everything already queued has been written.
+    void Stop() {
+        if (hThread) {
+            SetEvent(hStopEvent);
+            WaitForSingleObject(hThread, INFINITE);
+            CloseHandle(hThread);
+            hThread = NULL;
+        }
+        if (hStopEvent) CloseHandle(hStopEvent);
+        if (hDataEvent) CloseHandle(hDataEvent);
+        hStopEvent = hDataEvent = NULL;
+    }
+
+    // Sampler thread only. Sends the snapshot's added, changed and exited processes; after
+    // a drop the writer's view is stale, so the next sample carries the whole table.
+    // Names are already interned, so steady-state enqueueing does not allocate.
+    void Enqueue(const Snapshot& snap) {
+        staging.clear();
+        staging.push_back({ NULL, snap.sampleTime, snap.totalMemoryUsage, snap.totalCpuUsage, 0,
+            (DWORD)(resync ? LOG_RECORD_FULL_SAMPLE : LOG_RECORD_SAMPLE) });
+        auto pushProcess = [&](const ProcessInfo& proc) {
+            staging.push_back({ proc.name, proc.createTime, (ULONGLONG)proc.memoryUsage, proc.cpuUsage,
+                proc.pid, LOG_RECORD_PROCESS });
+        };
+        if (resync) {
+            for (const auto& proc : snap.processes) pushProcess(proc);
+        } else {
+            for (UINT row : snap.addedRows) pushProcess(snap.processes[row]);
+            for (UINT row : snap.changedRows) pushProcess(snap.processes[row]);
+            for (const auto& key : snap.exited) staging.push_back({ NULL, key.createTime, 0, 0.0, key.pid, LOG_RECORD_EXITED });
+        }
+        // Processes that lived between samples appear and exit within the same sample.
+        for (const auto& proc : snap.transient) {
+            staging.push_back({ proc.name, proc.startTime, 0, 0.0, proc.pid, LOG_RECORD_PROCESS });
+            staging.push_back({ NULL, proc.startTime, 0, 0.0, proc.pid, LOG_RECORD_EXITED });
+        }
+        staging[0].pid = (DWORD)(staging.size() - 1);
+
+        bool growing = requestedCapacity.load(std::memory_order_acquire) != 0;
+        SpscQueue<LogRecord>& q = *queue.load(std::memory_order_acquire);
+        if (!hThread || growing || !q.TryPush(staging.data(), staging.size())) {
+            samplesDropped.fetch_add(1, std::memory_order_relaxed);
+            recordsDropped.fetch_add(staging.size(), std::memory_order_relaxed);
+            resync = true;
+            if (hThread && !growing && staging.size() * 2 > q.Capacity()) {
+                size_t capacity = q.Capacity();
+                while (capacity < staging.size() * 2) capacity *= 2;
+                requestedCapacity.store(capacity, std::memory_order_release);
+                SetEvent(hDataEvent);
+            }
+            return;
+        }
+        resync = false;
+        samplesQueued.fetch_add(1, std::memory_order_relaxed);
+        size_t depth = q.Size();
+        if (depth > queueHighWater.load(std::memory_order_relaxed)) queueHighWater.store(depth, std::memory_order_relaxed);
+        SetEvent(hDataEvent);
+    }
+
+    // Sampler thread only. The line is formatted here, with the time it fired.
+    void EnqueueAlert(const Alert& alert) {
+        BYTE line[sizeof(DWORD) + ALERT_LINE_BYTES];
+        DWORD length = AlertLogSink::FormatLine(alert, reinterpret_cast<char*>(line + sizeof(DWORD)), ALERT_LINE_BYTES);
+        if (!length) return;
+        memcpy(line, &length, sizeof(length));
+        if (!hThread || !alertQueue.TryPush(line, sizeof(DWORD) + length)) {
+            alertsDropped.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+        SetEvent(hDataEvent);
+    }
+
+    LoggerStats GetStats() const {
+        LoggerStats stats;
+        const SpscQueue<LogRecord>& q = *queue.load(std::memory_order_acquire);
+        stats.queueDepth = q.Size();
+        stats.queueCapacity = q.Capacity();
+        stats.queueHighWater = queueHighWater.load(std::memory_order_relaxed);
+        stats.samplesQueued = samplesQueued.load(std::memory_order_relaxed);
+        stats.samplesDropped = samplesDropped.load(std::memory_order_relaxed);
+        stats.recordsDropped = recordsDropped.load(std::memory_order_relaxed);
+        stats.bytesWritten = bytesWritten.load(std::memory_order_relaxed);
+        stats.alertsDropped = alertsDropped.load(std::memory_order_relaxed);
+        stats.archiveSkipped = archiveSkipped.load(std::memory_order_relaxed);
+        return stats;
+    }
+};
@@ -0,0 +1,178 @@
+// Batch statistics over HistoryStore's columns: mean, min, max and standard deviation of
+// CPU, mean, min and max of memory, and a CPU percentile. An AVX2 kernel handles four
+// samples per instruction on x64 processors that have it; the scalar kernel is the
+// reference and the fallback, and both give the same results to rounding.
+#pragma once
+
+#include <windows.h>
+#include <cmath>
+#include <algorithm>
+
+#if defined(_M_X64) || defined(__x86_64__)
+#include <immintrin.h>
+#define HISTORY_STATS_AVX2 1
+#if defined(__GNUC__) || defined(__clang__)
+#define HISTORY_STATS_AVX2_TARGET __attribute__((target("avx2")))
+#else
+#define HISTORY_STATS_AVX2_TARGET
+#endif
+#endif
+
+#ifndef PF_AVX2_INSTRUCTIONS_AVAILABLE
+#define PF_AVX2_INSTRUCTIONS_AVAILABLE 40
+#endif
+
+#define HISTORY_STATS_PERCENTILE 0.95
+
+struct HistoryStats {
+    UINT count;
+    double cpuMean;
+    double cpuMin;
+    double cpuMax;
+    double cpuStdDev;           // population standard deviation
+    double cpuPercentile;       // HISTORY_STATS_PERCENTILE, nearest rank
+    double memoryMean;
+    ULONGLONG memoryMin;
+    ULONGLONG memoryMax;
+};
+
+// Fills everything except cpuPercentile. 'cpu' and 'memory' hold 'count' samples.
+typedef void (*HistoryStatsFn)(const double* cpu, const SIZE_T* memory, UINT count, HistoryStats& out);
+
+inline void HistoryStatsScalar(const double* cpu, const SIZE_T* memory, UINT count, HistoryStats& out) {
+    out = HistoryStats();
+    out.count = count;
+    if (!count) return;
+    double cpuSum = 0.0;
+    double cpuMin = cpu[0], cpuMax = cpu[0];
+    ULONGLONG memorySum = 0;
+    ULONGLONG memoryMin = memory[0], memoryMax = memory[0];
+    for (UINT i = 0; i < count; i++) {
+        cpuSum += cpu[i];
+        cpuMin = cpu[i] < cpuMin ? cpu[i] : cpuMin;
+        cpuMax = cpu[i] > cpuMax ? cpu[i] : cpuMax;
+        memorySum += memory[i];
+        memoryMin = memory[i] < memoryMin ? memory[i] : memoryMin;
+        memoryMax = memory[i] > memoryMax ? memory[i] : memoryMax;
+    }
+    double mean = cpuSum / count;
+    double squares = 0.0;
+    for (UINT i = 0; i < count; i++) squares += (cpu[i] - mean) * (cpu[i] - mean);
+
+    out.cpuMean = mean;
+    out.cpuMin = cpuMin;
+    out.cpuMax = cpuMax;
+    out.cpuStdDev = std::sqrt(squares / count);
+    out.memoryMean = (double)memorySum / count;
+    out.memoryMin = memoryMin;
+    out.memoryMax = memoryMax;
+}
+
+#ifdef HISTORY_STATS_AVX2
+HISTORY_STATS_AVX2_TARGET inline double HorizontalSum(__m256d v) {
+    __m128d pair = _mm_add_pd(_mm256_castpd256_pd128(v), _mm256_extractf128_pd(v, 1));
+    return _mm_cvtsd_f64(_mm_add_sd(pair, _mm_unpackhi_pd(pair, pair)));
+}
+
+// Memory is summed and compared as signed 64-bit lanes; working sets stay far below 2^63.
+HISTORY_STATS_AVX2_TARGET inline void HistoryStatsAvx2(const double* cpu, const SIZE_T* memory, UINT count, HistoryStats& out) {
+    if (count < 4) {
+        HistoryStatsScalar(cpu, memory, count, out);
+        return;
+    }
+    out = HistoryStats();
+    out.count = count;
+    const __m256i* memoryLanes = reinterpret_cast<const __m256i*>(memory);
+    __m256d cpuSum = _mm256_setzero_pd();
+    __m256d cpuMin = _mm256_loadu_pd(cpu);
+    __m256d cpuMax = cpuMin;
+    __m256i memorySum = _mm256_setzero_si256();
+    __m256i memoryMin = _mm256_loadu_si256(memoryLanes);
+    __m256i memoryMax = memoryMin;
+    UINT i = 0;
+    for (; i + 4 <= count; i += 4) {
+        __m256d c = _mm256_loadu_pd(cpu + i);
+        cpuSum = _mm256_add_pd(cpuSum, c);
+        cpuMin = _mm256_min_pd(cpuMin, c);
+        cpuMax = _mm256_max_pd(cpuMax, c);
+        __m256i m = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(memory + i));
+        memorySum = _mm256_add_epi64(memorySum, m);
+        memoryMin = _mm256_blendv_epi8(memoryMin, m, _mm256_cmpgt_epi64(memoryMin, m));
+        memoryMax = _mm256_blendv_epi8(memoryMax, m, _mm256_cmpgt_epi64(m, memoryMax));
+    }
+
+    double minLanes[4], maxLanes[4];
+    LONGLONG sumLanes[4], memoryMinLanes[4], memoryMaxLanes[4];
+    _mm256_storeu_pd(minLanes, cpuMin);
+    _mm256_storeu_pd(maxLanes, cpuMax);
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(sumLanes), memorySum);
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(memoryMinLanes), memoryMin);
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(memoryMaxLanes), memoryMax);
+    double sum = HorizontalSum(cpuSum);
+    double lowCpu = minLanes[0], highCpu = maxLanes[0];
+    ULONGLONG memoryTotal = 0;
+    ULONGLONG lowMemory = (ULONGLONG)memoryMinLanes[0], highMemory = (ULONGLONG)memoryMaxLanes[0];
+    for (int lane = 0; lane < 4; lane++) {
+        lowCpu = minLanes[lane] < lowCpu ? minLanes[lane] : lowCpu;
+        highCpu = maxLanes[lane] > highCpu ? maxLanes[lane] : highCpu;
+        memoryTotal += (ULONGLONG)sumLanes[lane];
+        lowMemory = (ULONGLONG)memoryMinLanes[lane] < lowMemory ? (ULONGLONG)memoryMinLanes[lane] : lowMemory;
+        highMemory = (ULONGLONG)memoryMaxLanes[lane] > highMemory ? (ULONGLONG)memoryMaxLanes[lane] : highMemory;
+    }
+    for (UINT tail = i; tail < count; tail++) {
+        sum += cpu[tail];
+        lowCpu = cpu[tail] < lowCpu ? cpu[tail] : lowCpu;
+        highCpu = cpu[tail] > highCpu ? cpu[tail] : highCpu;
+        memoryTotal += memory[tail];
+        lowMemory = memory[tail] < lowMemory ? memory[tail] : lowMemory;
+        highMemory = memory[tail] > highMemory ? memory[tail] : highMemory;
+    }
+
+    double mean = sum / count;
+    __m256d meanLanes = _mm256_set1_pd(mean);
+    __m256d squareSum = _mm256_setzero_pd();
+    for (i = 0; i + 4 <= count; i += 4) {
+        __m256d d = _mm256_sub_pd(_mm256_loadu_pd(cpu + i), meanLanes);
+        squareSum = _mm256_add_pd(squareSum, _mm256_mul_pd(d, d));
+    }
+    double squares = HorizontalSum(squareSum);
+    for (; i < count; i++) squares += (cpu[i] - mean) * (cpu[i] - mean);
+
+    out.cpuMean = mean;
+    out.cpuMin = lowCpu;
+    out.cpuMax = highCpu;
+    out.cpuStdDev = std::sqrt(squares / count);
+    out.memoryMean = (double)memoryTotal / count;
+    out.memoryMin = lowMemory;
+    out.memoryMax = highMemory;
+}
+#endif
+
+// Chosen once per process from what the processor supports.
+inline HistoryStatsFn HistoryStatsKernel() {
+#ifdef HISTORY_STATS_AVX2
+    static const HistoryStatsFn kernel = IsProcessorFeaturePresent(PF_AVX2_INSTRUCTIONS_AVAILABLE)
+        ? HistoryStatsAvx2 : HistoryStatsScalar;
+    return kernel;
+#else
+    return HistoryStatsScalar;
+#endif
+}
+
+inline bool HistoryStatsUsesAvx2() {
+#ifdef HISTORY_STATS_AVX2
+    return HistoryStatsKernel() == HistoryStatsAvx2;
+#else
+    return false;
+#endif
+}
+
+// Nearest-rank percentile of up to MAX_HISTORY samples; 'scratch' is overwritten.
+inline double HistoryPercentile(const double* cpu, UINT count, double fraction, double* scratch) {
+    if (!count) return 0.0;
+    std::copy(cpu, cpu + count, scratch);
+    UINT rank = (UINT)std::ceil(fraction * count);
+    if (rank) rank--;
+    std::nth_element(scratch, scratch + rank, scratch + count);
+    return scratch[rank];
+}
@@ -0,0 +1,239 @@
+// In-memory per-process history and the table of processes seen in the previous sample.
+#pragma once
+
+#include <windows.h>
+#include <vector>
+
+#include "process_types.h"
+#include "history_stats.h"
+
+// Fixed-capacity per-process ring buffers stored as structure-of-arrays: one contiguous
+// column per metric, MAX_HISTORY entries per slot. Slots are handed out by the process
+// table when a process first appears and released when it exits, so history lives
+// across refreshes. Running sums make averages O(1).
+class HistoryStore {
+private:
+    std::vector<double> cpuSamples;
+    std::vector<SIZE_T> memSamples;
+    std::vector<UINT> heads;
+    std::vector<UINT> counts;
+    std::vector<double> cpuSums;
+    std::vector<ULONGLONG> memSums;
+    std::vector<size_t> freeSlots;
+
+public:
+    size_t Allocate() {
+        size_t slot;
+        if (!freeSlots.empty()) {
+            slot = freeSlots.back();
+            freeSlots.pop_back();
+        } else {
+            slot = heads.size();
+            heads.push_back(0);
+            counts.push_back(0);
+            cpuSums.push_back(0.0);
+            memSums.push_back(0);
+            cpuSamples.resize(cpuSamples.size() + MAX_HISTORY);
+            memSamples.resize(memSamples.size() + MAX_HISTORY);
+        }
+        heads[slot] = 0;
+        counts[slot] = 0;
+        cpuSums[slot] = 0.0;
+        memSums[slot] = 0;
+        return slot;
+    }
+
+    void Release(size_t slot) {
+        freeSlots.push_back(slot);
+    }
+
+    void Record(size_t slot, double cpu, SIZE_T mem) {
+        size_t base = slot * MAX_HISTORY;
+        UINT head = heads[slot];
+        if (counts[slot] == MAX_HISTORY) {
+            cpuSums[slot] -= cpuSamples[base + head];
+            memSums[slot] -= memSamples[base + head];
+        } else {
+            counts[slot]++;
+        }
+        cpuSamples[base + head] = cpu;
+        memSamples[base + head] = mem;
+        cpuSums[slot] += cpu;
+        memSums[slot] += mem;
+        heads[slot] = (head + 1) % MAX_HISTORY;
+
+        // Re-derive the floating-point sum once per lap so subtraction error cannot accumulate.
+        if (heads[slot] == 0) {
+            double sum = 0.0;
+            for (UINT i = 0; i < counts[slot]; i++) sum += cpuSamples[base + i];
+            cpuSums[slot] = sum;
+        }
+    }
+
+    // A slow-tier sample stands for every tick since the previous one, so it fills that
+    // many entries and the ring keeps covering the same span as a fast-tier process's.
+    void Record(size_t slot, double cpu, SIZE_T mem, UINT ticks) {
+        if (ticks > MAX_HISTORY) ticks = MAX_HISTORY;
+        while (ticks--) Record(slot, cpu, mem);
+    }
+
+    UINT Count(size_t slot) const {
+        return counts[slot];
+    }
+
+    // i = 0 is the oldest retained sample.
+    double CpuAt(size_t slot, UINT i) const {
+        return cpuSamples[slot * MAX_HISTORY + (heads[slot] + MAX_HISTORY - counts[slot] + i) % MAX_HISTORY];
+    }
+
+    SIZE_T MemoryAt(size_t slot, UINT i) const {
+        return memSamples[slot * MAX_HISTORY + (heads[slot] + MAX_HISTORY - counts[slot] + i) % MAX_HISTORY];
+    }
+
+    double AverageCpu(size_t slot) const {
+        return counts[slot] ? cpuSums[slot] / counts[slot] : 0.0;
+    }
+
+    double AverageMemory(size_t slot) const {
+        return counts[slot] ? (double)memSums[slot] / counts[slot] : 0.0;
+    }
+
+    // Until a slot has wrapped its samples are the first Count(slot) entries; after that
+    // all MAX_HISTORY are, so the kernels always read one contiguous run per column.
+    void Summarize(size_t slot, HistoryStats& out, HistoryStatsFn kernel = HistoryStatsKernel()) const {
+        size_t base = slot * MAX_HISTORY;
+        kernel(cpuSamples.data() + base, memSamples.data() + base, counts[slot], out);
+        double scratch[MAX_HISTORY];
+        out.cpuPercentile = HistoryPercentile(cpuSamples.data() + base, counts[slot], HISTORY_STATS_PERCENTILE, scratch);
+    }
+
+    // One sweep over many slots, e.g. every live process after a refresh.
+    void SummarizeAll(const size_t* slots, size_t count, HistoryStats* out, HistoryStatsFn kernel = HistoryStatsKernel()) const {
+        for (size_t i = 0; i < count; i++) Summarize(slots[i], out[i], kernel);
+    }
+
+    double PeakCpu(size_t slot) const {
+        const double* samples = cpuSamples.data() + slot * MAX_HISTORY;
+        double peak = 0.0;
+        for (UINT i = 0; i < counts[slot]; i++) {
+            if (samples[i] > peak) peak = samples[i];
+        }
+        return peak;
+    }
+};
+
+// What the sampler remembers about a live process between refreshes. The 'shown' hashes
+// cover the values last published, at display resolution, for change detection.
+struct TrackedProcess {
+    ProcessKey key;
+    ULONGLONG generation;       // sample that last saw the process; 0 marks an empty slot
+    ULONGLONG lastCpuTime;
+    size_t historySlot;
+    UINT lastRow;
+    ULONGLONG shownRow;         // AllMetrics::ShownHash over Snapshot::changedRows' columns
+    ULONGLONG shownAverages;    // ...and over changedAverageRows'
+    ULONGLONG lastSampleTime;   // when lastCpuTime was read; rates are taken over this span
+    SIZE_T sampledMemory;       // working set at that sample, for the activity test
+    UINT idleSamples;           // consecutive samples without activity
+    UINT skippedTicks;          // ticks skipped on the slow tier since that sample
+    bool slowTier;
+    double cpuUsage;            // derived at that sample and carried over skipped ticks
+    SampledStorage::Values metrics;     // ...as are the collected metrics
+    SampledStorage::States metricStates; // e.g. the counters rates are taken from
+};
+
+// Open-addressing hash table (linear probing, backward-shift deletion) of the processes
+// seen in the previous sample, keyed by (PID, creation time). Kept at most half full.
+class ProcessTable {
+private:
+    std::vector<TrackedProcess> slots;
+    size_t mask;
+    size_t count = 0;
+
+    size_t Home(const ProcessKey& key) const {
+        return ProcessKeyHash()(key) & mask;
+    }
+
+    void Grow() {
+        std::vector<TrackedProcess> old;
+        old.swap(slots);
+        slots.assign(old.size() * 2, TrackedProcess());
+        mask = slots.size() - 1;
+        for (const auto& entry : old) {
+            if (!entry.generation) continue;
+            size_t i = Home(entry.key);
+            while (slots[i].generation) i = (i + 1) & mask;
+            slots[i] = entry;
+        }
+    }
+
+    void EraseAt(size_t i) {
+        size_t j = i;
+        for (;;) {
+            j = (j + 1) & mask;
+            if (!slots[j].generation) break;
+            // Move j back into the hole unless its home lies cyclically in (i, j].
+            size_t home = Home(slots[j].key);
+            bool stays = i <= j ? (i < home && home <= j) : (i < home || home <= j);
+            if (stays) continue;
+            slots[i] = slots[j];
+            i = j;
+        }
+        slots[i].generation = 0;
+        count--;
+    }
+
+public:
+    ProcessTable() : slots(1024), mask(1023) {}
+
+    // The returned reference is valid until the next Sweep, or Insert that has to grow.
+    TrackedProcess& Insert(const ProcessKey& key, bool& inserted) {
+        if ((count + 1) * 2 > slots.size()) Grow();
+        size_t i = Home(key);
+        while (slots[i].generation) {
+            if (slots[i].key == key) {
+                inserted = false;
+                return slots[i];
+            }
+            i = (i + 1) & mask;
+        }
+        inserted = true;
+        count++;
+        slots[i] = TrackedProcess();
+        slots[i].key = key;
+        return slots[i];
+    }
+
+    // Makes room for 'entries' processes, so Insert keeps earlier references valid until then.
+    void Reserve(size_t entries) {
+        while (entries * 2 > slots.size()) Grow();
+    }
+
+    // NULL if the process was not seen in an earlier sample.
+    const TrackedProcess* Find(const ProcessKey& key) const {
+        size_t i = Home(key);
+        while (slots[i].generation) {
+            if (slots[i].key == key) return &slots[i];
+            i = (i + 1) & mask;
+        }
+        return nullptr;
+    }
+
+    // Removes every process not seen in 'generation', calling onExit for each first.
+    template <typename Fn>
+    void Sweep(ULONGLONG generation, Fn onExit) {
+        size_t i = 0;
+        while (i < slots.size()) {
+            if (slots[i].generation && slots[i].generation != generation) {
+                onExit(slots[i]);
+                EraseAt(i);
+                continue; // a later entry may have shifted into i
+            }
+            i++;
+        }
+    }
+
+    size_t Size() const {
+        return count;
+    }
+};
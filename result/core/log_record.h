@@ -0,0 +1,22 @@
+// What the sampler thread hands to the logger thread: a sample header followed by the
+// processes that were added, changed or exited.
+#pragma once
+
+#include <windows.h>
+#include <string>
+
+enum LogRecordKind {
+    LOG_RECORD_SAMPLE,       // pid holds the number of records that follow; only changes
+    LOG_RECORD_FULL_SAMPLE,  // as above, but the records are the complete process table
+    LOG_RECORD_PROCESS,
+    LOG_RECORD_EXITED
+};
+
+struct LogRecord {
+    const std::wstring* name;   // interned in the sampler's NamePool; NULL for samples
+    ULONGLONG time;             // sample: timestamp, process: creation time
+    ULONGLONG memory;
+    double cpu;
+    DWORD pid;
+    DWORD kind;
+};
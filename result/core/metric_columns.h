@@ -0,0 +1,619 @@
+// Per-process metric columns as compile-time lists. Each metric is a traits type: key,
+// output label, table title and width, display unit and scale, sort key, where its value
+// comes from and how it is read from a ProcessInfo. A MetricColumns<...> list of them
+// generates the per-metric code that used to be written out by hand: sort comparisons,
+// filter lookups, table cells, key=value output, totals over a set of rows and the
+// sampler's change detection.
+//
+// Source metrics (PID, CPU, memory, ...) are ProcessInfo fields the process sources fill.
+// Every other metric is collected by the sampler from the extended counters or the history
+// window through its Collect hook, and stored in ProcessInfo::metrics, a tuple over the
+// SampledMetrics list. That list is a build switch: define SAMPLED_METRICS to a subset and
+// the build stores, collects and shows only those; the sampler skips the history rings and
+// rollups when no history metric is left, and the extended counters when no counter or
+// rate is. Adding a metric takes a traits type here and the lists that should carry it.
+// The binary layouts (history log, archive, wire protocol, shared snapshot) stay explicit,
+// because readers depend on them.
+#pragma once
+
+#include <windows.h>
+#include <cwchar>
+#include <cmath>
+#include <tuple>
+#include <type_traits>
+#include <strsafe.h>
+
+#include "history_stats.h"
+
+struct ProcessInfo;
+
+enum SortKey {
+    SORT_NONE,       // snapshot order
+    SORT_NAME,
+    SORT_PID,
+    SORT_CPU,
+    SORT_MEMORY,
+    SORT_AVG_CPU,
+    SORT_AVG_MEMORY,
+    SORT_PEAK_CPU,
+    SORT_CPU_STDDEV,
+    SORT_P95_CPU,
+    SORT_PRIVATE,    // extended counters
+    SORT_READ_RATE,
+    SORT_WRITE_RATE,
+    SORT_HANDLES,
+    SORT_THREADS,
+    SORT_FAULT_RATE
+};
+
+// Opt-in counters (Sampler::SetExtendedCounters), as the process sources read them. The NT
+// snapshot carries all of them in the same record as CPU and memory; the per-PID fallback
+// has no thread count.
+struct ExtendedCounters {
+    ULONGLONG privateBytes;     // private commit, as PROCESS_MEMORY_COUNTERS_EX::PrivateUsage
+    ULONGLONG readBytes;        // cumulative since the process started
+    ULONGLONG writeBytes;
+    DWORD pageFaults;           // cumulative
+    DWORD handleCount;
+    DWORD threadCount;
+};
+
+// Where a metric's value comes from, and so when the sampler collects it.
+enum MetricPhase {
+    METRIC_SOURCE,      // a ProcessInfo field filled by the process sources
+    METRIC_COUNTER,     // read from this sample's ExtendedCounters
+    METRIC_RATE,        // per second, from a cumulative counter and its previous reading
+    METRIC_HISTORY      // a statistic over the selected history window
+};
+
+// Which of the snapshot's change lists a metric's shown value feeds.
+enum MetricChange {
+    METRIC_CHANGE_NONE,
+    METRIC_CHANGE_ROW,          // Snapshot::changedRows
+    METRIC_CHANGE_AVERAGES      // Snapshot::changedAverageRows
+};
+
+// What a refresh of one process hands to the collected metrics.
+struct MetricSample {
+    const ExtendedCounters* counters;   // this sample's; set for the counter and rate phases
+    double seconds;                     // since the previous reading; 0 when there is none
+    HistoryStats stats;                 // over the window; cpuPercentile -1 where not kept
+};
+
+#define METRIC_MB (1024.0 * 1024.0)
+
+// Defaults; a metric hides the ones it changes.
+struct MetricTraits {
+    static constexpr const wchar_t* alias = nullptr;  // second filter name
+    static constexpr const wchar_t* unit = L"";       // appended in key=value output
+    static constexpr double scale = 1.0;              // shown value = raw value / scale
+    static constexpr int decimals = 2;
+    static constexpr int width = 100;                 // table column, pixels
+    static constexpr SortKey sort = SORT_NONE;
+    static constexpr bool summed = false;             // meaningful as a total over rows
+    static constexpr MetricPhase phase = METRIC_SOURCE;
+    static constexpr MetricChange change = METRIC_CHANGE_NONE;
+    static constexpr double resolution = 0.0;         // change detection step, raw units; 0: as shown
+
+    // Kept per process between refreshes, e.g. the previous reading of a counter.
+    struct State {};
+
+    // Shown as "-" instead of a number.
+    template <typename Process>
+    static bool Missing(const Process&) {
+        return false;
+    }
+};
+
+// A metric the sampler collects into ProcessInfo::metrics.
+template <typename Self, typename T>
+struct CollectedMetric : MetricTraits {
+    typedef T Value;
+
+    template <typename Process>
+    static T Get(const Process& proc) { return proc.metrics.template Get<Self>(); }
+};
+
+// Per second since the previous reading of a cumulative counter; 0 without one, or when
+// the counter went backwards.
+template <typename T>
+inline void CollectRate(T current, const MetricSample& sample, T& previous, double& rate) {
+    rate = sample.seconds > 0.0 && current >= previous ? (current - previous) / sample.seconds : 0.0;
+    previous = current;
+}
+
+struct MetricPid : MetricTraits {
+    static constexpr const wchar_t* key = L"pid";
+    static constexpr const wchar_t* label = L"pid";
+    static constexpr const wchar_t* title = L"PID";
+    static constexpr int decimals = 0;
+    static constexpr SortKey sort = SORT_PID;
+    template <typename Process>
+    static DWORD Get(const Process& proc) { return proc.pid; }
+};
+
+struct MetricParentPid : MetricTraits {
+    static constexpr const wchar_t* key = L"ppid";
+    static constexpr const wchar_t* label = L"parent";
+    static constexpr const wchar_t* title = L"Parent PID";
+    static constexpr int decimals = 0;
+    template <typename Process>
+    static DWORD Get(const Process& proc) { return proc.parentPid; }
+};
+
+struct MetricSession : MetricTraits {
+    static constexpr const wchar_t* key = L"session";
+    static constexpr const wchar_t* label = L"session";
+    static constexpr const wchar_t* title = L"Session";
+    static constexpr int decimals = 0;
+    template <typename Process>
+    static DWORD Get(const Process& proc) { return proc.sessionId; }
+};
+
+struct MetricCpu : MetricTraits {
+    static constexpr const wchar_t* key = L"cpu";
+    static constexpr const wchar_t* label = L"cpu";
+    static constexpr const wchar_t* title = L"CPU Usage (%)";
+    static constexpr const wchar_t* unit = L"%";
+    static constexpr SortKey sort = SORT_CPU;
+    static constexpr bool summed = true;
+    static constexpr MetricChange change = METRIC_CHANGE_ROW;
+    template <typename Process>
+    static double Get(const Process& proc) { return proc.cpuUsage; }
+};
+
+struct MetricMemory : MetricTraits {
+    static constexpr const wchar_t* key = L"memory";
+    static constexpr const wchar_t* alias = L"mem";
+    static constexpr const wchar_t* label = L"memory";
+    static constexpr const wchar_t* title = L"Memory Usage (MB)";
+    static constexpr const wchar_t* unit = L"MB";
+    static constexpr double scale = METRIC_MB;
+    static constexpr SortKey sort = SORT_MEMORY;
+    static constexpr bool summed = true;
+    static constexpr MetricChange change = METRIC_CHANGE_ROW;
+    template <typename Process>
+    static SIZE_T Get(const Process& proc) { return proc.memoryUsage; }
+};
+
+struct MetricAvgCpu : CollectedMetric<MetricAvgCpu, double> {
+    static constexpr const wchar_t* key = L"avgcpu";
+    static constexpr const wchar_t* label = L"avg_cpu";
+    static constexpr const wchar_t* title = L"Avg CPU (%)";
+    static constexpr const wchar_t* unit = L"%";
+    static constexpr int width = 150;
+    static constexpr SortKey sort = SORT_AVG_CPU;
+    static constexpr bool summed = true;
+    static constexpr MetricPhase phase = METRIC_HISTORY;
+    static constexpr MetricChange change = METRIC_CHANGE_AVERAGES;
+    static void Collect(const MetricSample& sample, State&, double& value) { value = sample.stats.cpuMean; }
+};
+
+struct MetricAvgMemory : CollectedMetric<MetricAvgMemory, double> {
+    static constexpr const wchar_t* key = L"avgmemory";
+    static constexpr const wchar_t* alias = L"avgmem";
+    static constexpr const wchar_t* label = L"avg_memory";
+    static constexpr const wchar_t* title = L"Avg Memory (MB)";
+    static constexpr const wchar_t* unit = L"MB";
+    static constexpr double scale = METRIC_MB;
+    static constexpr int width = 150;
+    static constexpr SortKey sort = SORT_AVG_MEMORY;
+    static constexpr bool summed = true;
+    static constexpr MetricPhase phase = METRIC_HISTORY;
+    static constexpr MetricChange change = METRIC_CHANGE_AVERAGES;
+    static void Collect(const MetricSample& sample, State&, double& value) { value = sample.stats.memoryMean; }
+};
+
+struct MetricPeakCpu : CollectedMetric<MetricPeakCpu, double> {
+    static constexpr const wchar_t* key = L"peakcpu";
+    static constexpr const wchar_t* label = L"peak_cpu";
+    static constexpr const wchar_t* title = L"Peak CPU (%)";
+    static constexpr const wchar_t* unit = L"%";
+    static constexpr int width = 150;
+    static constexpr SortKey sort = SORT_PEAK_CPU;
+    static constexpr MetricPhase phase = METRIC_HISTORY;
+    static constexpr MetricChange change = METRIC_CHANGE_AVERAGES;
+    static void Collect(const MetricSample& sample, State&, double& value) { value = sample.stats.cpuMax; }
+};
+
+struct MetricCpuStdDev : CollectedMetric<MetricCpuStdDev, double> {
+    static constexpr const wchar_t* key = L"stddevcpu";
+    static constexpr const wchar_t* label = L"stddev_cpu";
+    static constexpr const wchar_t* title = L"CPU Std Dev";
+    static constexpr int width = 110;
+    static constexpr SortKey sort = SORT_CPU_STDDEV;
+    static constexpr MetricPhase phase = METRIC_HISTORY;
+    static constexpr MetricChange change = METRIC_CHANGE_AVERAGES;
+    static void Collect(const MetricSample& sample, State&, double& value) { value = sample.stats.cpuStdDev; }
+};
+
+// Percentiles need raw samples, which only the minute window keeps.
+struct MetricP95Cpu : CollectedMetric<MetricP95Cpu, double> {
+    static constexpr const wchar_t* key = L"p95cpu";
+    static constexpr const wchar_t* label = L"p95_cpu";
+    static constexpr const wchar_t* title = L"P95 CPU (%)";
+    static constexpr const wchar_t* unit = L"%";
+    static constexpr int width = 110;
+    static constexpr SortKey sort = SORT_P95_CPU;
+    static constexpr MetricPhase phase = METRIC_HISTORY;
+    static constexpr MetricChange change = METRIC_CHANGE_AVERAGES;
+    static void Collect(const MetricSample& sample, State&, double& value) { value = sample.stats.cpuPercentile; }
+
+    template <typename Process>
+    static bool Missing(const Process& proc) { return Get(proc) < 0.0; }
+};
+
+struct MetricPrivate : CollectedMetric<MetricPrivate, ULONGLONG> {
+    static constexpr const wchar_t* key = L"private";
+    static constexpr const wchar_t* label = L"private";
+    static constexpr const wchar_t* title = L"Private (MB)";
+    static constexpr const wchar_t* unit = L"MB";
+    static constexpr double scale = METRIC_MB;
+    static constexpr int width = 85;
+    static constexpr SortKey sort = SORT_PRIVATE;
+    static constexpr bool summed = true;
+    static constexpr MetricPhase phase = METRIC_COUNTER;
+    static constexpr MetricChange change = METRIC_CHANGE_ROW;
+    static void Collect(const MetricSample& sample, State&, ULONGLONG& value) { value = sample.counters->privateBytes; }
+};
+
+struct MetricReadRate : CollectedMetric<MetricReadRate, double> {
+    static constexpr const wchar_t* key = L"read";
+    static constexpr const wchar_t* label = L"read";
+    static constexpr const wchar_t* title = L"Read (KB/s)";
+    static constexpr const wchar_t* unit = L"KB/s";
+    static constexpr double scale = 1024.0;
+    static constexpr int decimals = 1;
+    static constexpr int width = 85;
+    static constexpr SortKey sort = SORT_READ_RATE;
+    static constexpr bool summed = true;
+    static constexpr MetricPhase phase = METRIC_RATE;
+    static constexpr MetricChange change = METRIC_CHANGE_ROW;
+    typedef ULONGLONG State;
+
+    static void Collect(const MetricSample& sample, State& previous, double& value) {
+        CollectRate(sample.counters->readBytes, sample, previous, value);
+    }
+};
+
+struct MetricWriteRate : CollectedMetric<MetricWriteRate, double> {
+    static constexpr const wchar_t* key = L"write";
+    static constexpr const wchar_t* label = L"write";
+    static constexpr const wchar_t* title = L"Write (KB/s)";
+    static constexpr const wchar_t* unit = L"KB/s";
+    static constexpr double scale = 1024.0;
+    static constexpr int decimals = 1;
+    static constexpr int width = 85;
+    static constexpr SortKey sort = SORT_WRITE_RATE;
+    static constexpr bool summed = true;
+    static constexpr MetricPhase phase = METRIC_RATE;
+    static constexpr MetricChange change = METRIC_CHANGE_ROW;
+    typedef ULONGLONG State;
+
+    static void Collect(const MetricSample& sample, State& previous, double& value) {
+        CollectRate(sample.counters->writeBytes, sample, previous, value);
+    }
+};
+
+struct MetricHandles : CollectedMetric<MetricHandles, DWORD> {
+    static constexpr const wchar_t* key = L"handles";
+    static constexpr const wchar_t* label = L"handles";
+    static constexpr const wchar_t* title = L"Handles";
+    static constexpr int decimals = 0;
+    static constexpr int width = 85;
+    static constexpr SortKey sort = SORT_HANDLES;
+    static constexpr bool summed = true;
+    static constexpr MetricPhase phase = METRIC_COUNTER;
+    static constexpr MetricChange change = METRIC_CHANGE_ROW;
+    static void Collect(const MetricSample& sample, State&, DWORD& value) { value = sample.counters->handleCount; }
+};
+
+// The per-PID fallback cannot count threads cheaply.
+struct MetricThreads : CollectedMetric<MetricThreads, DWORD> {
+    static constexpr const wchar_t* key = L"threads";
+    static constexpr const wchar_t* label = L"threads";
+    static constexpr const wchar_t* title = L"Threads";
+    static constexpr int decimals = 0;
+    static constexpr int width = 85;
+    static constexpr SortKey sort = SORT_THREADS;
+    static constexpr bool summed = true;
+    static constexpr MetricPhase phase = METRIC_COUNTER;
+    static constexpr MetricChange change = METRIC_CHANGE_ROW;
+    static void Collect(const MetricSample& sample, State&, DWORD& value) { value = sample.counters->threadCount; }
+
+    template <typename Process>
+    static bool Missing(const Process& proc) { return Get(proc) == 0; }
+};
+
+struct MetricFaultRate : CollectedMetric<MetricFaultRate, double> {
+    static constexpr const wchar_t* key = L"faults";
+    static constexpr const wchar_t* label = L"faults";
+    static constexpr const wchar_t* title = L"Faults/s";
+    static constexpr const wchar_t* unit = L"/s";
+    static constexpr int decimals = 0;
+    static constexpr int width = 85;
+    static constexpr SortKey sort = SORT_FAULT_RATE;
+    static constexpr bool summed = true;
+    static constexpr MetricPhase phase = METRIC_RATE;
+    static constexpr MetricChange change = METRIC_CHANGE_ROW;
+    typedef DWORD State;
+
+    static void Collect(const MetricSample& sample, State& previous, double& value) {
+        CollectRate(sample.counters->pageFaults, sample, previous, value);
+    }
+};
+
+typedef double (*MetricGetter)(const ProcessInfo&);
+
+template <typename Metric>
+double MetricValue(const ProcessInfo& proc) {
+    return (double)Metric::Get(proc);
+}
+
+template <typename Metric>
+void FormatMetric(const ProcessInfo& proc, wchar_t* out, size_t size) {
+    if (Metric::Missing(proc)) StringCchCopyW(out, size, L"-");
+    else StringCchPrintfW(out, size, L"%.*f", Metric::decimals, MetricValue<Metric>(proc) / Metric::scale);
+}
+
+// The shown value in steps of Metric::resolution, or of the last decimal shown.
+template <typename Metric>
+LONGLONG ShownMetric(const ProcessInfo& proc) {
+    double step = Metric::resolution;
+    if (step == 0.0) {
+        step = Metric::scale;
+        for (int i = 0; i < Metric::decimals; i++) step /= 10.0;
+    }
+    return (LONGLONG)std::floor(MetricValue<Metric>(proc) / step + 0.5);
+}
+
+// Position of Metric in Metrics.
+template <typename Metric, typename... Metrics>
+struct MetricIndex;
+
+template <typename Metric, typename... Rest>
+struct MetricIndex<Metric, Metric, Rest...> : std::integral_constant<size_t, 0> {};
+
+template <typename Metric, typename First, typename... Rest>
+struct MetricIndex<Metric, First, Rest...> : std::integral_constant<size_t, 1 + MetricIndex<Metric, Rest...>::value> {};
+
+// One value per collected metric, as ProcessInfo::metrics stores them.
+template <typename... Metrics>
+struct MetricValues {
+    std::tuple<typename Metrics::Value...> values;
+
+    template <typename Metric>
+    typename Metric::Value& Get() { return std::get<MetricIndex<Metric, Metrics...>::value>(values); }
+
+    template <typename Metric>
+    const typename Metric::Value& Get() const { return std::get<MetricIndex<Metric, Metrics...>::value>(values); }
+};
+
+template <typename... Metrics>
+struct MetricColumns {
+    static constexpr size_t count = sizeof...(Metrics);
+
+    template <typename Metric>
+    static constexpr bool Contains = (std::is_same<Metric, Metrics>::value || ...);
+
+    // Per-column sums and maxima over the rows added, in raw units.
+    struct Totals {
+        size_t rows = 0;
+        double sum[count ? count : 1] = {};
+        double max[count ? count : 1] = {};
+    };
+
+    // Calls fn(Metric()) for each column in order.
+    template <typename Fn>
+    static void ForEach(Fn fn) {
+        (fn(Metrics()), ...);
+    }
+
+    // Table cell text for the column at 'index'; false past the end of the list.
+    static bool FormatCell(size_t index, const ProcessInfo& proc, wchar_t* out, size_t size) {
+        size_t i = 0;
+        bool found = false;
+        ((i++ == index ? (FormatMetric<Metrics>(proc, out, size), found = true) : false), ...);
+        return found;
+    }
+
+    // " label=valueunit" for every column, as the collector prints rows.
+    static void FormatFields(const ProcessInfo& proc, wchar_t* out, size_t size) {
+        out[0] = L'\0';
+        WCHAR value[64];
+        WCHAR field[96];
+        ForEach([&](auto metric) {
+            typedef decltype(metric) Metric;
+            FormatMetric<Metric>(proc, value, 64);
+            StringCchPrintfW(field, 96, L" %s=%s%s", Metric::label, value, Metric::Missing(proc) ? L"" : Metric::unit);
+            StringCchCatW(out, size, field);
+        });
+    }
+
+    // Finds a column by key or alias, ignoring case; 'length' characters of 'name'.
+    static bool Find(const wchar_t* name, size_t length, size_t& index) {
+        size_t i = 0;
+        bool found = false;
+        ForEach([&](auto metric) {
+            typedef decltype(metric) Metric;
+            if (!found && (Matches(Metric::key, name, length) || Matches(Metric::alias, name, length))) {
+                index = i;
+                found = true;
+            }
+            i++;
+        });
+        return found;
+    }
+
+    // One function per column, indexed like the list, for code that picks a column at
+    // run time once and then reads it for many rows.
+    static MetricGetter Getter(size_t index) {
+        static const MetricGetter getters[] = { &MetricValue<Metrics>..., nullptr };
+        return index < count ? getters[index] : nullptr;
+    }
+
+    static SortKey Sort(size_t index) {
+        static const SortKey keys[] = { Metrics::sort..., SORT_NONE };
+        return index < count ? keys[index] : SORT_NONE;
+    }
+
+    static bool FindSort(const wchar_t* name, SortKey& key) {
+        size_t index;
+        if (!Find(name, wcslen(name), index) || Sort(index) == SORT_NONE) return false;
+        key = Sort(index);
+        return true;
+    }
+
+    // -1, 0 or 1 for the column whose sort key is 'key'; 0 if no column has it.
+    static int Compare(SortKey key, const ProcessInfo& a, const ProcessInfo& b) {
+        int result = 0;
+        ((Metrics::sort != SORT_NONE && Metrics::sort == key ? (result = Order(Metrics::Get(a), Metrics::Get(b)), true) : false), ...);
+        return result;
+    }
+
+    static void Add(Totals& totals, const ProcessInfo& proc) {
+        size_t i = 0;
+        totals.rows++;
+        ForEach([&](auto metric) {
+            typedef decltype(metric) Metric;
+            double value = MetricValue<Metric>(proc);
+            totals.sum[i] += value;
+            if (value > totals.max[i]) totals.max[i] = value;
+            i++;
+        });
+    }
+
+    // " label=total" for the columns that add up across rows.
+    static void FormatTotals(const Totals& totals, wchar_t* out, size_t size) {
+        out[0] = L'\0';
+        WCHAR field[96];
+        size_t i = 0;
+        ForEach([&](auto metric) {
+            typedef decltype(metric) Metric;
+            if (Metric::summed) {
+                StringCchPrintfW(field, 96, L" %s=%.*f%s", Metric::label, Metric::decimals, totals.sum[i] / Metric::scale, Metric::unit);
+                StringCchCatW(out, size, field);
+            }
+            i++;
+        });
+    }
+
+    // A hash of the shown values of the columns that feed 'Change', for the sampler's
+    // change detection.
+    template <MetricChange Change>
+    static ULONGLONG ShownHash(const ProcessInfo& proc) {
+        ULONGLONG hash = 14695981039346656037ULL;
+        ForEach([&](auto metric) {
+            typedef decltype(metric) Metric;
+            if constexpr (Metric::change == Change) hash = (hash ^ (ULONGLONG)ShownMetric<Metric>(proc)) * 1099511628211ULL;
+        });
+        return hash;
+    }
+
+private:
+    template <typename T>
+    static int Order(T a, T b) {
+        return a < b ? -1 : a > b;
+    }
+
+    static bool Matches(const wchar_t* key, const wchar_t* name, size_t length) {
+        return key && wcslen(key) == length && _wcsnicmp(key, name, length) == 0;
+    }
+};
+
+// How a list of collected metrics is stored and collected: one value per process in
+// ProcessInfo::metrics and one State per process in the sampler's table.
+template <typename List>
+struct MetricStorage;
+
+template <typename... Metrics>
+struct MetricStorage<MetricColumns<Metrics...>> {
+    static_assert(((Metrics::phase != METRIC_SOURCE) && ...), "source metrics are ProcessInfo fields");
+
+    typedef MetricValues<Metrics...> Values;
+    typedef std::tuple<typename Metrics::State...> States;
+
+    static constexpr bool Uses(MetricPhase phase) {
+        return ((Metrics::phase == phase) || ...);
+    }
+
+    // Runs the Collect hook of every metric in 'Phase'.
+    template <MetricPhase Phase>
+    static void Collect(const MetricSample& sample, States& states, Values& values) {
+        (CollectMetric<Phase, Metrics>(sample, std::get<MetricIndex<Metrics, Metrics...>::value>(states),
+            values.template Get<Metrics>()), ...);
+    }
+
+    // Zeroes the metrics in 'Phase', e.g. the counters while they are not read.
+    template <MetricPhase Phase>
+    static void Reset(Values& values) {
+        ((Metrics::phase == Phase ? (void)(values.template Get<Metrics>() = typename Metrics::Value()) : (void)0), ...);
+    }
+
+private:
+    template <MetricPhase Phase, typename Metric>
+    static void CollectMetric(const MetricSample& sample, typename Metric::State& state, typename Metric::Value& value) {
+        if constexpr (Metric::phase == Phase) Metric::Collect(sample, state, value);
+    }
+};
+
+// The metrics this build stores and collects. Define SAMPLED_METRICS to a subset to leave
+// the others out of ProcessInfo, the sampler and every list below.
+#ifndef SAMPLED_METRICS
+#define SAMPLED_METRICS MetricAvgCpu, MetricAvgMemory, MetricPeakCpu, MetricCpuStdDev, MetricP95Cpu, MetricPrivate, \
+    MetricReadRate, MetricWriteRate, MetricHandles, MetricThreads, MetricFaultRate
+#endif
+typedef MetricColumns<SAMPLED_METRICS> SampledMetrics;
+typedef MetricStorage<SampledMetrics> SampledStorage;
+
+template <typename Metric>
+struct MetricEnabled : std::integral_constant<bool, Metric::phase == METRIC_SOURCE || SampledMetrics::Contains<Metric>> {};
+
+// The metric's value if this build collects it, else 'fallback'; for the fixed layouts.
+template <typename Metric>
+double MetricValueOr(const ProcessInfo& proc, double fallback) {
+    if constexpr (MetricEnabled<Metric>::value) {
+        return MetricValue<Metric>(proc);
+    } else {
+        (void)proc;
+        return fallback;
+    }
+}
+
+template <typename... Lists>
+struct MetricJoin;
+
+template <>
+struct MetricJoin<> {
+    typedef MetricColumns<> type;
+};
+
+template <typename... Metrics, typename... Lists>
+struct MetricJoin<MetricColumns<Metrics...>, Lists...> {
+    template <typename Rest>
+    struct Prepend;
+
+    template <typename... Others>
+    struct Prepend<MetricColumns<Others...>> {
+        typedef MetricColumns<Metrics..., Others...> type;
+    };
+
+    typedef typename Prepend<typename MetricJoin<Lists...>::type>::type type;
+};
+
+// MetricColumns over those of 'Metrics' this build has, in order.
+template <typename... Metrics>
+using MetricList = typename MetricJoin<typename std::conditional<MetricEnabled<Metrics>::value,
+    MetricColumns<Metrics>, MetricColumns<>>::type...>::type;
+
+// What each front end shows, after the name column, of the metrics this build has.
+typedef MetricList<MetricPid, MetricCpu, MetricMemory> ProcessTableMetrics;
+typedef MetricList<MetricAvgCpu, MetricAvgMemory, MetricPeakCpu, MetricCpuStdDev, MetricP95Cpu> HistoryTableMetrics;
+typedef MetricList<MetricPrivate, MetricReadRate, MetricWriteRate, MetricHandles, MetricThreads, MetricFaultRate> ExtendedMetrics;
+typedef MetricList<MetricCpu, MetricMemory, MetricAvgCpu, MetricAvgMemory, MetricPeakCpu, MetricCpuStdDev,
+    MetricP95Cpu> CollectorRowMetrics;
+
+// Every metric, for sorting and filtering by name.
+typedef MetricList<MetricPid, MetricParentPid, MetricSession, MetricCpu, MetricMemory, MetricAvgCpu, MetricAvgMemory,
+    MetricPeakCpu, MetricCpuStdDev, MetricP95Cpu, MetricPrivate, MetricReadRate, MetricWriteRate, MetricHandles,
+    MetricThreads, MetricFaultRate> AllMetrics;
@@ -0,0 +1,70 @@
+// Process name interning shared by the process sources, the snapshots and the logger.
+#pragma once
+
+#include <windows.h>
+#include <cwchar>
+#include <string>
+#include <deque>
+#include <vector>
+
+#define NAME_POOL_INITIAL_SLOTS 256 // power of two
+
+// Interns strings for the life of the pool. Returned pointers are stable, and the
+// strings behind them never change, so other threads may read them once the pointer
+// has been handed over through a synchronizing queue. Looking up a name that is already
+// interned never allocates, so a steady-state refresh interns every process for free.
+class NamePool {
+private:
+    std::deque<std::wstring> storage;
+    std::vector<const std::wstring*> slots;   // open addressing, kept at most half full
+    size_t count = 0;
+
+    static size_t Hash(const wchar_t* text, size_t length) {
+        ULONGLONG hash = 14695981039346656037ULL; // FNV-1a over UTF-16 code units
+        for (size_t i = 0; i < length; i++) {
+            hash ^= (ULONGLONG)text[i];
+            hash *= 1099511628211ULL;
+        }
+        return (size_t)hash;
+    }
+
+    void Place(const std::wstring* name) {
+        size_t mask = slots.size() - 1;
+        size_t i = Hash(name->data(), name->size()) & mask;
+        while (slots[i]) i = (i + 1) & mask;
+        slots[i] = name;
+    }
+
+    void Grow() {
+        std::vector<const std::wstring*> old(slots.size() * 2, nullptr);
+        old.swap(slots);
+        for (const std::wstring* name : old) {
+            if (name) Place(name);
+        }
+    }
+
+public:
+    NamePool() : slots(NAME_POOL_INITIAL_SLOTS, nullptr) {}
+
+    const std::wstring* Intern(const wchar_t* text, size_t length) {
+        size_t mask = slots.size() - 1;
+        for (size_t i = Hash(text, length) & mask; slots[i]; i = (i + 1) & mask) {
+            const std::wstring* name = slots[i];
+            if (name->size() == length && wmemcmp(name->data(), text, length) == 0) return name;
+        }
+        if ((count + 1) * 2 > slots.size()) Grow();
+        storage.emplace_back(text, length);
+        const std::wstring* interned = &storage.back();
+        Place(interned);
+        count++;
+        return interned;
+    }
+
+    const std::wstring* Intern(const std::wstring& name) {
+        return Intern(name.data(), name.size());
+    }
+
+    size_t Size() const {
+        return count;
+    }
+};
@@ -0,0 +1,302 @@
+// Process start and exit events from the kernel's ETW process provider, so processes that
+// live and die between two samples are still recorded. Polling remains the source of
+// counters, and with them of discovery: every tick needs each live process's CPU time, and
+// the NT capture returns the whole table, new and exited processes included, in one call,
+// so the events cannot spare any enumeration. They only add what polling cannot see.
+// Without the events (not elevated, or the session is unavailable) the sampler simply
+// polls as before.
+#pragma once
+
+#include <windows.h>
+#include <evntrace.h>
+#include <evntcons.h>
+#include <tdh.h>
+#include <vector>
+#include <algorithm>
+#include <map>
+#include <atomic>
+#include <strsafe.h>
+
+#include "process_types.h"
+#include "name_pool.h"
+#include "spsc_queue.h"
+
+#pragma comment(lib, "advapi32.lib")
+#pragma comment(lib, "tdh.lib")
+
+#define ETW_SESSION_NAME L"ProcessMonitorProcessTrace" // followed by '-' and the monitor's PID
+#define ETW_SESSION_NAME_CHARS 64
+#define ETW_SESSION_NAME_BYTES (1024 * sizeof(WCHAR))
+#define ETW_EVENT_QUEUE_CAPACITY 8192        // events; must be a power of two
+#define ETW_IMAGE_CHARS 64
+#define ETW_OPCODE_START 1
+#define ETW_OPCODE_END 2
+#define ETW_MATCH_TOLERANCE 10000000ULL      // FILETIME units between an event and a create time
+#define ETW_PENDING_MAX_AGE (30 * 10000000ULL)
+
+// Classic kernel provider GUIDs, as in evntrace.h, defined here so no GUID library is needed.
+static const GUID EtwSystemTraceControlGuid = { 0x9e814aad, 0x3204, 0x11d2, { 0x9a, 0x82, 0x00, 0x60, 0x08, 0xa8, 0x69, 0x39 } };
+static const GUID EtwProcessEventGuid = { 0x3d6fa8d0, 0xfe05, 0x11d0, { 0x9d, 0xda, 0x00, 0xc0, 0x4f, 0xd7, 0xba, 0x7c } };
+static const GUID EtwSessionGuid = { 0x6a1e2c55, 0x4f0b, 0x4d7e, { 0x9a, 0x31, 0x5b, 0x0e, 0x8c, 0x2d, 0x71, 0x44 } };
+
+struct ProcessEvent {
+    ULONGLONG time;             // FILETIME of the event
+    DWORD pid;
+    DWORD parentPid;
+    LONG exitStatus;
+    WORD opcode;                // ETW_OPCODE_START or ETW_OPCODE_END
+    WORD imageLength;
+    WCHAR image[ETW_IMAGE_CHARS];
+};
+
+struct ProcessEventStats {
+    bool active;
+    ULONGLONG received;
+    ULONGLONG dropped;          // the sampler fell behind and the queue was full
+    ULONGLONG transient;        // processes recorded only through events
+};
+
+struct PendingOrder {
+    bool operator()(const ProcessKey& a, const ProcessKey& b) const {
+        return a.pid != b.pid ? a.pid < b.pid : a.createTime < b.createTime;
+    }
+};
+
+// Owns a real-time kernel trace session and its consumer thread. The consumer thread
+// only decodes and queues events; the sampler thread drains them in Collect.
+class ProcessEventSource {
+private:
+    SpscQueue<ProcessEvent> queue{ ETW_EVENT_QUEUE_CAPACITY };
+    std::vector<BYTE> properties;
+    const wchar_t* sessionName = NULL;
+    WCHAR ownName[ETW_SESSION_NAME_CHARS];
+    TRACEHANDLE session = 0;
+    TRACEHANDLE trace = INVALID_PROCESSTRACE_HANDLE;
+    HANDLE hThread = NULL;
+    std::atomic<ULONGLONG> received{ 0 };
+    std::atomic<ULONGLONG> dropped{ 0 };
+    std::atomic<ULONGLONG> transientTotal{ 0 };
+
+    // Sampler thread only.
+    std::vector<ProcessEvent> events;
+    // Started, not yet seen by a snapshot; by (pid, start time), so a reused pid whose first
+    // process has not reported its exit yet does not replace that process.
+    std::map<ProcessKey, ProcessEvent, PendingOrder> pendingStarts;
+    std::vector<ProcessEvent> recentExits;                   // seen by snapshots, with their create time
+    std::vector<ProcessKey> live;                            // sorted snapshot keys, built on demand
+
+    EVENT_TRACE_PROPERTIES* Properties() {
+        properties.assign(sizeof(EVENT_TRACE_PROPERTIES) + 2 * ETW_SESSION_NAME_BYTES, 0);
+        EVENT_TRACE_PROPERTIES* props = reinterpret_cast<EVENT_TRACE_PROPERTIES*>(properties.data());
+        props->Wnode.BufferSize = (ULONG)properties.size();
+        props->Wnode.Flags = WNODE_FLAG_TRACED_GUID;
+        props->Wnode.ClientContext = 2; // system time stamps
+        props->LoggerNameOffset = sizeof(EVENT_TRACE_PROPERTIES);
+        props->LogFileNameOffset = 0;
+        return props;
+    }
+
+    ULONG StartSession(const wchar_t* name, bool systemLogger) {
+        EVENT_TRACE_PROPERTIES* props = Properties();
+        props->Wnode.Guid = systemLogger ? EtwSessionGuid : EtwSystemTraceControlGuid;
+        if (systemLogger) props->Wnode.Guid.Data1 ^= GetCurrentProcessId(); // one per monitor, like the name
+        props->LogFileMode = EVENT_TRACE_REAL_TIME_MODE | (systemLogger ? EVENT_TRACE_SYSTEM_LOGGER_MODE : 0);
+        props->EnableFlags = EVENT_TRACE_FLAG_PROCESS;
+        props->FlushTimer = 1;  // seconds; keeps delivery within about one sample
+        return StartTraceW(&session, name, props);
+    }
+
+    template <typename T>
+    static bool ReadProperty(PEVENT_RECORD record, const wchar_t* name, T& value) {
+        PROPERTY_DATA_DESCRIPTOR descriptor = { (ULONGLONG)(ULONG_PTR)name, ULONG_MAX, 0 };
+        ULONG size = 0;
+        if (TdhGetPropertySize(record, 0, NULL, 1, &descriptor, &size) != ERROR_SUCCESS || size != sizeof(T)) return false;
+        return TdhGetProperty(record, 0, NULL, 1, &descriptor, size, reinterpret_cast<PBYTE>(&value)) == ERROR_SUCCESS;
+    }
+
+    // ImageFileName is an ANSI string in the kernel's process events.
+    static void ReadImageName(PEVENT_RECORD record, ProcessEvent& event) {
+        event.imageLength = 0;
+        PROPERTY_DATA_DESCRIPTOR descriptor = { (ULONGLONG)(ULONG_PTR)L"ImageFileName", ULONG_MAX, 0 };
+        ULONG size = 0;
+        char image[ETW_IMAGE_CHARS * 2];
+        if (TdhGetPropertySize(record, 0, NULL, 1, &descriptor, &size) != ERROR_SUCCESS || size == 0) return;
+        if (size > sizeof(image)) size = sizeof(image);
+        if (TdhGetProperty(record, 0, NULL, 1, &descriptor, size, reinterpret_cast<PBYTE>(image)) != ERROR_SUCCESS) return;
+        int length = (int)strnlen(image, size);
+        event.imageLength = (WORD)MultiByteToWideChar(CP_ACP, 0, image, length, event.image, ETW_IMAGE_CHARS);
+    }
+
+    static VOID WINAPI OnEvent(PEVENT_RECORD record) {
+        ProcessEventSource* self = static_cast<ProcessEventSource*>(record->UserContext);
+        if (!IsEqualGUID(record->EventHeader.ProviderId, EtwProcessEventGuid)) return;
+        UCHAR opcode = record->EventHeader.EventDescriptor.Opcode;
+        if (opcode != ETW_OPCODE_START && opcode != ETW_OPCODE_END) return;
+
+        ProcessEvent event;
+        event.time = (ULONGLONG)record->EventHeader.TimeStamp.QuadPart;
+        event.opcode = opcode;
+        event.parentPid = 0;
+        event.exitStatus = 0;
+        if (!ReadProperty(record, L"ProcessId", event.pid)) return;
+        ReadProperty(record, L"ParentId", event.parentPid);
+        if (opcode == ETW_OPCODE_END) ReadProperty(record, L"ExitStatus", event.exitStatus);
+        ReadImageName(record, event);
+
+        self->received.fetch_add(1, std::memory_order_relaxed);
+        if (!self->queue.TryPush(&event, 1)) self->dropped.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    static DWORD WINAPI ThreadProc(LPVOID param) {
+        ProcessEventSource* self = static_cast<ProcessEventSource*>(param);
+        ProcessTrace(&self->trace, 1, NULL, NULL);
+        return 0;
+    }
+
+    static bool Near(ULONGLONG a, ULONGLONG b) {
+        return (a > b ? a - b : b - a) <= ETW_MATCH_TOLERANCE;
+    }
+
+    // Whether a snapshot saw this process: it is live now, or exited after being sampled.
+    bool Seen(const ProcessEvent& start) const {
+        auto it = std::lower_bound(live.begin(), live.end(), ProcessKey{ start.pid, 0 },
+            [](const ProcessKey& a, const ProcessKey& b) { return a.pid < b.pid; });
+        for (; it != live.end() && it->pid == start.pid; ++it) {
+            if (Near(it->createTime, start.time)) return true;
+        }
+        for (const auto& exit : recentExits) {
+            if (exit.pid == start.pid && Near(exit.time, start.time)) return true;
+        }
+        return false;
+    }
+
+public:
+    ~ProcessEventSource() {
+        Stop();
+    }
+
+    // Needs administrator rights. Prefers a system-logger session of its own (Windows 8+),
+    // named after this process so the GUI and a collector can both run, and falls back to
+    // the NT Kernel Logger only if nobody else is using it. Otherwise events are
+    // unavailable (IsActive is false) and the sampler only polls.
+    bool Start() {
+        StringCchPrintfW(ownName, ETW_SESSION_NAME_CHARS, L"%s-%lu", ETW_SESSION_NAME, GetCurrentProcessId());
+        sessionName = ownName;
+        ULONG status = StartSession(sessionName, true);
+        if (status == ERROR_ALREADY_EXISTS) {
+            // Only a run that did not stop cleanly can have left it: its owner had this PID,
+            // so it has exited.
+            ControlTraceW(0, sessionName, Properties(), EVENT_TRACE_CONTROL_STOP);
+            status = StartSession(sessionName, true);
+        }
+        if (status != ERROR_SUCCESS) {
+            sessionName = KERNEL_LOGGER_NAMEW;
+            status = StartSession(sessionName, false);
+        }
+        if (status != ERROR_SUCCESS) {
+            session = 0;
+            return false;
+        }
+
+        EVENT_TRACE_LOGFILEW logFile = { 0 };
+        logFile.LoggerName = const_cast<LPWSTR>(sessionName);
+        logFile.ProcessTraceMode = PROCESS_TRACE_MODE_REAL_TIME | PROCESS_TRACE_MODE_EVENT_RECORD;
+        logFile.EventRecordCallback = OnEvent;
+        logFile.Context = this;
+        trace = OpenTraceW(&logFile);
+        if (trace != INVALID_PROCESSTRACE_HANDLE) hThread = CreateThread(NULL, 0, ThreadProc, this, 0, NULL);
+        if (!hThread) {
+            Stop();
+            return false;
+        }
+        return true;
+    }
+
+    void Stop() {
+        if (session) {
+            ControlTraceW(session, NULL, Properties(), EVENT_TRACE_CONTROL_STOP);
+            session = 0;
+        }
+        if (trace != INVALID_PROCESSTRACE_HANDLE) {
+            CloseTrace(trace);
+            trace = INVALID_PROCESSTRACE_HANDLE;
+        }
+        if (hThread) {
+            WaitForSingleObject(hThread, INFINITE);
+            CloseHandle(hThread);
+            hThread = NULL;
+        }
+    }
+
+    bool IsActive() const {
+        return hThread != NULL;
+    }
+
+    // Sampler thread, after the snapshot's processes and exits are known. Appends the
+    // processes that started and exited without any snapshot seeing them to 'out'.
+    void Collect(const Snapshot& snap, NamePool& names, std::vector<TransientProcess>& out) {
+        if (!hThread) return;
+        events.clear();
+        ProcessEvent event;
+        while (queue.TryPop(event)) events.push_back(event);
+        // Each processor has its own trace buffers, so a batch is not in time order.
+        std::stable_sort(events.begin(), events.end(), [](const ProcessEvent& a, const ProcessEvent& b) { return a.time < b.time; });
+
+        for (const auto& key : snap.exited) {
+            ProcessEvent exit = {};
+            exit.pid = key.pid;
+            exit.time = key.createTime;
+            recentExits.push_back(exit);
+        }
+        live.clear();
+        if (!events.empty() || !pendingStarts.empty()) {
+            for (const auto& proc : snap.processes) live.push_back({ proc.pid, proc.createTime });
+            std::sort(live.begin(), live.end(), [](const ProcessKey& a, const ProcessKey& b) { return a.pid < b.pid; });
+        }
+
+        for (const auto& e : events) {
+            if (e.opcode == ETW_OPCODE_START) {
+                pendingStarts[{ e.pid, e.time }] = e;
+                continue;
+            }
+            // The exit belongs to the newest start of its pid at or before it.
+            auto it = pendingStarts.upper_bound({ e.pid, e.time });
+            if (it == pendingStarts.begin()) continue;
+            --it;
+            if (it->first.pid != e.pid) continue;
+            const ProcessEvent& start = it->second;
+            if (!Seen(start)) {
+                TransientProcess transient;
+                transient.pid = e.pid;
+                transient.parentPid = start.parentPid;
+                transient.name = start.imageLength ? names.Intern(start.image, start.imageLength)
+                    : names.Intern(e.image, e.imageLength);
+                transient.startTime = start.time;
+                transient.exitTime = e.time;
+                transient.exitStatus = e.exitStatus;
+                out.push_back(transient);
+                transientTotal.fetch_add(1, std::memory_order_relaxed);
+            }
+            pendingStarts.erase(it);
+        }
+
+        // Starts that a snapshot has now seen are ordinary processes; drop them, and any
+        // whose exit event was lost.
+        for (auto it = pendingStarts.begin(); it != pendingStarts.end();) {
+            bool stale = snap.sampleTime > it->second.time + ETW_PENDING_MAX_AGE;
+            if (stale || Seen(it->second)) it = pendingStarts.erase(it);
+            else ++it;
+        }
+        // recentExits holds create times, so age it by count rather than by time.
+        if (recentExits.size() > 4096) recentExits.erase(recentExits.begin(), recentExits.end() - 1024);
+    }
+
+    ProcessEventStats Stats() const {
+        ProcessEventStats stats;
+        stats.active = hThread != NULL;
+        stats.received = received.load(std::memory_order_relaxed);
+        stats.dropped = dropped.load(std::memory_order_relaxed);
+        stats.transient = transientTotal.load(std::memory_order_relaxed);
+        return stats;
+    }
+};
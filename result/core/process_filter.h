@@ -0,0 +1,354 @@
+// Filter expressions over process columns, such as  name ~ "cl.exe" && cpu > 5  or
+// mem > 1GB. Each expression is compiled once into a postfix program. The view, the
+// alert rules and the collector then run that program over each ProcessInfo before
+// anything is formatted.
+//
+//   expr   := and ('||' and)*
+//   and    := unary ('&&' unary)*
+//   unary  := '!' unary | '(' expr ')' | column op value
+//   op     := == != < <= > >= ~ !~       (~ is "contains"; = is taken as ==)
+//   value  := number [K|KB|M|MB|G|GB|T|TB|%] | "text" | word
+//
+// Columns are "name" and the metric keys in metric_columns.h: the --sort names, ppid and
+// session, with mem and avgmem short for memory and avgmemory. Memory values are in bytes
+// and rates per second, with units in powers of 1024. Names take only == != ~ !~, and
+// match without regard to case.
+#pragma once
+
+#include <windows.h>
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <cwchar>
+#include <cwctype>
+#include <cstdlib>
+#include <strsafe.h>
+
+#include "process_types.h"
+#include "metric_columns.h"
+
+#define FILTER_MAX_DEPTH 32          // operands pending at once while evaluating
+#define FILTER_MAX_NAME_TESTS 64     // name comparisons per expression; one bit each in the cache
+
+enum FilterCompare : BYTE {
+    FILTER_EQ,
+    FILTER_NE,
+    FILTER_LT,
+    FILTER_LE,
+    FILTER_GT,
+    FILTER_GE,
+    FILTER_CONTAINS,
+    FILTER_NOT_CONTAINS
+};
+
+class ProcessFilter {
+private:
+    enum Opcode : BYTE {
+        OP_COMPARE,     // push getter(row) <compare> value
+        OP_NAME,        // push bit 'test' of the name's cached results
+        OP_AND,
+        OP_OR,
+        OP_NOT
+    };
+
+    struct Instruction {
+        Opcode op;
+        FilterCompare compare;
+        BYTE test;
+        MetricGetter getter;
+        double value;
+    };
+
+    struct NameTest {
+        FilterCompare compare;
+        std::wstring pattern;       // lowercase
+    };
+
+    std::vector<Instruction> program;
+    std::vector<NameTest> nameTests;
+    std::wstring text;
+
+    // Bit t is the result of nameTests[t]. Names are interned, so the pointer identifies the
+    // name and each one is lowered and matched once, the first time a row carries it.
+    std::unordered_map<const std::wstring*, ULONGLONG> nameResults;
+    std::wstring lowered;
+
+    // Compiler state, valid only during Compile.
+    const wchar_t* input = nullptr;
+    size_t pos = 0;
+    int depth = 0;
+    int nesting = 0;
+    std::wstring* error = nullptr;
+
+    static bool Compare(double left, FilterCompare compare, double right) {
+        switch (compare) {
+        case FILTER_EQ: return left == right;
+        case FILTER_NE: return left != right;
+        case FILTER_LT: return left < right;
+        case FILTER_LE: return left <= right;
+        case FILTER_GT: return left > right;
+        case FILTER_GE: return left >= right;
+        default: return false;
+        }
+    }
+
+    ULONGLONG NameBits(const std::wstring* name) {
+        auto it = nameResults.find(name);
+        if (it != nameResults.end()) return it->second;
+        lowered.assign(*name);
+        for (auto& ch : lowered) ch = (wchar_t)towlower(ch);
+        ULONGLONG bits = 0;
+        for (size_t t = 0; t < nameTests.size(); t++) {
+            const NameTest& test = nameTests[t];
+            bool result;
+            switch (test.compare) {
+            case FILTER_EQ: result = lowered == test.pattern; break;
+            case FILTER_NE: result = lowered != test.pattern; break;
+            case FILTER_CONTAINS: result = lowered.find(test.pattern) != std::wstring::npos; break;
+            default: result = lowered.find(test.pattern) == std::wstring::npos; break;
+            }
+            if (result) bits |= 1ULL << t;
+        }
+        nameResults.emplace(name, bits);
+        return bits;
+    }
+
+    bool Fail(const wchar_t* message) {
+        if (error->empty()) {
+            WCHAR buffer[128];
+            StringCchPrintfW(buffer, 128, L"%s at column %u", message, (unsigned)pos + 1);
+            *error = buffer;
+        }
+        return false;
+    }
+
+    void SkipSpace() {
+        while (input[pos] == L' ' || input[pos] == L'\t') pos++;
+    }
+
+    bool Accept(const wchar_t* token) {
+        SkipSpace();
+        size_t length = wcslen(token);
+        if (wcsncmp(input + pos, token, length) != 0) return false;
+        pos += length;
+        return true;
+    }
+
+    // Each operand pushed or binary operator popped changes the evaluation depth by one.
+    bool Emit(Opcode op, FilterCompare compare = FILTER_EQ, BYTE test = 0, MetricGetter getter = nullptr, double value = 0.0) {
+        if (op == OP_COMPARE || op == OP_NAME) {
+            if (++depth > FILTER_MAX_DEPTH) return Fail(L"expression too deep");
+        } else if (op != OP_NOT) {
+            depth--;
+        }
+        program.push_back({ op, compare, test, getter, value });
+        return true;
+    }
+
+    static bool IsWordChar(wchar_t ch) {
+        return ch && !iswspace(ch) && !wcschr(L"()&|!<>=~\"", ch);
+    }
+
+    // 'getter' is null for the name column.
+    bool ParseColumn(MetricGetter& getter) {
+        SkipSpace();
+        size_t start = pos;
+        while (iswalnum(input[pos])) pos++;
+        size_t index;
+        if (pos - start == 4 && _wcsnicmp(input + start, L"name", 4) == 0) {
+            getter = nullptr;
+            return true;
+        }
+        if (AllMetrics::Find(input + start, pos - start, index)) {
+            getter = AllMetrics::Getter(index);
+            return true;
+        }
+        pos = start;
+        return Fail(L"expected a column name");
+    }
+
+    // Two-character operators first so "<=" is not read as "<".
+    bool ParseCompare(FilterCompare& compare) {
+        static const struct { const wchar_t* token; FilterCompare compare; } operators[] = {
+            { L"==", FILTER_EQ }, { L"!=", FILTER_NE }, { L"<=", FILTER_LE }, { L">=", FILTER_GE }, { L"!~", FILTER_NOT_CONTAINS },
+            { L"<", FILTER_LT }, { L">", FILTER_GT }, { L"~", FILTER_CONTAINS }, { L"=", FILTER_EQ },
+        };
+        for (const auto& entry : operators) {
+            if (Accept(entry.token)) {
+                compare = entry.compare;
+                return true;
+            }
+        }
+        return Fail(L"expected a comparison");
+    }
+
+    bool ParseText(std::wstring& value) {
+        SkipSpace();
+        value.clear();
+        if (input[pos] == L'"') {
+            size_t end = pos + 1;
+            while (input[end] && input[end] != L'"') end++;
+            if (!input[end]) return Fail(L"unterminated string");
+            value.assign(input + pos + 1, end - pos - 1);
+            pos = end + 1;
+            return true;
+        }
+        size_t start = pos;
+        while (IsWordChar(input[pos])) pos++;
+        if (pos == start) return Fail(L"expected a name");
+        value.assign(input + start, pos - start);
+        return true;
+    }
+
+    bool ParseNumber(double& value) {
+        SkipSpace();
+        if (!iswdigit(input[pos]) && input[pos] != L'.') return Fail(L"expected a number");
+        wchar_t* end;
+        value = wcstod(input + pos, &end);
+        pos = end - input;
+        static const struct { const wchar_t* suffix; double scale; } units[] = {
+            { L"KB", 1024.0 }, { L"MB", 1024.0 * 1024.0 }, { L"GB", 1024.0 * 1024.0 * 1024.0 },
+            { L"TB", 1024.0 * 1024.0 * 1024.0 * 1024.0 }, { L"K", 1024.0 }, { L"M", 1024.0 * 1024.0 },
+            { L"G", 1024.0 * 1024.0 * 1024.0 }, { L"T", 1024.0 * 1024.0 * 1024.0 * 1024.0 }, { L"%", 1.0 },
+        };
+        for (const auto& unit : units) {
+            size_t length = wcslen(unit.suffix);
+            if (_wcsnicmp(input + pos, unit.suffix, length) == 0 && !iswalnum(input[pos + length])) {
+                value *= unit.scale;
+                pos += length;
+                return true;
+            }
+        }
+        if (iswalpha(input[pos])) return Fail(L"unknown unit");
+        return true;
+    }
+
+    bool ParseComparison() {
+        MetricGetter getter;
+        FilterCompare compare;
+        if (!ParseColumn(getter) || !ParseCompare(compare)) return false;
+        if (!getter) {
+            if (compare != FILTER_EQ && compare != FILTER_NE && compare != FILTER_CONTAINS && compare != FILTER_NOT_CONTAINS) {
+                return Fail(L"names only compare with == != ~ !~");
+            }
+            if (nameTests.size() == FILTER_MAX_NAME_TESTS) return Fail(L"too many name comparisons");
+            NameTest test = { compare, L"" };
+            if (!ParseText(test.pattern)) return false;
+            for (auto& ch : test.pattern) ch = (wchar_t)towlower(ch);
+            nameTests.push_back(test);
+            return Emit(OP_NAME, compare, (BYTE)(nameTests.size() - 1));
+        }
+        if (compare == FILTER_CONTAINS || compare == FILTER_NOT_CONTAINS) return Fail(L"~ only applies to names");
+        double value;
+        if (!ParseNumber(value)) return false;
+        return Emit(OP_COMPARE, compare, 0, getter, value);
+    }
+
+    // Nesting is bounded like the evaluation stack, so no input can exhaust the real one.
+    bool ParseUnary() {
+        if (++nesting > FILTER_MAX_DEPTH) return Fail(L"expression too deep");
+        bool ok;
+        // "!=" and "!~" only follow a column, so a '!' here is always a negation.
+        if (Accept(L"!")) {
+            ok = ParseUnary() && Emit(OP_NOT);
+        } else if (Accept(L"(")) {
+            ok = ParseOr() && (Accept(L")") || Fail(L"expected )"));
+        } else {
+            ok = ParseComparison();
+        }
+        nesting--;
+        return ok;
+    }
+
+    bool ParseAnd() {
+        if (!ParseUnary()) return false;
+        while (Accept(L"&&")) {
+            if (!ParseUnary() || !Emit(OP_AND)) return false;
+        }
+        return true;
+    }
+
+    bool ParseOr() {
+        if (!ParseAnd()) return false;
+        while (Accept(L"||")) {
+            if (!ParseAnd() || !Emit(OP_OR)) return false;
+        }
+        return true;
+    }
+
+public:
+    // An empty or blank expression matches every process. On failure 'message' says what
+    // was expected where, and the filter is left empty.
+    bool Compile(const wchar_t* expression, std::wstring& message) {
+        Clear();
+        message.clear();
+        input = expression;
+        pos = 0;
+        depth = 0;
+        nesting = 0;
+        error = &message;
+        SkipSpace();
+        bool ok = !input[pos] || ParseOr();
+        SkipSpace();
+        if (ok && input[pos]) ok = Fail(L"unexpected text");
+        input = nullptr;
+        error = nullptr;
+        if (!ok) {
+            Clear();
+            return false;
+        }
+        text = expression;
+        return true;
+    }
+
+    void Clear() {
+        program.clear();
+        nameTests.clear();
+        nameResults.clear();
+        text.clear();
+    }
+
+    bool Empty() const {
+        return program.empty();
+    }
+
+    const std::wstring& Text() const {
+        return text;
+    }
+
+    // Reads only columns and the name pointer; a name is compared once per filter, so a
+    // steady-state pass over a snapshot touches no strings and does not allocate.
+    bool Matches(const ProcessInfo& proc) {
+        if (program.empty()) return true;
+        bool stack[FILTER_MAX_DEPTH];
+        int top = 0;
+        ULONGLONG bits = 0;
+        bool bitsLoaded = false;
+        for (const Instruction& ins : program) {
+            switch (ins.op) {
+            case OP_COMPARE:
+                stack[top++] = Compare(ins.getter(proc), ins.compare, ins.value);
+                break;
+            case OP_NAME:
+                if (!bitsLoaded) {
+                    bits = NameBits(proc.name);
+                    bitsLoaded = true;
+                }
+                stack[top++] = (bits >> ins.test) & 1;
+                break;
+            case OP_AND:
+                top--;
+                stack[top - 1] = stack[top - 1] && stack[top];
+                break;
+            case OP_OR:
+                top--;
+                stack[top - 1] = stack[top - 1] || stack[top];
+                break;
+            case OP_NOT:
+                stack[top - 1] = !stack[top - 1];
+                break;
+            }
+        }
+        return stack[0];
+    }
+};
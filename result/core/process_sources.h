@@ -0,0 +1,528 @@
+// Ways of reading the process list: one NtQuerySystemInformation snapshot, or the
+// EnumProcesses fallback with a cache of opened process handles.
+#pragma once
+
+#include <windows.h>
+#include <winternl.h>
+#include <psapi.h>
+#include <vector>
+#include <string>
+#include <unordered_map>
+#include <atomic>
+
+#include "process_types.h"
+#include "work_pool.h"
+#include "name_pool.h"
+
+#pragma comment(lib, "psapi.lib")
+
+#define SNAPSHOT_INITIAL_BUFFER (256 * 1024)
+#define SNAPSHOT_MAX_ATTEMPTS 8
+#define PID_BUFFER_INITIAL 1024
+#define PID_ENUM_MAX_ATTEMPTS 16
+#define UNKNOWN_PROCESS_NAME L"<unknown>"
+
+#ifndef NT_SUCCESS
+#define NT_SUCCESS(Status) (((NTSTATUS)(Status)) >= 0)
+#endif
+#ifndef CREATE_WAITABLE_TIMER_HIGH_RESOLUTION
+#define CREATE_WAITABLE_TIMER_HIGH_RESOLUTION 0x00000002
+#endif
+#ifndef STATUS_INFO_LENGTH_MISMATCH
+#define STATUS_INFO_LENGTH_MISMATCH ((NTSTATUS)0xC0000004L)
+#endif
+
+// Full SystemProcessInformation record; winternl.h only publishes a reduced layout.
+struct NtProcessEntry {
+    ULONG NextEntryOffset;
+    ULONG NumberOfThreads;
+    LARGE_INTEGER WorkingSetPrivateSize;
+    ULONG HardFaultCount;
+    ULONG NumberOfThreadsHighWatermark;
+    ULONGLONG CycleTime;
+    LARGE_INTEGER CreateTime;
+    LARGE_INTEGER UserTime;
+    LARGE_INTEGER KernelTime;
+    UNICODE_STRING ImageName;
+    LONG BasePriority;
+    HANDLE UniqueProcessId;
+    HANDLE InheritedFromUniqueProcessId;
+    ULONG HandleCount;
+    ULONG SessionId;
+    ULONG_PTR UniqueProcessKey;
+    SIZE_T PeakVirtualSize;
+    SIZE_T VirtualSize;
+    ULONG PageFaultCount;
+    SIZE_T PeakWorkingSetSize;
+    SIZE_T WorkingSetSize;
+    SIZE_T QuotaPeakPagedPoolUsage;
+    SIZE_T QuotaPagedPoolUsage;
+    SIZE_T QuotaPeakNonPagedPoolUsage;
+    SIZE_T QuotaNonPagedPoolUsage;
+    SIZE_T PagefileUsage;
+    SIZE_T PeakPagefileUsage;
+    SIZE_T PrivatePageCount;
+    LARGE_INTEGER ReadOperationCount;
+    LARGE_INTEGER WriteOperationCount;
+    LARGE_INTEGER OtherOperationCount;
+    LARGE_INTEGER ReadTransferCount;
+    LARGE_INTEGER WriteTransferCount;
+    LARGE_INTEGER OtherTransferCount;
+};
+
+struct PidEnumeratorStats {
+    ULONGLONG enumerations = 0;
+    ULONGLONG truncations = 0;   // EnumProcesses filled the whole buffer
+    ULONGLONG retries = 0;       // extra EnumProcesses calls after growing
+    ULONGLONG growths = 0;
+    ULONGLONG unresolved = 0;    // still full after PID_ENUM_MAX_ATTEMPTS
+    size_t capacity = 0;
+    size_t lastCount = 0;
+};
+
+// EnumProcesses wrapper whose PID buffer doubles whenever a call comes back full.
+// The grown buffer is kept, so once it fits the host a refresh never allocates.
+class PidEnumerator {
+private:
+    std::vector<DWORD> pids;
+    size_t count = 0;
+    PidEnumeratorStats stats;
+
+public:
+    PidEnumerator() : pids(PID_BUFFER_INITIAL) {
+        stats.capacity = pids.size();
+    }
+
+    bool Enumerate() {
+        stats.enumerations++;
+        count = 0;
+        for (int attempt = 0; attempt < PID_ENUM_MAX_ATTEMPTS; attempt++) {
+            DWORD cbNeeded = 0;
+            if (!EnumProcesses(pids.data(), (DWORD)(pids.size() * sizeof(DWORD)), &cbNeeded)) return false;
+
+            count = cbNeeded / sizeof(DWORD);
+            if (count < pids.size()) break;
+
+            // A full buffer is indistinguishable from a truncated one, so grow and ask again.
+            stats.truncations++;
+            if (attempt + 1 == PID_ENUM_MAX_ATTEMPTS) {
+                stats.unresolved++;
+                break;
+            }
+            pids.resize(pids.size() * 2);
+            stats.growths++;
+            stats.retries++;
+        }
+        stats.capacity = pids.size();
+        stats.lastCount = count;
+        return true;
+    }
+
+    const DWORD* Data() const {
+        return pids.data();
+    }
+
+    size_t Count() const {
+        return count;
+    }
+
+    const PidEnumeratorStats& Stats() const {
+        return stats;
+    }
+};
+
+// PROCESS_BASIC_INFORMATION with the parent field named; winternl.h calls it Reserved3.
+struct NtBasicProcessInformation {
+    NTSTATUS ExitStatus;
+    PVOID PebBaseAddress;
+    ULONG_PTR AffinityMask;
+    LONG BasePriority;
+    ULONG_PTR UniqueProcessId;
+    ULONG_PTR InheritedFromUniqueProcessId;
+};
+
+typedef NTSTATUS (NTAPI* NtQueryInformationProcessFn)(HANDLE, PROCESSINFOCLASS, PVOID, ULONG, PULONG);
+
+// One opened process on the per-PID path. Heap-allocated so the exit callback, which runs
+// on a thread-pool wait thread, can hold a stable pointer to its flag.
+struct CachedProcess {
+    HANDLE hProcess;
+    HANDLE hWait;
+    ULONGLONG createTime;
+    ULONGLONG generation;
+    DWORD parentPid;
+    DWORD sessionId;
+    std::wstring name;
+    const std::wstring* internedName = nullptr;   // set on the sampler thread
+    ProcessInfo last;                             // the previous query's result, for skipped ticks
+    bool hasLast = false;
+    std::atomic<bool> exited{ false };
+};
+
+// Keeps a PROCESS_QUERY_LIMITED_INFORMATION handle and the resolved image name for every
+// live process between refreshes, so a steady-state refresh only queries times and
+// memory. A registered wait on each handle flags the entry when the process exits; the
+// sampler thread evicts flagged entries at the start of the next refresh.
+class ProcessHandleCache {
+private:
+    std::unordered_map<DWORD, CachedProcess*> entries;
+    ULONGLONG generation = 0;
+
+    static VOID CALLBACK OnProcessExit(PVOID param, BOOLEAN) {
+        static_cast<CachedProcess*>(param)->exited.store(true, std::memory_order_release);
+    }
+
+    static void Destroy(CachedProcess* entry) {
+        // INVALID_HANDLE_VALUE waits for a callback already in flight before returning.
+        if (entry->hWait) UnregisterWaitEx(entry->hWait, INVALID_HANDLE_VALUE);
+        CloseHandle(entry->hProcess);
+        delete entry;
+    }
+
+    // Read once when the handle is opened; PROCESS_QUERY_LIMITED_INFORMATION is enough.
+    static DWORD ParentPid(HANDLE hProcess) {
+        static const NtQueryInformationProcessFn queryFn = reinterpret_cast<NtQueryInformationProcessFn>(
+            GetProcAddress(GetModuleHandleW(L"ntdll.dll"), "NtQueryInformationProcess"));
+        NtBasicProcessInformation info;
+        if (!queryFn || !NT_SUCCESS(queryFn(hProcess, ProcessBasicInformation, &info, sizeof(info), NULL))) return 0;
+        return (DWORD)info.InheritedFromUniqueProcessId;
+    }
+
+    static std::wstring ImageBaseName(HANDLE hProcess) {
+        WCHAR path[MAX_PATH];
+        DWORD length = MAX_PATH;
+        if (!QueryFullProcessImageNameW(hProcess, 0, path, &length)) return UNKNOWN_PROCESS_NAME;
+        std::wstring fullPath(path, length);
+        size_t slash = fullPath.find_last_of(L"\\/");
+        return slash == std::wstring::npos ? fullPath : fullPath.substr(slash + 1);
+    }
+
+public:
+    ~ProcessHandleCache() {
+        for (auto& item : entries) Destroy(item.second);
+    }
+
+    // Opens a process and resolves its name. Touches no cache state, so pool workers may
+    // call it; the result is handed back to the cache with Adopt on the sampler thread.
+    static CachedProcess* Open(DWORD pid) {
+        HANDLE hProcess = OpenProcess(PROCESS_QUERY_LIMITED_INFORMATION | SYNCHRONIZE, FALSE, pid);
+        if (hProcess == NULL) return nullptr;
+
+        FILETIME ftCreate, ftExit, ftKernel, ftUser;
+        if (!GetProcessTimes(hProcess, &ftCreate, &ftExit, &ftKernel, &ftUser)) {
+            CloseHandle(hProcess);
+            return nullptr;
+        }
+
+        CachedProcess* entry = new CachedProcess();
+        entry->hProcess = hProcess;
+        entry->hWait = NULL;
+        entry->createTime = ((ULONGLONG)ftCreate.dwHighDateTime << 32) | ftCreate.dwLowDateTime;
+        entry->name = ImageBaseName(hProcess);
+        entry->parentPid = ParentPid(hProcess);
+        if (!ProcessIdToSessionId(pid, &entry->sessionId)) entry->sessionId = 0;
+        // Without a registered wait the entry is still evicted once its PID disappears.
+        if (!RegisterWaitForSingleObject(&entry->hWait, hProcess, OnProcessExit, entry, INFINITE, WT_EXECUTEONLYONCE)) {
+            entry->hWait = NULL;
+        }
+        return entry;
+    }
+
+    // Evicts processes whose exit was signalled since the previous refresh.
+    void BeginRefresh() {
+        generation++;
+        for (auto it = entries.begin(); it != entries.end();) {
+            if (!it->second->exited.load(std::memory_order_acquire)) {
+                ++it;
+                continue;
+            }
+            Destroy(it->second);
+            it = entries.erase(it);
+        }
+    }
+
+    // Returns the cached entry for a PID in the current enumeration, or NULL if the PID
+    // has not been opened yet.
+    CachedProcess* Find(DWORD pid) {
+        auto it = entries.find(pid);
+        if (it == entries.end()) return nullptr;
+        it->second->generation = generation;
+        return it->second;
+    }
+
+    // Takes ownership of an entry from Open, replacing any entry cached for the PID.
+    void Adopt(DWORD pid, CachedProcess* entry) {
+        Evict(pid);
+        entry->generation = generation;
+        entries.emplace(pid, entry);
+    }
+
+    // Drops the cached entry for a PID, e.g. after its handle turned out to be stale.
+    void Evict(DWORD pid) {
+        auto it = entries.find(pid);
+        if (it == entries.end()) return;
+        Destroy(it->second);
+        entries.erase(it);
+    }
+
+    // Evicts PIDs that were not part of this refresh's enumeration.
+    void EndRefresh() {
+        for (auto it = entries.begin(); it != entries.end();) {
+            if (it->second->generation == generation) {
+                ++it;
+                continue;
+            }
+            Destroy(it->second);
+            it = entries.erase(it);
+        }
+    }
+
+    size_t Size() const {
+        return entries.size();
+    }
+};
+
+// The EnumProcesses fallback. The sampler thread resolves cached handles, then the
+// per-process opens and queries fan out over a WorkStealingPool; each worker writes only
+// the result slots of the items it took, so results merge in PID-array order with no
+// locks. The cache is updated serially afterwards.
+class PerPidQuery {
+private:
+    struct WorkItem {
+        DWORD pid;
+        bool valid;
+        bool stale;                 // the cached handle belonged to an exited process
+        bool skipped;               // not queried this refresh; 'info' is the cached result
+        CachedProcess* cached;
+        CachedProcess* opened;      // new entry for the cache, from this refresh
+        ProcessInfo info;
+    };
+
+    PidEnumerator pidEnumerator;
+    ProcessHandleCache handleCache;
+    std::vector<WorkItem> work;
+    WorkStealingPool* pool = nullptr;
+    bool parallel = true;
+    bool extended = false;
+
+    static bool ReadTimes(HANDLE hProcess, FILETIME& ftCreate, FILETIME& ftExit, ULONGLONG& cpuTime) {
+        FILETIME ftKernelTime, ftUserTime;
+        if (!GetProcessTimes(hProcess, &ftCreate, &ftExit, &ftKernelTime, &ftUserTime)) return false;
+        ULONGLONG kernel = ((ULONGLONG)ftKernelTime.dwHighDateTime << 32) | ftKernelTime.dwLowDateTime;
+        ULONGLONG user = ((ULONGLONG)ftUserTime.dwHighDateTime << 32) | ftUserTime.dwLowDateTime;
+        cpuTime = kernel + user;
+        return true;
+    }
+
+    // Three extra calls per process; the NT snapshot gets the same numbers for free.
+    static void ReadExtended(HANDLE hProcess, ExtendedCounters& counters) {
+        PROCESS_MEMORY_COUNTERS_EX pmc;
+        if (GetProcessMemoryInfo(hProcess, reinterpret_cast<PROCESS_MEMORY_COUNTERS*>(&pmc), sizeof(pmc))) {
+            counters.privateBytes = pmc.PrivateUsage;
+            counters.pageFaults = pmc.PageFaultCount;
+        }
+        IO_COUNTERS io;
+        if (GetProcessIoCounters(hProcess, &io)) {
+            counters.readBytes = io.ReadTransferCount;
+            counters.writeBytes = io.WriteTransferCount;
+        }
+        DWORD handles = 0;
+        if (GetProcessHandleCount(hProcess, &handles)) counters.handleCount = handles;
+    }
+
+    static void QueryItem(void* context, size_t, size_t index) {
+        PerPidQuery* self = static_cast<PerPidQuery*>(context);
+        WorkItem& item = self->work[index];
+        if (item.skipped) return;
+        CachedProcess* entry = item.cached;
+        if (!entry) entry = item.opened = ProcessHandleCache::Open(item.pid);
+        if (!entry) return;
+
+        FILETIME ftCreate, ftExit;
+        ULONGLONG cpuTime;
+        if (!ReadTimes(entry->hProcess, ftCreate, ftExit, cpuTime)) return;
+        // The handle outlives its process, so a reused PID shows up as an exited handle.
+        if ((ftExit.dwLowDateTime || ftExit.dwHighDateTime) && !item.opened) {
+            item.stale = true;
+            entry = item.opened = ProcessHandleCache::Open(item.pid);
+            if (!entry || !ReadTimes(entry->hProcess, ftCreate, ftExit, cpuTime)) return;
+        }
+
+        PROCESS_MEMORY_COUNTERS pmc;
+        SIZE_T memoryUsage = 0;
+        if (GetProcessMemoryInfo(entry->hProcess, &pmc, sizeof(pmc))) {
+            memoryUsage = pmc.WorkingSetSize;
+        }
+
+        ProcessInfo& info = item.info;
+        info.pid = item.pid;
+        info.name = nullptr;        // interned when results are merged
+        info.cpuUsage = 0.0;
+        info.memoryUsage = memoryUsage;
+        info.lastCpuTime = cpuTime;
+        info.createTime = entry->createTime;
+        info.parentPid = entry->parentPid;
+        info.sessionId = entry->sessionId;
+        info.historySlot = HISTORY_NO_SLOT;
+        info.extended = ExtendedCounters();
+        if (self->extended) ReadExtended(entry->hProcess, info.extended);
+        item.valid = true;
+    }
+
+public:
+    ~PerPidQuery() {
+        delete pool;
+    }
+
+    // Serial mode runs every item on the calling thread; used as the baseline.
+    void SetParallel(bool enabled) {
+        parallel = enabled;
+    }
+
+    void SetExtended(bool enabled) {
+        extended = enabled;
+    }
+
+    // Names are interned into 'names' on the calling thread.
+    bool Query(std::vector<ProcessInfo>& out, NamePool& names) {
+        return Query(out, names, [](DWORD, ULONGLONG) { return false; });
+    }
+
+    // skip(pid, createTime) is called on the calling thread for every cached process; when
+    // it returns true the process is not queried and its previous result is returned
+    // instead. Only entries with a registered exit wait qualify, since without one a
+    // reused PID would go unnoticed.
+    template <typename SkipFn>
+    bool Query(std::vector<ProcessInfo>& out, NamePool& names, SkipFn skip) {
+        if (!pidEnumerator.Enumerate()) return false;
+
+        const DWORD* processesIds = pidEnumerator.Data();
+        size_t processCount = pidEnumerator.Count();
+        handleCache.BeginRefresh();
+        if (work.size() < processCount) work.resize(processCount);
+        size_t itemCount = 0;
+        for (size_t i = 0; i < processCount; i++) {
+            if (processesIds[i] == 0) continue;
+            WorkItem& item = work[itemCount++];
+            item.pid = processesIds[i];
+            item.valid = false;
+            item.stale = false;
+            item.cached = handleCache.Find(item.pid);
+            item.opened = nullptr;
+            item.skipped = item.cached && item.cached->hasLast && item.cached->hWait
+                && skip(item.pid, item.cached->createTime);
+            if (item.skipped) {
+                item.info = item.cached->last;
+                item.valid = true;
+            }
+        }
+
+        if (parallel) {
+            // Created on first use: hosts where the NT snapshot works never need threads.
+            if (!pool) pool = new WorkStealingPool(GetActiveProcessorCount(ALL_PROCESSOR_GROUPS));
+            pool->Run(itemCount, QueryItem, this);
+        } else {
+            for (size_t i = 0; i < itemCount; i++) QueryItem(this, 0, i);
+        }
+
+        for (size_t i = 0; i < itemCount; i++) {
+            WorkItem& item = work[i];
+            if (item.stale) handleCache.Evict(item.pid);
+            if (item.opened) handleCache.Adopt(item.pid, item.opened);
+            if (!item.valid) continue;
+            CachedProcess* entry = item.opened ? item.opened : item.cached;
+            if (!entry->internedName) entry->internedName = names.Intern(entry->name);
+            item.info.name = entry->internedName;
+            if (!item.skipped) {
+                entry->last = item.info;
+                entry->hasLast = true;
+            }
+            out.push_back(item.info);
+        }
+        handleCache.EndRefresh();
+        return true;
+    }
+
+    size_t WorkerCount() const {
+        return parallel && pool ? pool->WorkerCount() : 1;
+    }
+
+    const PidEnumeratorStats& Stats() const {
+        return pidEnumerator.Stats();
+    }
+};
+
+typedef NTSTATUS (NTAPI* NtQuerySystemInformationFn)(SYSTEM_INFORMATION_CLASS, PVOID, ULONG, PULONG);
+
+// Reads every process in one NtQuerySystemInformation call instead of opening each PID.
+// The buffer is kept between refreshes and only grows when the system outgrows it.
+class NtProcessSnapshot {
+private:
+    NtQuerySystemInformationFn queryFn = nullptr;
+    std::vector<BYTE> buffer;
+
+public:
+    NtProcessSnapshot() {
+        HMODULE ntdll = GetModuleHandleW(L"ntdll.dll");
+        if (ntdll) {
+            queryFn = reinterpret_cast<NtQuerySystemInformationFn>(GetProcAddress(ntdll, "NtQuerySystemInformation"));
+        }
+    }
+
+    bool IsAvailable() const {
+        return queryFn != nullptr;
+    }
+
+    // Names are interned into 'names'; after warm-up a capture allocates nothing. The
+    // extended counters are copied from the same record, so they cost a few stores.
+    bool Capture(std::vector<ProcessInfo>& out, NamePool& names, bool extended = false) {
+        if (!queryFn) return false;
+        if (buffer.empty()) buffer.resize(SNAPSHOT_INITIAL_BUFFER);
+
+        NTSTATUS status = STATUS_INFO_LENGTH_MISMATCH;
+        for (int attempt = 0; attempt < SNAPSHOT_MAX_ATTEMPTS; attempt++) {
+            ULONG returnLength = 0;
+            status = queryFn(SystemProcessInformation, buffer.data(), (ULONG)buffer.size(), &returnLength);
+            if (status != STATUS_INFO_LENGTH_MISMATCH) break;
+            // Leave headroom for processes started between the size probe and the retry.
+            SIZE_T needed = (SIZE_T)returnLength + returnLength / 4;
+            buffer.resize(needed > buffer.size() * 2 ? needed : buffer.size() * 2);
+        }
+        if (!NT_SUCCESS(status)) return false;
+
+        const BYTE* cursor = buffer.data();
+        for (;;) {
+            const NtProcessEntry* entry = reinterpret_cast<const NtProcessEntry*>(cursor);
+            DWORD pid = (DWORD)(ULONG_PTR)entry->UniqueProcessId;
+            if (pid != 0) {
+                ProcessInfo info;
+                info.pid = pid;
+                if (entry->ImageName.Buffer && entry->ImageName.Length) {
+                    info.name = names.Intern(entry->ImageName.Buffer, entry->ImageName.Length / sizeof(WCHAR));
+                } else {
+                    info.name = names.Intern(UNKNOWN_PROCESS_NAME, ARRAYSIZE(UNKNOWN_PROCESS_NAME) - 1);
+                }
+                info.cpuUsage = 0.0;
+                info.memoryUsage = entry->WorkingSetSize;
+                info.lastCpuTime = (ULONGLONG)entry->KernelTime.QuadPart + (ULONGLONG)entry->UserTime.QuadPart;
+                info.createTime = (ULONGLONG)entry->CreateTime.QuadPart;
+                info.parentPid = (DWORD)(ULONG_PTR)entry->InheritedFromUniqueProcessId;
+                info.sessionId = entry->SessionId;
+                info.historySlot = HISTORY_NO_SLOT;
+                info.extended = ExtendedCounters();
+                if (extended) {
+                    info.extended.privateBytes = entry->PrivatePageCount;
+                    info.extended.readBytes = (ULONGLONG)entry->ReadTransferCount.QuadPart;
+                    info.extended.writeBytes = (ULONGLONG)entry->WriteTransferCount.QuadPart;
+                    info.extended.pageFaults = entry->PageFaultCount;
+                    info.extended.handleCount = entry->HandleCount;
+                    info.extended.threadCount = entry->NumberOfThreads;
+                }
+                out.push_back(info);
+            }
+            if (entry->NextEntryOffset == 0) break;
+            cursor += entry->NextEntryOffset;
+        }
+        return true;
+    }
+};
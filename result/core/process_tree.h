@@ -0,0 +1,542 @@
+// Parent-PID tree and name/session groups over the sampler's snapshots, with subtree and
+// group CPU and memory totals maintained from each snapshot's diff: an added, changed or
+// exited process costs O(depth) for the tree and O(1) per grouping. The display order is
+// kept across refreshes, too: only the sibling lists and groups whose totals changed are
+// re-sorted, and the rows are rebuilt only when that moves one, so a refresh in which
+// nothing moves costs O(changed) and redraws only the changed rows.
+#pragma once
+
+#include <windows.h>
+#include <vector>
+#include <unordered_map>
+#include <algorithm>
+
+#include "process_types.h"
+#include "process_view.h"
+
+#define TREE_NO_NODE (-1)
+#define TREE_REBUILD_INTERVAL 3600   // incremental updates between full rebuilds, to shed rounding drift
+
+enum GroupMode {
+    GROUP_NONE,      // the flat process list
+    GROUP_TREE,
+    GROUP_NAME,
+    GROUP_SESSION
+};
+
+// Parses the names used by the collector's --group flag. Returns false if unknown.
+inline bool ParseGroupMode(const wchar_t* name, GroupMode& mode) {
+    static const struct { const wchar_t* name; GroupMode mode; } modes[] = {
+        { L"tree", GROUP_TREE }, { L"name", GROUP_NAME }, { L"session", GROUP_SESSION },
+    };
+    for (const auto& entry : modes) {
+        if (lstrcmpiW(name, entry.name) == 0) {
+            mode = entry.mode;
+            return true;
+        }
+    }
+    return false;
+}
+
+struct TreeNode {
+    ProcessKey key;
+    DWORD parentPid;
+    DWORD sessionId;
+    const std::wstring* name;
+    double cpu;                 // the process itself, as last applied
+    ULONGLONG memory;
+    double subtreeCpu;          // itself plus every descendant
+    ULONGLONG subtreeMemory;
+    UINT subtreeCount;
+    int parent;
+    int firstChild;
+    int nextSibling;
+    int prevSibling;            // siblings are linked in display order
+    int row;                    // in Rows(), or -1 when not shown
+    bool collapsed;
+    bool used;
+    bool dirty;                 // its children's totals or set changed since they were sorted
+    bool touched;               // its totals changed since the rows were last refreshed
+};
+
+struct GroupTotals {
+    const std::wstring* name;   // GROUP_NAME
+    DWORD sessionId;            // GROUP_SESSION
+    UINT count;                 // 0 until the next refresh removes the group
+    double cpu;
+    ULONGLONG memory;
+    int row;                    // in Rows(), or -1 when not shown
+    bool dirty;                 // changed since the last refresh of its grouping
+};
+
+// One list row of a tree or group view.
+struct GroupRow {
+    int node;                   // GROUP_TREE: index for ProcessTree::Node
+    const GroupTotals* group;   // GROUP_NAME and GROUP_SESSION
+    int depth;
+};
+
+// The order one structure was last sorted or laid out for.
+struct TreeOrder {
+    SortKey key;
+    bool descending;
+    size_t topN;
+    bool valid = false;
+
+    bool Matches(const ViewOptions& options, bool withTopN) const {
+        return valid && key == options.key && descending == options.descending && (!withTopN || topN == options.topN);
+    }
+
+    void Set(const ViewOptions& options) {
+        key = options.key;
+        descending = options.descending;
+        topN = options.topN;
+        valid = true;
+    }
+};
+
+// Totals per name or session, keyed by that GroupTotals field, and their display order.
+// An element stays where it is until the refresh that drops it once empty, so 'order',
+// 'dirty' and the rows can point into the map.
+template <typename Key, Key GroupTotals::*Field>
+struct GroupSet {
+    std::unordered_map<Key, GroupTotals> totals;
+    std::vector<GroupTotals*> order;
+    std::vector<GroupTotals*> dirty;
+    TreeOrder sorted;
+
+    void Add(const Key& key, const TreeNode& node, double cpu, ULONGLONG memory, int count) {
+        auto inserted = totals.emplace(key, GroupTotals());
+        GroupTotals& group = inserted.first->second;
+        if (inserted.second) {
+            group.name = node.name;
+            group.sessionId = node.sessionId;
+            group.row = -1;
+        }
+        group.cpu += cpu;
+        group.memory += memory;
+        group.count += count;
+        if (!group.dirty) {
+            group.dirty = true;
+            dirty.push_back(&group);
+        }
+    }
+
+    // After a refresh: forgets what changed and erases the groups left empty.
+    void Settle() {
+        for (GroupTotals* group : dirty) group->dirty = false;
+        for (GroupTotals* group : dirty) {
+            if (!group->count) totals.erase(group->*Field);
+        }
+        dirty.clear();
+    }
+
+    void Clear() {
+        totals.clear();
+        order.clear();
+        dirty.clear();
+        sorted.valid = false;
+    }
+};
+
+class ProcessTree {
+private:
+    std::vector<TreeNode> nodes;
+    std::vector<int> freeNodes;
+    std::unordered_map<ProcessKey, int, ProcessKeyHash> index;
+    std::unordered_map<DWORD, int> pidIndex;    // live PID to node, for parent lookups
+    GroupSet<const std::wstring*, &GroupTotals::name> byName;
+    GroupSet<DWORD, &GroupTotals::sessionId> bySession;
+    std::vector<int> added;
+    std::vector<int> roots;         // in display order
+    std::vector<int> dirtyNodes;    // nodes with dirty set, each once
+    std::vector<int> touchedNodes;  // nodes with touched set, each once
+    std::vector<int> siblings;      // scratch for sorting one list
+    std::vector<GroupTotals*> merged;
+    std::vector<GroupRow> rows;
+    TreeOrder treeSorted;
+    TreeOrder rowsLaidOut;
+    GroupMode rowsMode = GROUP_NONE;
+    bool rootsDirty = false;
+    bool treeChanged = true;        // tree rows must be rebuilt: a process came, went or was toggled
+    ULONGLONG sequence = 0;
+    UINT updates = 0;
+    bool built = false;
+
+    void MarkDirty(int n) {
+        if (nodes[n].dirty) return;
+        nodes[n].dirty = true;
+        dirtyNodes.push_back(n);
+    }
+
+    // The order of n's siblings depends on n's totals.
+    void MarkMoved(int n) {
+        TreeNode& node = nodes[n];
+        if (!node.touched) {
+            node.touched = true;
+            touchedNodes.push_back(n);
+        }
+        if (node.parent == TREE_NO_NODE) rootsDirty = true;
+        else MarkDirty(node.parent);
+    }
+
+    // Adds to a node and every ancestor; negative deltas are applied with wrap-around.
+    void AddUp(int node, double cpu, ULONGLONG memory, int count) {
+        for (int n = node; n != TREE_NO_NODE; n = nodes[n].parent) {
+            nodes[n].subtreeCpu += cpu;
+            nodes[n].subtreeMemory += memory;
+            nodes[n].subtreeCount += count;
+            MarkMoved(n);
+        }
+    }
+
+    void AddToGroups(const TreeNode& node, double cpu, ULONGLONG memory, int count) {
+        byName.Add(node.name, node, cpu, memory, count);
+        bySession.Add(node.sessionId, node, cpu, memory, count);
+    }
+
+    int Create(const ProcessInfo& proc) {
+        int n;
+        if (!freeNodes.empty()) {
+            n = freeNodes.back();
+            freeNodes.pop_back();
+        } else {
+            n = (int)nodes.size();
+            nodes.emplace_back();
+            nodes[n].dirty = nodes[n].touched = false; // a reused node keeps its flags, and its place in the lists
+        }
+        TreeNode& node = nodes[n];
+        node.key = { proc.pid, proc.createTime };
+        node.parentPid = proc.parentPid;
+        node.sessionId = proc.sessionId;
+        node.name = proc.name;
+        node.cpu = node.subtreeCpu = proc.cpuUsage;
+        node.memory = node.subtreeMemory = proc.memoryUsage;
+        node.subtreeCount = 1;
+        node.parent = node.firstChild = node.nextSibling = node.prevSibling = TREE_NO_NODE;
+        node.row = -1;
+        node.collapsed = false;
+        node.used = true;
+        index[node.key] = n;
+        pidIndex[proc.pid] = n;
+        AddToGroups(node, node.cpu, node.memory, 1);
+        return n;
+    }
+
+    // A PID is reused once its process exits, so the parent must also predate the child.
+    int FindParent(const TreeNode& node) const {
+        if (!node.parentPid || node.parentPid == node.key.pid) return TREE_NO_NODE;
+        auto it = pidIndex.find(node.parentPid);
+        if (it == pidIndex.end()) return TREE_NO_NODE;
+        const TreeNode& parent = nodes[it->second];
+        return parent.key.createTime <= node.key.createTime ? it->second : TREE_NO_NODE;
+    }
+
+    // A new child goes first; the next refresh sorts it into place.
+    void Link(int n) {
+        int p = FindParent(nodes[n]);
+        if (p == TREE_NO_NODE) {
+            roots.push_back(n);
+            rootsDirty = true;
+            return;
+        }
+        TreeNode& node = nodes[n];
+        node.parent = p;
+        node.nextSibling = nodes[p].firstChild;
+        if (node.nextSibling != TREE_NO_NODE) nodes[node.nextSibling].prevSibling = n;
+        nodes[p].firstChild = n;
+        MarkDirty(p);
+        AddUp(p, node.subtreeCpu, node.subtreeMemory, (int)node.subtreeCount);
+    }
+
+    // Children of an exited process become roots, keeping their own subtrees.
+    void Remove(int n) {
+        TreeNode& node = nodes[n];
+        if (node.parent != TREE_NO_NODE) {
+            AddUp(node.parent, -node.subtreeCpu, (ULONGLONG)0 - node.subtreeMemory, -(int)node.subtreeCount);
+            if (node.prevSibling != TREE_NO_NODE) nodes[node.prevSibling].nextSibling = node.nextSibling;
+            else nodes[node.parent].firstChild = node.nextSibling;
+            if (node.nextSibling != TREE_NO_NODE) nodes[node.nextSibling].prevSibling = node.prevSibling;
+        } else {
+            roots.erase(std::find(roots.begin(), roots.end(), n));
+        }
+        for (int c = node.firstChild; c != TREE_NO_NODE;) {
+            int next = nodes[c].nextSibling;
+            nodes[c].parent = nodes[c].nextSibling = nodes[c].prevSibling = TREE_NO_NODE;
+            roots.push_back(c);
+            rootsDirty = true;
+            c = next;
+        }
+        AddToGroups(node, -node.cpu, (ULONGLONG)0 - node.memory, -1);
+        index.erase(node.key);
+        auto it = pidIndex.find(node.key.pid);
+        if (it != pidIndex.end() && it->second == n) pidIndex.erase(it);
+        node.used = false;
+        freeNodes.push_back(n);
+    }
+
+    void Update(int n, const ProcessInfo& proc) {
+        TreeNode& node = nodes[n];
+        double cpu = proc.cpuUsage - node.cpu;
+        ULONGLONG memory = (ULONGLONG)proc.memoryUsage - node.memory;
+        node.cpu = proc.cpuUsage;
+        node.memory = proc.memoryUsage;
+        AddUp(n, cpu, memory, 0);
+        AddToGroups(node, cpu, memory, 0);
+    }
+
+    template <typename T>
+    static int Order(T a, T b) {
+        return a < b ? -1 : a > b;
+    }
+
+    // Sibling and group order for a view: by the sort key, numbers largest first by default.
+    static bool Before(const ViewOptions& options, const std::wstring* nameA, DWORD idA, double cpuA, ULONGLONG memA,
+                       const std::wstring* nameB, DWORD idB, double cpuB, ULONGLONG memB) {
+        int result;
+        switch (options.key) {
+        case SORT_NAME: result = lstrcmpiW(nameA ? nameA->c_str() : L"", nameB ? nameB->c_str() : L""); break;
+        case SORT_PID: result = Order(idA, idB); break;
+        case SORT_MEMORY: result = Order(memA, memB); break;
+        default: result = Order(cpuA, cpuB); break;
+        }
+        if (result == 0) return idA < idB;
+        bool descending = options.key == SORT_NONE ? true : options.descending;
+        return descending ? result > 0 : result < 0;
+    }
+
+    bool NodeBefore(const ViewOptions& options, int a, int b) const {
+        const TreeNode& x = nodes[a];
+        const TreeNode& y = nodes[b];
+        return Before(options, x.name, x.key.pid, x.subtreeCpu, x.subtreeMemory, y.name, y.key.pid, y.subtreeCpu, y.subtreeMemory);
+    }
+
+    // Name groups tie on the name, which unlike their member count is unique and stable.
+    static bool GroupBefore(GroupMode mode, const ViewOptions& options, const GroupTotals* x, const GroupTotals* y) {
+        if (mode == GROUP_SESSION) {
+            return Before(options, x->name, x->sessionId, x->cpu, x->memory, y->name, y->sessionId, y->cpu, y->memory);
+        }
+        if (Before(options, x->name, x->count, x->cpu, x->memory, y->name, y->count, y->cpu, y->memory)) return true;
+        if (Before(options, y->name, y->count, y->cpu, y->memory, x->name, x->count, x->cpu, x->memory)) return false;
+        int names = lstrcmpiW(x->name->c_str(), y->name->c_str());
+        return names != 0 ? names < 0 : x->name < y->name;
+    }
+
+    // Re-sorts the children of p in place; true if their order changed.
+    bool SortChildren(int p, const ViewOptions& options) {
+        siblings.clear();
+        for (int c = nodes[p].firstChild; c != TREE_NO_NODE; c = nodes[c].nextSibling) siblings.push_back(c);
+        if (std::is_sorted(siblings.begin(), siblings.end(), [&](int a, int b) { return NodeBefore(options, a, b); })) return false;
+        std::sort(siblings.begin(), siblings.end(), [&](int a, int b) { return NodeBefore(options, a, b); });
+        int previous = TREE_NO_NODE;
+        for (int c : siblings) {
+            nodes[c].prevSibling = previous;
+            if (previous == TREE_NO_NODE) nodes[p].firstChild = c;
+            else nodes[previous].nextSibling = c;
+            previous = c;
+        }
+        nodes[previous].nextSibling = TREE_NO_NODE;
+        return true;
+    }
+
+    bool SortRoots(const ViewOptions& options) {
+        auto before = [&](int a, int b) { return NodeBefore(options, a, b); };
+        if (std::is_sorted(roots.begin(), roots.end(), before)) return false;
+        std::sort(roots.begin(), roots.end(), before);
+        return true;
+    }
+
+    // Brings the sibling order up to date; true if any row moves. A new sort order sorts
+    // every list, otherwise only the lists marked dirty.
+    bool SortTree(const ViewOptions& options) {
+        bool moved = false;
+        if (!treeSorted.Matches(options, false)) {
+            for (size_t n = 0; n < nodes.size(); n++) {
+                if (nodes[n].used && nodes[n].firstChild != TREE_NO_NODE) SortChildren((int)n, options);
+            }
+            SortRoots(options);
+            treeSorted.Set(options);
+            moved = true;
+        } else {
+            for (int n : dirtyNodes) {
+                if (nodes[n].used && nodes[n].dirty) moved |= SortChildren(n, options);
+            }
+            if (rootsDirty) moved |= SortRoots(options);
+        }
+        for (int n : dirtyNodes) nodes[n].dirty = false;
+        dirtyNodes.clear();
+        rootsDirty = false;
+        return moved;
+    }
+
+    // Takes the changed groups out, sorts them and merges them back in, leaving out the
+    // empty ones; true if any shown row moves. A new sort order sorts every group.
+    template <typename Set>
+    bool SortGroups(Set& set, GroupMode mode, const ViewOptions& options) {
+        auto before = [&](const GroupTotals* x, const GroupTotals* y) { return GroupBefore(mode, options, x, y); };
+        if (!set.sorted.Matches(options, false)) {
+            set.order.clear();
+            for (auto& entry : set.totals) {
+                if (entry.second.count) set.order.push_back(&entry.second);
+            }
+            std::sort(set.order.begin(), set.order.end(), before);
+            set.sorted.Set(options);
+            return true;
+        }
+        if (set.dirty.empty()) return false;
+        merged.clear();
+        for (GroupTotals* group : set.dirty) {
+            if (group->count) merged.push_back(group);
+        }
+        std::sort(merged.begin(), merged.end(), before);
+        size_t previous = set.order.size();
+        size_t kept = 0;
+        for (GroupTotals* group : set.order) {
+            if (!group->dirty) set.order[kept++] = group;
+        }
+        set.order.resize(kept);
+        set.order.insert(set.order.end(), merged.begin(), merged.end());
+        std::inplace_merge(set.order.begin(), set.order.begin() + kept, set.order.end(), before);
+        if (set.order.size() != previous) return true;
+        size_t shown = options.topN && options.topN < set.order.size() ? options.topN : set.order.size();
+        for (size_t i = 0; i < shown; i++) {
+            if (set.order[i]->row != (int)i) return true;
+        }
+        return false;
+    }
+
+    void AppendSubtree(int n, int depth) {
+        nodes[n].row = (int)rows.size();
+        rows.push_back({ n, NULL, depth });
+        if (nodes[n].collapsed) return;
+        for (int c = nodes[n].firstChild; c != TREE_NO_NODE; c = nodes[c].nextSibling) AppendSubtree(c, depth + 1);
+    }
+
+    void ClearRows() {
+        for (const auto& row : rows) {
+            if (row.group) const_cast<GroupTotals*>(row.group)->row = -1;
+            else nodes[row.node].row = -1;
+        }
+        rows.clear();
+    }
+
+public:
+    // Brings the tree up to date with 'snap'. Consecutive snapshots are applied as deltas;
+    // after a gap (a skipped snapshot) the tree is rebuilt, keeping collapsed state by key.
+    void Apply(const Snapshot& snap) {
+        if (built && snap.sequence == sequence) return;
+        if (!built || snap.sequence != sequence + 1 || ++updates >= TREE_REBUILD_INTERVAL) {
+            Rebuild(snap);
+            return;
+        }
+        sequence = snap.sequence;
+        for (const auto& key : snap.exited) {
+            auto it = index.find(key);
+            if (it != index.end()) Remove(it->second);
+        }
+        if (!snap.exited.empty() || !snap.addedRows.empty()) treeChanged = true;
+        added.clear();
+        for (UINT row : snap.addedRows) added.push_back(Create(snap.processes[row]));
+        for (int n : added) Link(n);
+        for (UINT row : snap.changedRows) {
+            const ProcessInfo& proc = snap.processes[row];
+            auto it = index.find({ proc.pid, proc.createTime });
+            if (it != index.end()) Update(it->second, proc);
+        }
+    }
+
+    void Rebuild(const Snapshot& snap) {
+        std::vector<ProcessKey> collapsed;
+        for (const auto& node : nodes) {
+            if (node.used && node.collapsed) collapsed.push_back(node.key);
+        }
+        ClearRows();
+        nodes.clear();
+        freeNodes.clear();
+        index.clear();
+        pidIndex.clear();
+        byName.Clear();
+        bySession.Clear();
+        added.clear();
+        roots.clear();
+        dirtyNodes.clear();
+        touchedNodes.clear();
+        for (const auto& proc : snap.processes) added.push_back(Create(proc));
+        for (int n : added) Link(n);
+        for (const auto& key : collapsed) {
+            auto it = index.find(key);
+            if (it != index.end()) nodes[it->second].collapsed = true;
+        }
+        treeSorted.valid = false;
+        treeChanged = true;
+        sequence = snap.sequence;
+        updates = 0;
+        built = true;
+    }
+
+    const TreeNode& Node(int n) const {
+        return nodes[n];
+    }
+
+    bool HasChildren(int n) const {
+        return nodes[n].firstChild != TREE_NO_NODE;
+    }
+
+    // Collapses or expands a node; returns false if it has no children.
+    bool Toggle(int n) {
+        if (n < 0 || n >= (int)nodes.size() || !nodes[n].used || !HasChildren(n)) return false;
+        nodes[n].collapsed = !nodes[n].collapsed;
+        treeChanged = true;
+        return true;
+    }
+
+    // Brings Rows() up to date for 'mode'; a collapsed subtree costs one row, and topN
+    // limits the tree's roots or the number of groups. Returns true if the rows were
+    // rebuilt; otherwise they stand, and 'changed' lists the ones whose totals changed.
+    bool Refresh(GroupMode mode, const ViewOptions& options, std::vector<UINT>& changed) {
+        changed.clear();
+        bool moved = mode != rowsMode || !rowsLaidOut.Matches(options, true);
+        if (mode == GROUP_TREE) {
+            moved |= treeChanged;
+            moved |= SortTree(options);
+            if (moved) {
+                ClearRows();
+                size_t shown = options.topN && options.topN < roots.size() ? options.topN : roots.size();
+                for (size_t i = 0; i < shown; i++) AppendSubtree(roots[i], 0);
+            } else {
+                for (int n : touchedNodes) {
+                    if (nodes[n].used && nodes[n].row >= 0) changed.push_back((UINT)nodes[n].row);
+                }
+            }
+        } else if (mode == GROUP_NAME || mode == GROUP_SESSION) {
+            auto refreshGroups = [&](auto& set) {
+                moved |= SortGroups(set, mode, options);
+                if (moved) {
+                    ClearRows();
+                    size_t shown = options.topN && options.topN < set.order.size() ? options.topN : set.order.size();
+                    for (size_t i = 0; i < shown; i++) {
+                        set.order[i]->row = (int)i;
+                        rows.push_back({ TREE_NO_NODE, set.order[i], 0 });
+                    }
+                } else {
+                    for (GroupTotals* group : set.dirty) {
+                        if (group->row >= 0) changed.push_back((UINT)group->row);
+                    }
+                }
+                set.Settle();
+            };
+            if (mode == GROUP_NAME) refreshGroups(byName);
+            else refreshGroups(bySession);
+        }
+        for (int n : touchedNodes) nodes[n].touched = false;
+        touchedNodes.clear();
+        if (mode == GROUP_TREE) treeChanged = false;
+        rowsMode = mode;
+        rowsLaidOut.Set(options);
+        return moved;
+    }
+
+    const std::vector<GroupRow>& Rows() const {
+        return rows;
+    }
+};
@@ -0,0 +1,104 @@
+// Plain data shared by the sampling core and its front ends: one process, its identity,
+// alerts, and the Snapshot the sampler publishes.
+#pragma once
+
+#include <windows.h>
+#include <string>
+#include <vector>
+
+#include "metric_columns.h"
+
+#define MAX_HISTORY 60 // Store 60 seconds of history
+
+struct ProcessInfo {
+    DWORD pid;
+    const std::wstring* name;   // interned in the sampler's NamePool; never NULL
+    double cpuUsage;
+    SIZE_T memoryUsage;
+    ULONGLONG lastCpuTime;
+    ULONGLONG createTime;
+    DWORD parentPid;            // 0 when unknown; may name an exited process whose PID was reused
+    DWORD sessionId;
+    size_t historySlot;
+    ExtendedCounters extended;  // as read; zero unless extended counters are enabled
+    SampledStorage::Values metrics; // SampledMetrics, read through their traits
+};
+
+// A PID alone is reused by Windows; together with the creation time it names one process.
+struct ProcessKey {
+    DWORD pid;
+    ULONGLONG createTime;
+
+    bool operator==(const ProcessKey& other) const {
+        return pid == other.pid && createTime == other.createTime;
+    }
+};
+
+struct ProcessKeyHash {
+    size_t operator()(const ProcessKey& key) const {
+        ULONGLONG h = key.createTime * 0x9E3779B97F4A7C15ULL;
+        return (size_t)(h ^ (h >> 32) ^ key.pid);
+    }
+};
+
+// A process that started and exited between two samples, known only from its events.
+struct TransientProcess {
+    DWORD pid;
+    DWORD parentPid;
+    const std::wstring* name;   // interned like ProcessInfo::name
+    ULONGLONG startTime;        // FILETIME
+    ULONGLONG exitTime;
+    LONG exitStatus;
+};
+
+#define HISTORY_NO_SLOT ((size_t)-1)
+
+enum AlertRule {
+    ALERT_PROCESS_CPU,
+    ALERT_SYSTEM_MEMORY
+};
+
+struct Alert {
+    AlertRule rule;
+    DWORD pid;
+    std::wstring name;
+    double value;
+    double threshold;
+    std::wstring message;
+};
+
+// One published refresh. The sampler never touches a Snapshot after handing it over;
+// the UI hands finished ones back through Sampler::Recycle so their storage is reused.
+struct Snapshot {
+    std::vector<ProcessInfo> processes;
+    double totalCpuUsage = 0.0;            // percent of all logical processors, from the kernel's counters
+    double kernelCpuUsage = 0.0;           // privileged-mode share of totalCpuUsage
+    std::vector<double> coreUsage;         // percent per logical processor, group by group
+    double maxCoreUsage = 0.0;
+    double coreImbalance = 0.0;            // maxCoreUsage minus the mean core, in percentage points
+    ULONGLONG totalMemoryUsage = 0;
+    int historyWindow = 0;                 // HistoryWindow the averages below and in processes cover
+    double windowAvgCpu = 0.0;             // system CPU and memory over that window
+    double windowPeakCpu = 0.0;
+    double windowAvgMemory = 0.0;
+    ULONGLONG windowPeakMemory = 0;
+    ULONGLONG sampleTime = 0;
+    bool manual = false;
+    bool extended = false;                 // processes carry ExtendedCounters
+    double selfCpuUsage = 0.0;             // the monitor itself, percent of all logical processors
+    ULONGLONG selfWorkingSet = 0;
+    ULONGLONG selfPrivateBytes = 0;
+    ULONGLONG allocations = 0;             // heap allocations on the sampler thread since the previous snapshot
+    UINT sampledProcesses = 0;             // processes refreshed this tick
+    UINT slowTierProcesses = 0;            // the rest: slow-tier processes showing their last sample
+    std::vector<Alert> alerts;
+
+    // What changed since the previous snapshot. Row numbers index 'processes'.
+    std::vector<UINT> addedRows;
+    std::vector<UINT> changedRows;         // live CPU or memory changed at display resolution
+    std::vector<UINT> changedAverageRows;  // history averages changed at display resolution
+    std::vector<ProcessKey> exited;
+    std::vector<TransientProcess> transient; // started and exited since the previous snapshot
+    bool rowsStable = false;               // same processes in the same rows as before
+    ULONGLONG sequence = 0;
+};
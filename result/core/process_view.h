@@ -0,0 +1,95 @@
+// Sorted, filtered, top-N views over a Snapshot. A view is an index array into
+// snap.processes, so building one never copies a ProcessInfo and its cost is
+// O(processes) for the filter plus O(N log N) for ordering the N rows that are kept.
+#pragma once
+
+#include <windows.h>
+#include <vector>
+#include <algorithm>
+
+#include "process_types.h"
+#include "metric_columns.h"
+#include "process_filter.h"
+
+struct ViewOptions {
+    SortKey key = SORT_NONE;
+    bool descending = true;
+    size_t topN = 0;                 // 0 keeps every row that passes the filter
+    bool onlyInteresting = false;    // keep rows that changed this sample or are above cpuThreshold
+    double cpuThreshold = 0.0;
+    ProcessFilter* filter = nullptr; // rows must also match it; not owned
+
+    bool IsIdentity() const {
+        return key == SORT_NONE && topN == 0 && !onlyInteresting && (!filter || filter->Empty());
+    }
+};
+
+// Parses the names used by the collector's --sort flag: "name" or a metric key (see
+// metric_columns.h). Returns false if unknown.
+inline bool ParseSortKey(const wchar_t* name, SortKey& key) {
+    if (lstrcmpiW(name, L"name") == 0) {
+        key = SORT_NAME;
+        return true;
+    }
+    return AllMetrics::FindSort(name, key);
+}
+
+class ProcessView {
+private:
+    std::vector<UINT> rows;
+    std::vector<BYTE> changed;       // per snapshot row; reused between builds
+
+    // Ties fall back to the row number so the order is total and stable between samples.
+    struct Less {
+        const ProcessInfo* processes;
+        SortKey key;
+        bool descending;
+
+        int Compare(const ProcessInfo& a, const ProcessInfo& b) const {
+            if (key == SORT_NAME) return lstrcmpiW(a.name->c_str(), b.name->c_str());
+            return AllMetrics::Compare(key, a, b);
+        }
+
+        bool operator()(UINT left, UINT right) const {
+            int result = Compare(processes[left], processes[right]);
+            if (result == 0) return left < right;
+            return descending ? result > 0 : result < 0;
+        }
+    };
+
+public:
+    void Build(const Snapshot& snap, const ViewOptions& options) {
+        rows.clear();
+        size_t count = snap.processes.size();
+        if (options.onlyInteresting) {
+            changed.assign(count, 0);
+            for (UINT row : snap.addedRows) changed[row] = 1;
+            for (UINT row : snap.changedRows) changed[row] = 1;
+        }
+        for (UINT row = 0; row < count; row++) {
+            if (options.onlyInteresting && !changed[row] && snap.processes[row].cpuUsage < options.cpuThreshold) continue;
+            if (options.filter && !options.filter->Matches(snap.processes[row])) continue;
+            rows.push_back(row);
+        }
+
+        Less less = { snap.processes.data(), options.key, options.descending };
+        if (options.topN && options.topN < rows.size()) {
+            if (options.key == SORT_NONE) {
+                rows.resize(options.topN);
+                return;
+            }
+            // Select the N best in linear time, then order only those.
+            std::nth_element(rows.begin(), rows.begin() + options.topN, rows.end(), less);
+            rows.resize(options.topN);
+        }
+        if (options.key != SORT_NONE) std::sort(rows.begin(), rows.end(), less);
+    }
+
+    size_t Size() const {
+        return rows.size();
+    }
+
+    UINT Row(size_t index) const {
+        return rows[index];
+    }
+};
@@ -0,0 +1,221 @@
+// Self-profiling: QPC scoped timers feeding lock-free latency histograms, one per phase
+// of a refresh, plus the monitor's own CPU and memory, so it can report its own overhead.
+#pragma once
+
+#include <windows.h>
+#include <psapi.h>
+#include <atomic>
+
+#define PROFILE_BUCKETS 128     // log-linear microsecond buckets, four per power of two
+
+enum ProfilePhase {
+    PROFILE_SAMPLE,          // the whole refresh on the sampler thread
+    PROFILE_CAPTURE,         // NtQuerySystemInformation process snapshot
+    PROFILE_PER_PID,         // fallback: enumeration, OpenProcess and memory queries
+    PROFILE_TRACK,           // diffing, history and rollups
+    PROFILE_SYSTEM_CPU,
+    PROFILE_ALERTS,
+    PROFILE_ENQUEUE,         // handing the sample to the history logger
+    PROFILE_WRITER,          // writing one sample to the history file and archive
+    PROFILE_EXPORT,          // updating the shared-memory snapshot
+    PROFILE_LIST_VIEW,       // UI thread: process table update
+    PROFILE_HISTORY_VIEW,    // UI thread: history table update
+    PROFILE_FIRST_PAINT,     // front end: launch to the window's first paint, once
+    PROFILE_FIRST_DATA,      // front end: launch to the first snapshot shown, once
+    PROFILE_PHASE_COUNT
+};
+
+// Heap allocation counters, advanced by the operator new in alloc_counter.h. In programs
+// that do not include it they stay at 0 and AllocationCountingEnabled() is false.
+inline bool& AllocationCountingEnabled() {
+    static bool enabled = false;
+    return enabled;
+}
+
+inline ULONGLONG& ThreadAllocationCount() {
+    static thread_local ULONGLONG count = 0;
+    return count;
+}
+
+inline std::atomic<ULONGLONG>& ProcessAllocationCount() {
+    static std::atomic<ULONGLONG> count{ 0 };
+    return count;
+}
+
+inline const wchar_t* ProfilePhaseName(ProfilePhase phase) {
+    static const wchar_t* names[PROFILE_PHASE_COUNT] = {
+        L"sample", L"capture", L"per_pid", L"track", L"system_cpu", L"alerts",
+        L"enqueue", L"writer", L"export", L"list_view", L"history_view", L"first_paint", L"first_data"
+    };
+    return phase >= 0 && phase < PROFILE_PHASE_COUNT ? names[phase] : L"unknown";
+}
+
+struct LatencySummary {
+    ULONGLONG count;
+    double meanUs;
+    ULONGLONG p50Us;
+    ULONGLONG p99Us;
+    ULONGLONG maxUs;
+};
+
+// Any thread may record and any thread may summarise; counters are relaxed atomics, so
+// a summary taken during a write can be one sample behind, never torn.
+class LatencyHistogram {
+private:
+    std::atomic<ULONGLONG> buckets[PROFILE_BUCKETS];
+    std::atomic<ULONGLONG> count{ 0 };
+    std::atomic<ULONGLONG> totalUs{ 0 };
+    std::atomic<ULONGLONG> maxUs{ 0 };
+
+    // Values below 8 get a bucket each; above that, four buckets per power of two (<19% wide).
+    static UINT BucketOf(ULONGLONG us) {
+        if (us < 8) return (UINT)us;
+        UINT msb = 63;
+        while (!(us >> msb)) msb--;
+        UINT index = msb * 4 + (UINT)((us >> (msb - 2)) & 3);
+        return index < PROFILE_BUCKETS ? index : PROFILE_BUCKETS - 1;
+    }
+
+    // Upper bound of a bucket, so percentiles err on the slow side.
+    static ULONGLONG BucketLimit(UINT index) {
+        if (index < 8) return index;
+        UINT msb = index / 4;
+        return ((ULONGLONG)(5 + index % 4) << (msb - 2)) - 1;
+    }
+
+public:
+    LatencyHistogram() {
+        for (auto& bucket : buckets) bucket.store(0, std::memory_order_relaxed);
+    }
+
+    void Record(ULONGLONG us) {
+        buckets[BucketOf(us)].fetch_add(1, std::memory_order_relaxed);
+        count.fetch_add(1, std::memory_order_relaxed);
+        totalUs.fetch_add(us, std::memory_order_relaxed);
+        ULONGLONG seen = maxUs.load(std::memory_order_relaxed);
+        while (us > seen && !maxUs.compare_exchange_weak(seen, us, std::memory_order_relaxed)) {}
+    }
+
+    LatencySummary Summarize() const {
+        LatencySummary summary = {};
+        ULONGLONG counts[PROFILE_BUCKETS];
+        ULONGLONG total = 0;
+        for (UINT i = 0; i < PROFILE_BUCKETS; i++) {
+            counts[i] = buckets[i].load(std::memory_order_relaxed);
+            total += counts[i];
+        }
+        summary.count = total;
+        if (total == 0) return summary;
+        summary.meanUs = (double)totalUs.load(std::memory_order_relaxed) / count.load(std::memory_order_relaxed);
+        summary.maxUs = maxUs.load(std::memory_order_relaxed);
+
+        ULONGLONG p50Rank = (total + 1) / 2, p99Rank = total - total / 100, seen = 0;
+        bool haveP50 = false;
+        for (UINT i = 0; i < PROFILE_BUCKETS; i++) {
+            seen += counts[i];
+            if (!haveP50 && seen >= p50Rank) {
+                summary.p50Us = BucketLimit(i);
+                haveP50 = true;
+            }
+            if (seen >= p99Rank) {
+                summary.p99Us = BucketLimit(i);
+                break;
+            }
+        }
+        if (summary.p50Us > summary.maxUs) summary.p50Us = summary.maxUs;
+        if (summary.p99Us > summary.maxUs) summary.p99Us = summary.maxUs;
+        return summary;
+    }
+};
+
+class Profiler {
+private:
+    LatencyHistogram phases[PROFILE_PHASE_COUNT];
+
+public:
+    LatencyHistogram& Phase(ProfilePhase phase) {
+        return phases[phase];
+    }
+
+    LatencySummary Summarize(ProfilePhase phase) const {
+        return phases[phase].Summarize();
+    }
+
+    // For phases that do not fit a scope; 'qpcStart' is a QueryPerformanceCounter value.
+    void RecordSince(ProfilePhase phase, LONGLONG qpcStart) {
+        LARGE_INTEGER now;
+        QueryPerformanceCounter(&now);
+        phases[phase].Record(QpcToUs(now.QuadPart - qpcStart));
+    }
+
+    static LONGLONG Frequency() {
+        static const LONGLONG frequency = [] {
+            LARGE_INTEGER value;
+            QueryPerformanceFrequency(&value);
+            return value.QuadPart;
+        }();
+        return frequency;
+    }
+
+    static ULONGLONG QpcToUs(LONGLONG ticks) {
+        return ticks > 0 ? (ULONGLONG)ticks * 1000000 / Frequency() : 0;
+    }
+};
+
+// Times its own lifetime into a histogram; a null histogram makes it a no-op.
+class ScopedTimer {
+private:
+    LatencyHistogram* histogram;
+    LONGLONG start;
+
+public:
+    explicit ScopedTimer(LatencyHistogram* target) : histogram(target), start(0) {
+        if (!histogram) return;
+        LARGE_INTEGER now;
+        QueryPerformanceCounter(&now);
+        start = now.QuadPart;
+    }
+
+    explicit ScopedTimer(LatencyHistogram& target) : ScopedTimer(&target) {}
+
+    ~ScopedTimer() {
+        if (!histogram) return;
+        LARGE_INTEGER now;
+        QueryPerformanceCounter(&now);
+        histogram->Record(Profiler::QpcToUs(now.QuadPart - start));
+    }
+
+    ScopedTimer(const ScopedTimer&) = delete;
+    ScopedTimer& operator=(const ScopedTimer&) = delete;
+};
+
+// The monitor's own CPU (percent of all logical processors) and memory between samples.
+class SelfUsageMeter {
+private:
+    ULONGLONG lastCpuTime = 0;
+    ULONGLONG lastWallTime = 0;
+
+    static ULONGLONG ToUInt64(const FILETIME& ft) {
+        return ((ULONGLONG)ft.dwHighDateTime << 32) | ft.dwLowDateTime;
+    }
+
+public:
+    void Sample(ULONGLONG now, DWORD processorCount, double& cpuUsage, ULONGLONG& workingSet, ULONGLONG& privateBytes) {
+        FILETIME ftCreate, ftExit, ftKernel, ftUser;
+        if (GetProcessTimes(GetCurrentProcess(), &ftCreate, &ftExit, &ftKernel, &ftUser)) {
+            ULONGLONG cpuTime = ToUInt64(ftKernel) + ToUInt64(ftUser);
+            if (lastWallTime && now > lastWallTime && cpuTime >= lastCpuTime && processorCount) {
+                cpuUsage = (cpuTime - lastCpuTime) * 100.0 / ((now - lastWallTime) * processorCount);
+            }
+            lastCpuTime = cpuTime;
+            lastWallTime = now;
+        }
+
+        PROCESS_MEMORY_COUNTERS_EX counters;
+        counters.cb = sizeof(counters);
+        if (GetProcessMemoryInfo(GetCurrentProcess(), (PROCESS_MEMORY_COUNTERS*)&counters, sizeof(counters))) {
+            workingSet = counters.WorkingSetSize;
+            privateBytes = counters.PrivateUsage;
+        }
+    }
+};
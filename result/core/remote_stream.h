@@ -0,0 +1,438 @@
+// TCP transport for the wire protocol: a write-behind sender for collectors and a
+// single-threaded aggregator that merges many hosts into one fleet table.
+//
+// Winsock 2 must come before <windows.h>, which otherwise pulls in the old winsock.h;
+// front ends that include this header include <winsock2.h> first.
+#pragma once
+
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#include <windows.h>
+#include <climits>
+#include <string>
+#include <vector>
+#include <memory>
+#include <atomic>
+
+#include "process_types.h"
+#include "name_pool.h"
+#include "spsc_queue.h"
+#include "wire_protocol.h"
+
+#pragma comment(lib, "ws2_32.lib")
+
+#define REMOTE_QUEUE_BYTES (4 * 1024 * 1024)       // power of two
+#define REMOTE_RECONNECT_MS 2000
+#define REMOTE_MAX_HOSTS 1024
+#define REMOTE_FRAME_PREFIX (sizeof(DWORD) + sizeof(WireFrameHeader))
+
+inline bool WinsockStartup() {
+    static bool started = false;
+    if (!started) {
+        WSADATA data;
+        started = WSAStartup(MAKEWORD(2, 2), &data) == 0;
+    }
+    return started;
+}
+
+// Splits "host:port" (or "[v6]:port", or just "host") into its parts.
+inline void SplitHostPort(const std::wstring& target, std::wstring& host, std::wstring& port) {
+    size_t colon = target.rfind(L':');
+    bool bracketed = !target.empty() && target[0] == L'[';
+    if (colon == std::wstring::npos || (bracketed && colon < target.find(L']'))) {
+        host = target;
+        port = std::to_wstring(WIRE_DEFAULT_PORT);
+    } else {
+        host = target.substr(0, colon);
+        port = target.substr(colon + 1);
+    }
+    if (bracketed && host.size() >= 2 && host.back() == L']') host = host.substr(1, host.size() - 2);
+}
+
+struct RemoteSenderStats {
+    bool connected;
+    ULONGLONG framesSent;
+    ULONGLONG bytesSent;
+    ULONGLONG samplesSent;
+    ULONGLONG framesDropped;    // queue full or no connection; the next frame resynchronises
+    ULONGLONG connections;
+};
+
+// Encodes on the front end's thread and sends from its own, so a slow or absent
+// aggregator never blocks sampling or printing. Each queued frame is prefixed with the
+// connection epoch it was encoded for; frames from an earlier connection are discarded,
+// and a new connection always starts with a hello and a full table.
+class RemoteSender {
+private:
+    std::wstring host;
+    std::wstring port;
+    std::wstring hostName;
+    DWORD logicalProcessors = 1;
+    bool compress = false;
+    DWORD batchSamples = 1;
+
+    // Producer side.
+    WireEncoder encoder;
+    WireFramer framer;
+    WireCompressor compressor;
+    std::vector<BYTE> frame;
+    DWORD producerEpoch = 0;
+    DWORD batchedSamples = 0;
+
+    // Consumer side.
+    SpscQueue<BYTE> queue{ REMOTE_QUEUE_BYTES };
+    std::vector<BYTE> outgoing;
+    SOCKET connection = INVALID_SOCKET;
+    std::atomic<DWORD> epoch{ 0 };              // 0 while disconnected
+    HANDLE hThread = NULL;
+    HANDLE hStopEvent = NULL;
+    HANDLE hDataEvent = NULL;
+
+    std::atomic<ULONGLONG> framesSent{ 0 };
+    std::atomic<ULONGLONG> bytesSent{ 0 };
+    std::atomic<ULONGLONG> samplesSent{ 0 };
+    std::atomic<ULONGLONG> framesDropped{ 0 };
+    std::atomic<ULONGLONG> connections{ 0 };
+
+    bool Connect() {
+        ADDRINFOW hints = { 0 };
+        hints.ai_family = AF_UNSPEC;
+        hints.ai_socktype = SOCK_STREAM;
+        hints.ai_protocol = IPPROTO_TCP;
+        ADDRINFOW* addresses = NULL;
+        if (GetAddrInfoW(host.c_str(), port.c_str(), &hints, &addresses) != 0) return false;
+        for (ADDRINFOW* a = addresses; a && connection == INVALID_SOCKET; a = a->ai_next) {
+            SOCKET s = socket(a->ai_family, a->ai_socktype, a->ai_protocol);
+            if (s == INVALID_SOCKET) continue;
+            if (connect(s, a->ai_addr, (int)a->ai_addrlen) == 0) {
+                BOOL noDelay = TRUE; // frames are already batched
+                setsockopt(s, IPPROTO_TCP, TCP_NODELAY, reinterpret_cast<const char*>(&noDelay), sizeof(noDelay));
+                connection = s;
+            } else {
+                closesocket(s);
+            }
+        }
+        FreeAddrInfoW(addresses);
+        return connection != INVALID_SOCKET;
+    }
+
+    void Disconnect() {
+        if (connection != INVALID_SOCKET) closesocket(connection);
+        connection = INVALID_SOCKET;
+        epoch.store(0, std::memory_order_release);
+    }
+
+    bool SendAll(const BYTE* data, size_t size) {
+        while (size) {
+            int sent = send(connection, reinterpret_cast<const char*>(data), size > INT_MAX ? INT_MAX : (int)size, 0);
+            if (sent <= 0) return false;
+            data += sent;
+            size -= sent;
+        }
+        return true;
+    }
+
+    // Frames arrive whole: the producer publishes each with a single TryPush.
+    void Drain() {
+        BYTE prefix[REMOTE_FRAME_PREFIX];
+        while (queue.Pop(prefix, sizeof(prefix))) {
+            DWORD frameEpoch;
+            WireFrameHeader header;
+            memcpy(&frameEpoch, prefix, sizeof(frameEpoch));
+            memcpy(&header, prefix + sizeof(frameEpoch), sizeof(header));
+            outgoing.assign(reinterpret_cast<const BYTE*>(&header), reinterpret_cast<const BYTE*>(&header) + sizeof(header));
+            outgoing.resize(sizeof(header) + header.payloadBytes);
+            queue.Pop(outgoing.data() + sizeof(header), header.payloadBytes);
+            if (connection == INVALID_SOCKET || frameEpoch != epoch.load(std::memory_order_relaxed)) continue;
+            if (!SendAll(outgoing.data(), outgoing.size())) {
+                Disconnect();
+                continue;
+            }
+            framesSent.fetch_add(1, std::memory_order_relaxed);
+            bytesSent.fetch_add(outgoing.size(), std::memory_order_relaxed);
+        }
+    }
+
+    void Run() {
+        HANDLE waits[] = { hStopEvent, hDataEvent };
+        DWORD nextEpoch = 1;
+        for (;;) {
+            if (connection == INVALID_SOCKET) {
+                if (Connect()) {
+                    connections.fetch_add(1, std::memory_order_relaxed);
+                    epoch.store(nextEpoch++, std::memory_order_release);
+                    if (!nextEpoch) nextEpoch = 1;
+                } else if (WaitForSingleObject(hStopEvent, REMOTE_RECONNECT_MS) == WAIT_OBJECT_0) {
+                    break;
+                }
+            }
+            Drain();
+            if (connection == INVALID_SOCKET) continue;
+            DWORD result = WaitForMultipleObjects(2, waits, FALSE, INFINITE);
+            if (result != WAIT_OBJECT_0 + 1) break;
+        }
+        Drain();
+        Disconnect();
+    }
+
+    static DWORD WINAPI ThreadProc(LPVOID param) {
+        static_cast<RemoteSender*>(param)->Run();
+        return 0;
+    }
+
+    void Flush() {
+        frame.clear();
+        const BYTE* e = reinterpret_cast<const BYTE*>(&producerEpoch);
+        frame.insert(frame.end(), e, e + sizeof(producerEpoch));
+        framer.Finish(frame, compress ? &compressor : NULL);
+        batchedSamples = 0;
+        if (!queue.TryPush(frame.data(), frame.size())) {
+            framesDropped.fetch_add(1, std::memory_order_relaxed);
+            encoder.Reset();
+            return;
+        }
+        SetEvent(hDataEvent);
+    }
+
+public:
+    ~RemoteSender() {
+        Stop();
+    }
+
+    // 'target' is host:port. Batches of more than one sample trade latency for fewer,
+    // better-compressed frames.
+    bool Start(const wchar_t* target, bool compressFrames, DWORD batch) {
+        if (!WinsockStartup()) return false;
+        SplitHostPort(target, host, port);
+        compress = compressFrames;
+        batchSamples = batch ? batch : 1;
+        WCHAR computer[MAX_COMPUTERNAME_LENGTH + 1];
+        DWORD length = ARRAYSIZE(computer);
+        hostName = GetComputerNameW(computer, &length) ? computer : L"unknown";
+        logicalProcessors = GetActiveProcessorCount(ALL_PROCESSOR_GROUPS);
+
+        hStopEvent = CreateEventW(NULL, TRUE, FALSE, NULL);
+        hDataEvent = CreateEventW(NULL, FALSE, FALSE, NULL);
+        if (!hStopEvent || !hDataEvent) return false;
+        hThread = CreateThread(NULL, 0, ThreadProc, this, 0, NULL);
+        if (hThread) SetThreadPriority(hThread, THREAD_PRIORITY_BELOW_NORMAL);
+        return hThread != NULL;
+    }
+
+    // Stops after everything already queued has been sent.
+    void Stop() {
+        if (hThread) {
+            if (framer.Messages() && producerEpoch) Flush();
+            SetEvent(hStopEvent);
+            WaitForSingleObject(hThread, INFINITE);
+            CloseHandle(hThread);
+            hThread = NULL;
+        }
+        if (hStopEvent) CloseHandle(hStopEvent);
+        if (hDataEvent) CloseHandle(hDataEvent);
+        hStopEvent = hDataEvent = NULL;
+    }
+
+    // Front end's thread, for every snapshot it takes. Nothing is encoded while there is
+    // no connection.
+    void Send(const Snapshot& snap) {
+        if (!hThread) return;
+        DWORD current = epoch.load(std::memory_order_acquire);
+        if (current != producerEpoch) {
+            producerEpoch = current;
+            framer.Discard();
+            batchedSamples = 0;
+            encoder.Reset();
+            if (current) {
+                encoder.Hello(hostName, logicalProcessors, framer.Buffer());
+                framer.Commit();
+            }
+        }
+        if (!current) return;
+
+        encoder.Sample(snap, framer.Buffer());
+        framer.Commit();
+        samplesSent.fetch_add(1, std::memory_order_relaxed);
+        if (++batchedSamples >= batchSamples) Flush();
+    }
+
+    RemoteSenderStats GetStats() const {
+        RemoteSenderStats stats;
+        stats.connected = epoch.load(std::memory_order_relaxed) != 0;
+        stats.framesSent = framesSent.load(std::memory_order_relaxed);
+        stats.bytesSent = bytesSent.load(std::memory_order_relaxed);
+        stats.samplesSent = samplesSent.load(std::memory_order_relaxed);
+        stats.framesDropped = framesDropped.load(std::memory_order_relaxed);
+        stats.connections = connections.load(std::memory_order_relaxed);
+        return stats;
+    }
+};
+
+// Receives from up to REMOTE_MAX_HOSTS collectors on one thread with WSAPoll, which has
+// no FD_SETSIZE limit. A host's processes leave the fleet when its connection closes.
+class Aggregator {
+private:
+    struct Connection {
+        SOCKET socket;
+        std::vector<BYTE> buffer;     // received bytes not yet forming a whole frame
+        WireDecoder decoder;
+
+        Connection(SOCKET s, NamePool& pool) : socket(s), decoder(pool) {}
+    };
+
+    NamePool names;
+    SOCKET listener = INVALID_SOCKET;
+    std::vector<std::unique_ptr<Connection>> connections;
+    std::vector<WSAPOLLFD> polls;
+    std::vector<BYTE> raw;
+    WireCompressor decompressor;
+    ULONGLONG bytesReceived = 0;
+
+    // Applies every whole frame in the buffer. False drops the connection.
+    bool Consume(Connection& c) {
+        size_t offset = 0;
+        while (c.buffer.size() - offset >= sizeof(WireFrameHeader)) {
+            WireFrameHeader header;
+            memcpy(&header, c.buffer.data() + offset, sizeof(header));
+            if (header.magic != WIRE_MAGIC || header.version != WIRE_VERSION
+                || header.payloadBytes > WIRE_MAX_FRAME_BYTES || header.rawBytes > WIRE_MAX_FRAME_BYTES) return false;
+            if (c.buffer.size() - offset - sizeof(header) < header.payloadBytes) break;
+
+            const BYTE* payload = c.buffer.data() + offset + sizeof(header);
+            bool applied;
+            if (header.flags & WIRE_FLAG_COMPRESSED) {
+                applied = decompressor.Decompress(payload, header.payloadBytes, header.rawBytes, raw)
+                    && c.decoder.Apply(raw.data(), raw.size(), header.messages);
+            } else {
+                applied = header.rawBytes == header.payloadBytes && c.decoder.Apply(payload, header.payloadBytes, header.messages);
+            }
+            if (!applied) return false;
+            offset += sizeof(header) + header.payloadBytes;
+        }
+        c.buffer.erase(c.buffer.begin(), c.buffer.begin() + offset);
+        return true;
+    }
+
+    void Accept() {
+        for (;;) {
+            SOCKET s = accept(listener, NULL, NULL);
+            if (s == INVALID_SOCKET) return;
+            if (connections.size() >= REMOTE_MAX_HOSTS) {
+                closesocket(s);
+                continue;
+            }
+            u_long nonBlocking = 1;
+            ioctlsocket(s, FIONBIO, &nonBlocking);
+            connections.emplace_back(new Connection(s, names));
+        }
+    }
+
+    // False when the peer closed or sent something malformed.
+    bool Receive(Connection& c) {
+        BYTE chunk[16384];
+        for (;;) {
+            int received = recv(c.socket, reinterpret_cast<char*>(chunk), sizeof(chunk), 0);
+            if (received == 0) return false;
+            if (received < 0) return WSAGetLastError() == WSAEWOULDBLOCK;
+            bytesReceived += received;
+            c.buffer.insert(c.buffer.end(), chunk, chunk + received);
+            if (!Consume(c)) return false;
+        }
+    }
+
+public:
+    ~Aggregator() {
+        Close();
+    }
+
+    bool Listen(const wchar_t* port) {
+        if (!WinsockStartup()) return false;
+        ADDRINFOW hints = { 0 };
+        hints.ai_family = AF_INET6;
+        hints.ai_socktype = SOCK_STREAM;
+        hints.ai_protocol = IPPROTO_TCP;
+        hints.ai_flags = AI_PASSIVE;
+        ADDRINFOW* address = NULL;
+        if (GetAddrInfoW(NULL, port, &hints, &address) != 0) return false;
+        listener = socket(address->ai_family, address->ai_socktype, address->ai_protocol);
+        if (listener != INVALID_SOCKET) {
+            DWORD v6Only = 0; // accept IPv4 collectors on the same socket
+            setsockopt(listener, IPPROTO_IPV6, IPV6_V6ONLY, reinterpret_cast<const char*>(&v6Only), sizeof(v6Only));
+            u_long nonBlocking = 1;
+            ioctlsocket(listener, FIONBIO, &nonBlocking);
+            if (bind(listener, address->ai_addr, (int)address->ai_addrlen) != 0 || listen(listener, SOMAXCONN) != 0) {
+                closesocket(listener);
+                listener = INVALID_SOCKET;
+            }
+        }
+        FreeAddrInfoW(address);
+        return listener != INVALID_SOCKET;
+    }
+
+    void Close() {
+        for (auto& c : connections) closesocket(c->socket);
+        connections.clear();
+        if (listener != INVALID_SOCKET) closesocket(listener);
+        listener = INVALID_SOCKET;
+    }
+
+    // Waits up to timeoutMs for traffic and applies whatever arrived.
+    void Poll(DWORD timeoutMs) {
+        polls.resize(connections.size() + 1);
+        polls[0] = { listener, POLLRDNORM, 0 };
+        for (size_t i = 0; i < connections.size(); i++) polls[i + 1] = { connections[i]->socket, POLLRDNORM, 0 };
+        if (WSAPoll(polls.data(), (ULONG)polls.size(), (INT)timeoutMs) <= 0) return;
+
+        size_t count = connections.size();
+        for (size_t i = count; i-- > 0;) {
+            if (!polls[i + 1].revents) continue;
+            if (!Receive(*connections[i])) {
+                closesocket(connections[i]->socket);
+                connections.erase(connections.begin() + i);
+            }
+        }
+        if (polls[0].revents & POLLRDNORM) Accept();
+    }
+
+    size_t HostCount() const {
+        return connections.size();
+    }
+
+    ULONGLONG BytesReceived() const {
+        return bytesReceived;
+    }
+
+    // Merges every host's current table into 'fleet'; hosts[row] names the host of
+    // fleet.processes[row]. Memory is summed over hosts; CPU is a percentage of every
+    // logical processor in the fleet, so each host counts by its processor count.
+    void BuildFleet(Snapshot& fleet, std::vector<const std::wstring*>& hosts) {
+        fleet.processes.clear();
+        hosts.clear();
+        double busyProcessors = 0.0;
+        ULONGLONG processors = 0;
+        fleet.totalCpuUsage = 0.0;
+        fleet.totalMemoryUsage = 0;
+        fleet.sampleTime = 0;
+        for (const auto& c : connections) {
+            const WireDecoder& d = c->decoder;
+            if (!d.samples) continue;
+            const std::wstring* host = names.Intern(d.host);
+            busyProcessors += d.totalCpuUsage * d.logicalProcessors;
+            processors += d.logicalProcessors;
+            fleet.totalMemoryUsage += d.totalMemoryUsage;
+            if (d.sampleTime > fleet.sampleTime) fleet.sampleTime = d.sampleTime;
+            for (const auto& entry : d.processes) {
+                ProcessInfo info = {};
+                info.pid = entry.first;
+                info.name = entry.second.name;
+                info.cpuUsage = entry.second.cpuUsage;
+                info.memoryUsage = (SIZE_T)entry.second.memoryUsage;
+                info.createTime = entry.second.createTime;
+                info.historySlot = HISTORY_NO_SLOT;
+                fleet.processes.push_back(info);
+                hosts.push_back(host);
+            }
+        }
+        if (processors) fleet.totalCpuUsage = busyProcessors / processors;
+    }
+};
@@ -0,0 +1,221 @@
+// Multi-resolution rollups: every raw sample is folded into 1-second, 1-minute and
+// 1-hour min/max/sum buckets as it arrives, so long windows are answered from a few
+// hundred buckets instead of raw samples. All bucket storage is preallocated.
+#pragma once
+
+#include <windows.h>
+#include <vector>
+#include <cmath>
+
+#define ROLLUP_SECOND_WIDTH 10000000ULL            // FILETIME units
+#define ROLLUP_MINUTE_WIDTH (60 * ROLLUP_SECOND_WIDTH)
+#define ROLLUP_HOUR_WIDTH (60 * ROLLUP_MINUTE_WIDTH)
+#define SYSTEM_ROLLUP_SECONDS 3600                 // one hour at 1 s
+#define SYSTEM_ROLLUP_MINUTES 10080                // one week at 1 min
+#define SYSTEM_ROLLUP_HOURS 2160                   // 90 days at 1 h
+#define PROCESS_ROLLUP_MINUTES 60                  // one hour at 1 min
+#define PROCESS_ROLLUP_HOURS 168                   // one week at 1 h
+
+enum HistoryWindow {
+    HISTORY_WINDOW_MINUTE,   // the raw 60-sample history
+    HISTORY_WINDOW_HOUR,
+    HISTORY_WINDOW_DAY,
+    HISTORY_WINDOW_WEEK,
+    HISTORY_WINDOW_COUNT
+};
+
+inline ULONGLONG HistoryWindowSpan(HistoryWindow window) {
+    switch (window) {
+    case HISTORY_WINDOW_HOUR: return ROLLUP_HOUR_WIDTH;
+    case HISTORY_WINDOW_DAY: return 24 * ROLLUP_HOUR_WIDTH;
+    case HISTORY_WINDOW_WEEK: return 7 * 24 * ROLLUP_HOUR_WIDTH;
+    default: return ROLLUP_MINUTE_WIDTH;
+    }
+}
+
+struct RollupBucket {
+    ULONGLONG start;             // FILETIME at which the bucket begins
+    double cpuSum;
+    double cpuSquareSum;         // for the standard deviation over a window
+    double memorySum;
+    ULONGLONG memoryMin;
+    ULONGLONG memoryMax;
+    float cpuMin;
+    float cpuMax;
+    DWORD count;                 // samples folded in; 0 for an empty aggregate
+    DWORD reserved;
+
+    void Clear() {
+        start = 0;
+        cpuSum = cpuSquareSum = memorySum = 0.0;
+        memoryMin = memoryMax = 0;
+        cpuMin = cpuMax = 0.0f;
+        count = 0;
+    }
+
+    // 'weight' samples of the same value; a slow-tier sample counts for every tick it covers.
+    void Add(double cpu, ULONGLONG memory, DWORD weight = 1) {
+        float value = (float)cpu;
+        if (count == 0 || value < cpuMin) cpuMin = value;
+        if (count == 0 || value > cpuMax) cpuMax = value;
+        if (count == 0 || memory < memoryMin) memoryMin = memory;
+        if (count == 0 || memory > memoryMax) memoryMax = memory;
+        cpuSum += cpu * weight;
+        cpuSquareSum += cpu * cpu * weight;
+        memorySum += (double)memory * weight;
+        count += weight;
+    }
+
+    void Merge(const RollupBucket& other) {
+        if (other.count == 0) return;
+        if (count == 0 || other.cpuMin < cpuMin) cpuMin = other.cpuMin;
+        if (count == 0 || other.cpuMax > cpuMax) cpuMax = other.cpuMax;
+        if (count == 0 || other.memoryMin < memoryMin) memoryMin = other.memoryMin;
+        if (count == 0 || other.memoryMax > memoryMax) memoryMax = other.memoryMax;
+        cpuSum += other.cpuSum;
+        cpuSquareSum += other.cpuSquareSum;
+        memorySum += other.memorySum;
+        count += other.count;
+    }
+
+    double AverageCpu() const {
+        return count ? cpuSum / count : 0.0;
+    }
+
+    double AverageMemory() const {
+        return count ? memorySum / count : 0.0;
+    }
+
+    double CpuStdDev() const {
+        if (!count) return 0.0;
+        double mean = cpuSum / count;
+        double variance = cpuSquareSum / count - mean * mean;
+        return variance > 0.0 ? sqrt(variance) : 0.0;
+    }
+};
+
+// A ring of equal-width buckets over storage owned by someone else.
+struct RollupRing {
+    RollupBucket* buckets;
+    UINT capacity;
+    UINT head;                   // next bucket to start
+    UINT count;
+    ULONGLONG width;
+
+    void Reset() {
+        head = 0;
+        count = 0;
+    }
+
+    void Fold(ULONGLONG time, double cpu, ULONGLONG memory, DWORD weight = 1) {
+        ULONGLONG start = time - time % width;
+        UINT newest = (head + capacity - 1) % capacity;
+        // A clock stepped backwards still lands in the newest bucket rather than reordering.
+        if (count == 0 || start > buckets[newest].start) {
+            newest = head;
+            head = (head + 1) % capacity;
+            if (count < capacity) count++;
+            buckets[newest].Clear();
+            buckets[newest].start = start;
+        }
+        buckets[newest].Add(cpu, memory, weight);
+    }
+
+    // Merges every bucket overlapping [from, infinity) into 'out'.
+    void Aggregate(ULONGLONG from, RollupBucket& out) const {
+        for (UINT i = 0; i < count; i++) {
+            const RollupBucket& bucket = buckets[(head + capacity - 1 - i) % capacity];
+            if (bucket.start + width <= from) break;
+            out.Merge(bucket);
+        }
+    }
+};
+
+// System-wide series: total CPU and total memory, kept for weeks.
+class SystemRollups {
+private:
+    std::vector<RollupBucket> storage;
+    RollupRing seconds;
+    RollupRing minutes;
+    RollupRing hours;
+
+public:
+    SystemRollups() : storage(SYSTEM_ROLLUP_SECONDS + SYSTEM_ROLLUP_MINUTES + SYSTEM_ROLLUP_HOURS) {
+        RollupBucket* base = storage.data();
+        seconds = { base, SYSTEM_ROLLUP_SECONDS, 0, 0, ROLLUP_SECOND_WIDTH };
+        minutes = { base + SYSTEM_ROLLUP_SECONDS, SYSTEM_ROLLUP_MINUTES, 0, 0, ROLLUP_MINUTE_WIDTH };
+        hours = { base + SYSTEM_ROLLUP_SECONDS + SYSTEM_ROLLUP_MINUTES, SYSTEM_ROLLUP_HOURS, 0, 0, ROLLUP_HOUR_WIDTH };
+    }
+
+    void Fold(ULONGLONG time, double cpu, ULONGLONG memory) {
+        seconds.Fold(time, cpu, memory);
+        minutes.Fold(time, cpu, memory);
+        hours.Fold(time, cpu, memory);
+    }
+
+    // Uses the coarsest resolution that still covers the window with at least 24 buckets.
+    RollupBucket Aggregate(ULONGLONG now, HistoryWindow window) const {
+        RollupBucket out;
+        out.Clear();
+        ULONGLONG span = HistoryWindowSpan(window);
+        ULONGLONG from = now > span ? now - span : 0;
+        if (window == HISTORY_WINDOW_MINUTE) seconds.Aggregate(from, out);
+        else if (window == HISTORY_WINDOW_HOUR) minutes.Aggregate(from, out);
+        else hours.Aggregate(from, out);
+        return out;
+    }
+};
+
+// Per-process series, indexed by the same slots as HistoryStore: minute buckets for the
+// last hour and hour buckets for the last week, about 15 KB per process.
+class ProcessRollups {
+private:
+    static const UINT bucketsPerSlot = PROCESS_ROLLUP_MINUTES + PROCESS_ROLLUP_HOURS;
+
+    std::vector<RollupBucket> storage;
+    std::vector<RollupRing> minuteRings;
+    std::vector<RollupRing> hourRings;
+
+    // Growing the storage moves it, so rings are re-pointed at their new home.
+    void Grow(size_t slots) {
+        storage.resize(slots * bucketsPerSlot);
+        size_t old = minuteRings.size();
+        minuteRings.resize(slots);
+        hourRings.resize(slots);
+        for (size_t slot = 0; slot < slots; slot++) {
+            RollupBucket* base = storage.data() + slot * bucketsPerSlot;
+            if (slot >= old) {
+                minuteRings[slot] = { base, PROCESS_ROLLUP_MINUTES, 0, 0, ROLLUP_MINUTE_WIDTH };
+                hourRings[slot] = { base + PROCESS_ROLLUP_MINUTES, PROCESS_ROLLUP_HOURS, 0, 0, ROLLUP_HOUR_WIDTH };
+            } else {
+                minuteRings[slot].buckets = base;
+                hourRings[slot].buckets = base + PROCESS_ROLLUP_MINUTES;
+            }
+        }
+    }
+
+public:
+    // Called whenever HistoryStore hands out 'slot' to a new process.
+    void Reset(size_t slot) {
+        if (slot >= minuteRings.size()) Grow(slot + 1 > minuteRings.size() * 2 ? slot + 1 : minuteRings.size() * 2);
+        minuteRings[slot].Reset();
+        hourRings[slot].Reset();
+    }
+
+    // The whole weight lands in the bucket holding 'time', even if the ticks it covers
+    // began in the previous one.
+    void Fold(size_t slot, ULONGLONG time, double cpu, ULONGLONG memory, DWORD weight = 1) {
+        minuteRings[slot].Fold(time, cpu, memory, weight);
+        hourRings[slot].Fold(time, cpu, memory, weight);
+    }
+
+    RollupBucket Aggregate(size_t slot, ULONGLONG now, HistoryWindow window) const {
+        RollupBucket out;
+        out.Clear();
+        ULONGLONG span = HistoryWindowSpan(window);
+        ULONGLONG from = now > span ? now - span : 0;
+        if (window == HISTORY_WINDOW_HOUR) minuteRings[slot].Aggregate(from, out);
+        else hourRings[slot].Aggregate(from, out);
+        return out;
+    }
+};
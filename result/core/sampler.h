@@ -0,0 +1,583 @@
+// The sampling core: a background thread that samples processes, keeps history, raises
+// alerts, logs, and publishes Snapshots. Used by the GUI and by the headless collector.
+#pragma once
+
+#include <windows.h>
+#include <atomic>
+
+#include "process_types.h"
+#include "history_store.h"
+#include "process_sources.h"
+#include "alerts.h"
+#include "history_log.h"
+#include "system_cpu.h"
+#include "topology.h"
+#include "rollups.h"
+#include "profiler.h"
+#include "process_events.h"
+#include "shared_snapshot.h"
+
+#define DEFAULT_SAMPLE_INTERVAL_MS 1000
+#define MIN_SAMPLE_INTERVAL_MS 50
+#define TIER_HOT_CPU 0.5                    // percent; a sample at or above it is activity
+#define TIER_HOT_MEMORY_DELTA (256 * 1024)  // as is a working-set change this large
+#define TIER_IDLE_SAMPLES 10                // idle samples before a process moves to the slow tier
+#define TIER_SLOW_TICKS 5                   // the slow tier is refreshed every this many ticks
+
+// Called on the sampler thread when a snapshot is ready and the previous one has been
+// taken; the front end should wake its own thread and call TakeLatest there.
+typedef void (*SnapshotReadyFn)(void* context);
+
+// Samples on its own thread at a fixed cadence and publishes immutable Snapshots,
+// signalling the front end through a SnapshotReadyFn. Publication is a lock-free pointer
+// swap: the sampler fills a spare buffer, exchanges it into 'ready', and the front end
+// exchanges 'ready' out again.
+class Sampler {
+private:
+    NtProcessSnapshot snapshot;
+    PerPidQuery perPid; // fallback when NtQuerySystemInformation is unavailable or fails
+    SystemCpuEngine systemCpu;
+    TopologyCache topology;
+    // The ring buffers and rollups exist for the history metrics; a build without any
+    // skips them per process.
+    static constexpr bool keepsHistory = SampledStorage::Uses(METRIC_HISTORY);
+    HistoryStore history;
+    ProcessRollups processRollups;
+    SystemRollups systemRollups;
+    ProcessTable tracked;
+    std::vector<TrackedProcess*> rowEntries;  // per snapshot row, valid during Sample
+    std::vector<UINT> summaryRows;            // rows refreshed this tick, for SummarizeAll
+    std::vector<size_t> summarySlots;
+    std::vector<HistoryStats> summaryStats;
+    ULONGLONG generation = 0;
+    ULONGLONG sequence = 0;
+    AlertEngine alertEngine;
+    ProcessFilter alertFilter;      // empty: the per-process rules cover every process
+    HistoryLogger historyLogger;
+    NamePool names;                 // every process name seen; snapshots point into it
+    ULONGLONG allocationMark = 0;
+    Profiler profiler;
+    SelfUsageMeter selfUsage;
+    ProcessEventSource processEvents; // short-lived processes between samples; needs elevation
+    SharedSnapshotWriter sharedSnapshot;
+    bool exportShared = true;
+    bool lastExtended = false;      // the previous sample read extended counters
+    HistoryWindow lastWindow = HISTORY_WINDOW_MINUTE;
+    ULONGLONG memoryAlertThreshold = 0;
+
+    std::atomic<Snapshot*> ready{ nullptr };
+    std::atomic<Snapshot*> spare{ nullptr };
+    std::atomic<double> cpuAlertThreshold{ 80.0 };
+    std::atomic<DWORD> intervalMs{ DEFAULT_SAMPLE_INTERVAL_MS };
+    std::atomic<int> historyWindow{ HISTORY_WINDOW_MINUTE };
+    std::atomic<bool> extendedCounters{ false };
+    std::atomic<bool> adaptiveSampling{ true };
+
+    SnapshotReadyFn notify = NULL;
+    void* notifyContext = NULL;
+    HANDLE hThread = NULL;
+    HANDLE hStopEvent = NULL;
+    HANDLE hSampleNowEvent = NULL;
+    HANDLE hReconfigureEvent = NULL;
+    HANDLE hTimer = NULL;
+    LARGE_INTEGER qpcFrequency;
+    ULONGLONG overruns = 0;
+    ULONGLONG failedSamples = 0;
+
+    // Sampler thread: picks up hardware changes before a refresh uses the topology.
+    void RefreshTopology() {
+        if (!topology.Refresh(GetTickCount64())) return;
+        const SystemTopology& current = topology.Get();
+        systemCpu.Configure(current.groupSizes);
+        memoryAlertThreshold = current.totalPhysicalMemory / 10 * 8; // 80% of total system memory
+    }
+
+    LONGLONG QpcNow() {
+        LARGE_INTEGER now;
+        QueryPerformanceCounter(&now);
+        return now.QuadPart;
+    }
+
+    // Slow-tier processes are refreshed every TIER_SLOW_TICKS ticks. The NT capture reads
+    // them anyway, so there the sample loop also refreshes one early when it shows activity.
+    static bool SkipsTick(const TrackedProcess& entry, bool refreshAll) {
+        return !refreshAll && entry.slowTier && entry.skippedTicks + 1 < TIER_SLOW_TICKS;
+    }
+
+    static bool IsActive(const TrackedProcess& entry, double cpuUsage, SIZE_T memoryUsage) {
+        SIZE_T memoryDelta = memoryUsage > entry.sampledMemory ? memoryUsage - entry.sampledMemory : entry.sampledMemory - memoryUsage;
+        return cpuUsage >= TIER_HOT_CPU || memoryDelta >= TIER_HOT_MEMORY_DELTA;
+    }
+
+    // Collects the metrics read from this sample's extended counters. Counters are current
+    // on every tick; rates only move when the process is refreshed, over 'seconds' since its
+    // previous refresh, or 0 for none.
+    static void CollectCounters(TrackedProcess& entry, ProcessInfo& info, bool extended, bool refreshed, double seconds) {
+        if (!extended) {
+            SampledStorage::Reset<METRIC_COUNTER>(info.metrics);
+            SampledStorage::Reset<METRIC_RATE>(info.metrics);
+            return;
+        }
+        MetricSample sample = {};
+        sample.counters = &info.extended;
+        sample.seconds = seconds;
+        SampledStorage::Collect<METRIC_COUNTER>(sample, entry.metricStates, info.metrics);
+        if (refreshed) SampledStorage::Collect<METRIC_RATE>(sample, entry.metricStates, info.metrics);
+    }
+
+    static void CollectHistory(TrackedProcess& entry, ProcessInfo& info, const HistoryStats& stats) {
+        MetricSample sample = {};
+        sample.stats = stats;
+        SampledStorage::Collect<METRIC_HISTORY>(sample, entry.metricStates, info.metrics);
+    }
+
+    // The longer windows keep rollups rather than samples, so they have no percentile.
+    static HistoryStats RollupStats(const RollupBucket& total) {
+        HistoryStats stats = {};
+        stats.count = total.count;
+        stats.cpuMean = total.AverageCpu();
+        stats.cpuMin = total.cpuMin;
+        stats.cpuMax = total.cpuMax;
+        stats.cpuStdDev = total.CpuStdDev();
+        stats.cpuPercentile = -1.0;
+        stats.memoryMean = total.AverageMemory();
+        stats.memoryMin = total.memoryMin;
+        stats.memoryMax = total.memoryMax;
+        return stats;
+    }
+
+    // Returns false if neither source could enumerate processes; 'snap' is then only partly
+    // filled and must not be published.
+    bool Sample(Snapshot& snap, bool manual) {
+        ScopedTimer sampleTimer(profiler.Phase(PROFILE_SAMPLE));
+        snap.processes.clear();
+        snap.alerts.clear();
+        snap.totalCpuUsage = 0.0;
+        snap.kernelCpuUsage = 0.0;
+        snap.totalMemoryUsage = 0;
+        snap.manual = manual;
+        snap.extended = extendedCounters.load(std::memory_order_relaxed);
+        snap.selfCpuUsage = 0.0;
+        snap.addedRows.clear();
+        snap.changedRows.clear();
+        snap.changedAverageRows.clear();
+        snap.exited.clear();
+        snap.transient.clear();
+        snap.rowsStable = false;
+        snap.sampledProcesses = 0;
+        snap.slowTierProcesses = 0;
+        // Right after enabling extended counters no process has a baseline to take rates
+        // from, and after a window change carried-over averages cover the wrong span, so
+        // every process is refreshed once.
+        HistoryWindow window = (HistoryWindow)historyWindow.load(std::memory_order_relaxed);
+        bool refreshAll = manual || !adaptiveSampling.load(std::memory_order_relaxed)
+            || (snap.extended && !lastExtended) || window != lastWindow;
+
+        ULONGLONG currentTime;
+        FILETIME ftSystem;
+        GetSystemTimeAsFileTime(&ftSystem);
+        currentTime = ((ULONGLONG)ftSystem.dwHighDateTime << 32) | ftSystem.dwLowDateTime;
+        snap.sampleTime = currentTime;
+
+        bool captured;
+        {
+            ScopedTimer timer(profiler.Phase(PROFILE_CAPTURE));
+            captured = snapshot.Capture(snap.processes, names, snap.extended);
+        }
+        if (!captured) {
+            ScopedTimer timer(profiler.Phase(PROFILE_PER_PID));
+            snap.processes.clear();
+            perPid.SetExtended(snap.extended);
+            bool queried = perPid.Query(snap.processes, names, [&](DWORD pid, ULONGLONG createTime) {
+                const TrackedProcess* entry = tracked.Find({ pid, createTime });
+                return entry && SkipsTick(*entry, refreshAll);
+            });
+            if (!queried) return false;
+        }
+        snap.sequence = ++sequence;
+
+        RefreshTopology();
+        DWORD processorCount = topology.Get().logicalProcessors;
+        snap.historyWindow = window;
+        double processCpuSum = 0.0;
+        LONGLONG trackStart = QpcNow();
+        generation++;
+        snap.rowsStable = true;
+        // Entries stay where they are until the sweep, so the second pass can reach them.
+        tracked.Reserve(tracked.Size() + snap.processes.size());
+        rowEntries.resize(snap.processes.size());
+        summaryRows.clear();
+        summarySlots.clear();
+        for (size_t row = 0; row < snap.processes.size(); row++) {
+            ProcessInfo& info = snap.processes[row];
+            bool inserted;
+            TrackedProcess& entry = tracked.Insert({ info.pid, info.createTime }, inserted);
+            rowEntries[row] = &entry;
+
+            double cpuUsage = 0.0;
+            if (inserted) {
+                entry.historySlot = HISTORY_NO_SLOT;
+                if constexpr (keepsHistory) {
+                    entry.historySlot = history.Allocate();
+                    processRollups.Reset(entry.historySlot);
+                }
+                snap.addedRows.push_back((UINT)row);
+                snap.rowsStable = false;
+            } else if (info.lastCpuTime >= entry.lastCpuTime && currentTime > entry.lastSampleTime) {
+                ULONGLONG timeDiff = currentTime - entry.lastSampleTime;
+                ULONGLONG cpuDiff = info.lastCpuTime - entry.lastCpuTime;
+                cpuUsage = (cpuDiff * 100.0) / (timeDiff * processorCount);
+            }
+            info.historySlot = entry.historySlot;
+            bool skip = !inserted && SkipsTick(entry, refreshAll) && !IsActive(entry, cpuUsage, info.memoryUsage);
+
+            if (skip) {
+                entry.skippedTicks++;
+                snap.slowTierProcesses++;
+                // A process that was not refreshed shows the values of its last sample.
+                cpuUsage = info.cpuUsage = entry.cpuUsage;
+                info.metrics = entry.metrics;
+                CollectCounters(entry, info, snap.extended, false, 0.0);
+            } else {
+                info.cpuUsage = cpuUsage;
+                bool baseline = !inserted && lastExtended && currentTime > entry.lastSampleTime;
+                CollectCounters(entry, info, snap.extended, true, baseline ? (currentTime - entry.lastSampleTime) / 10000000.0 : 0.0);
+
+                // Everything since the previous sample of this process is folded in with
+                // the weight of the ticks it covers.
+                if constexpr (keepsHistory) {
+                    UINT ticks = inserted ? 1 : entry.skippedTicks + 1;
+                    history.Record(entry.historySlot, cpuUsage, info.memoryUsage, ticks);
+                    processRollups.Fold(entry.historySlot, currentTime, cpuUsage, info.memoryUsage, ticks);
+                    if (window == HISTORY_WINDOW_MINUTE) {
+                        summaryRows.push_back((UINT)row);
+                        summarySlots.push_back(entry.historySlot);
+                    } else {
+                        CollectHistory(entry, info, RollupStats(processRollups.Aggregate(entry.historySlot, currentTime, window)));
+                    }
+                }
+
+                if (inserted || IsActive(entry, cpuUsage, info.memoryUsage)) {
+                    entry.idleSamples = 0;
+                    entry.slowTier = false;
+                } else if (++entry.idleSamples >= TIER_IDLE_SAMPLES) {
+                    entry.slowTier = true;
+                }
+                entry.skippedTicks = 0;
+                entry.lastCpuTime = info.lastCpuTime;
+                entry.lastSampleTime = currentTime;
+                entry.sampledMemory = info.memoryUsage;
+                entry.cpuUsage = cpuUsage;
+                snap.sampledProcesses++;
+            }
+            // Marks the slot as occupied for later inserts as well as seen for the sweep.
+            entry.generation = generation;
+
+            processCpuSum += cpuUsage;
+            snap.totalMemoryUsage += info.memoryUsage;
+        }
+
+        // The minute-window statistics of every refreshed process, in one sweep.
+        summaryStats.resize(summarySlots.size());
+        history.SummarizeAll(summarySlots.data(), summarySlots.size(), summaryStats.data());
+        for (size_t i = 0; i < summaryRows.size(); i++) {
+            CollectHistory(*rowEntries[summaryRows[i]], snap.processes[summaryRows[i]], summaryStats[i]);
+        }
+
+        size_t nextAdded = 0;
+        for (size_t row = 0; row < snap.processes.size(); row++) {
+            const ProcessInfo& info = snap.processes[row];
+            TrackedProcess& entry = *rowEntries[row];
+            bool inserted = nextAdded < snap.addedRows.size() && snap.addedRows[nextAdded] == row;
+            if (inserted) nextAdded++;
+
+            ULONGLONG shownRow = AllMetrics::ShownHash<METRIC_CHANGE_ROW>(info);
+            ULONGLONG shownAverages = AllMetrics::ShownHash<METRIC_CHANGE_AVERAGES>(info);
+            if (!inserted) {
+                if (entry.shownRow != shownRow) snap.changedRows.push_back((UINT)row);
+                if (entry.shownAverages != shownAverages) snap.changedAverageRows.push_back((UINT)row);
+                if (entry.lastRow != row) snap.rowsStable = false;
+            }
+
+            entry.lastRow = (UINT)row;
+            entry.shownRow = shownRow;
+            entry.shownAverages = shownAverages;
+            entry.metrics = info.metrics;
+        }
+
+        tracked.Sweep(generation, [&](const TrackedProcess& entry) {
+            if (entry.historySlot != HISTORY_NO_SLOT) history.Release(entry.historySlot);
+            snap.exited.push_back(entry.key);
+        });
+        if (!snap.exited.empty()) snap.rowsStable = false;
+        lastExtended = snap.extended;
+        lastWindow = window;
+        processEvents.Collect(snap, names, snap.transient);
+        profiler.RecordSince(PROFILE_TRACK, trackStart);
+
+        // The kernel's counters include processes we could not open; the per-process sum is
+        // only a stand-in until the engine has two samples.
+        bool systemSampled;
+        {
+            ScopedTimer timer(profiler.Phase(PROFILE_SYSTEM_CPU));
+            systemSampled = systemCpu.Sample(snap);
+        }
+        if (!systemSampled) snap.totalCpuUsage = processCpuSum;
+        selfUsage.Sample(currentTime, processorCount, snap.selfCpuUsage, snap.selfWorkingSet, snap.selfPrivateBytes);
+
+        systemRollups.Fold(currentTime, snap.totalCpuUsage, snap.totalMemoryUsage);
+        RollupBucket system = systemRollups.Aggregate(currentTime, window);
+        snap.windowAvgCpu = system.AverageCpu();
+        snap.windowPeakCpu = system.cpuMax;
+        snap.windowAvgMemory = system.AverageMemory();
+        snap.windowPeakMemory = system.memoryMax;
+
+        // Rules run once over the finished snapshot; delivery never blocks the sampler.
+        ScopedTimer alertTimer(profiler.Phase(PROFILE_ALERTS));
+        alertEngine.Evaluate(snap, cpuAlertThreshold.load(std::memory_order_relaxed), (double)memoryAlertThreshold,
+            GetTickCount64(), snap.alerts, &alertFilter);
+        for (const auto& alert : snap.alerts) historyLogger.EnqueueAlert(alert);
+        return true;
+    }
+
+    void SaveHistoricalData(const Snapshot& snap) {
+        ScopedTimer timer(profiler.Phase(PROFILE_ENQUEUE));
+        historyLogger.Enqueue(snap);
+    }
+
+    void Publish(Snapshot* snap) {
+        Snapshot* previous = ready.exchange(snap, std::memory_order_acq_rel);
+        if (previous) {
+            // The front end has not picked up the previous snapshot yet; it was already notified.
+            Recycle(previous);
+        } else if (notify) {
+            notify(notifyContext);
+        }
+    }
+
+    // Arms the timer for the next tick. Deadlines advance in whole periods from the
+    // previous one, and ticks that have already passed are skipped, so a slow sample
+    // never shifts the cadence.
+    void ScheduleNext(LONGLONG& nextDeadline, bool ticked) {
+        LONGLONG period = qpcFrequency.QuadPart * intervalMs.load(std::memory_order_relaxed) / 1000;
+        LONGLONG now = QpcNow();
+        if (ticked || nextDeadline <= now) {
+            LONGLONG next = nextDeadline + period;
+            if (next <= now) {
+                LONGLONG missed = (now - next) / period + 1;
+                overruns += missed;
+                next += missed * period;
+            }
+            nextDeadline = next;
+        }
+        LARGE_INTEGER dueTime;
+        dueTime.QuadPart = -((nextDeadline - now) * 10000000 / qpcFrequency.QuadPart);
+        if (dueTime.QuadPart == 0) dueTime.QuadPart = -1;
+        SetWaitableTimer(hTimer, &dueTime, 0, NULL, NULL, FALSE);
+    }
+
+    void Run() {
+        HANDLE waits[] = { hStopEvent, hTimer, hSampleNowEvent, hReconfigureEvent };
+        LONGLONG nextDeadline = QpcNow();
+        bool ticked = true;
+
+        for (;;) {
+            if (ticked) DoSample(false);
+            ScheduleNext(nextDeadline, ticked);
+
+            DWORD result = WaitForMultipleObjects(4, waits, FALSE, INFINITE);
+            if (result == WAIT_OBJECT_0) break;
+            ticked = false;
+            if (result == WAIT_OBJECT_0 + 1) {
+                ticked = true;
+            } else if (result == WAIT_OBJECT_0 + 2) {
+                DoSample(true);
+            } else if (result == WAIT_OBJECT_0 + 3) {
+                // New interval: restart the cadence from now.
+                nextDeadline = QpcNow();
+                ticked = true;
+            } else {
+                break;
+            }
+        }
+        CancelWaitableTimer(hTimer);
+    }
+
+    void DoSample(bool manual) {
+        Snapshot* snap = spare.exchange(nullptr, std::memory_order_acq_rel);
+        if (!snap) snap = new Snapshot();
+        // The front end, the history and the export keep the previous snapshot; a tick with
+        // no processes would otherwise read as every process exiting.
+        if (!Sample(*snap, manual)) {
+            failedSamples++;
+            Recycle(snap);
+            return;
+        }
+        // Everything this thread allocated since the previous snapshot, including that
+        // snapshot's log hand-off. Once buffers and names have warmed up this stays at 0.
+        ULONGLONG allocated = ThreadAllocationCount();
+        snap->allocations = allocated - allocationMark;
+        allocationMark = allocated;
+        Publish(snap);
+        // Published snapshots are read-only for both threads, so writing from it is safe.
+        SaveHistoricalData(*snap);
+        ScopedTimer timer(profiler.Phase(PROFILE_EXPORT));
+        sharedSnapshot.Publish(*snap);
+    }
+
+    static DWORD WINAPI ThreadProc(LPVOID param) {
+        static_cast<Sampler*>(param)->Run();
+        return 0;
+    }
+
+public:
+    Sampler() {
+        QueryPerformanceFrequency(&qpcFrequency);
+        RefreshTopology();
+    }
+
+    ~Sampler() {
+        Stop();
+        delete ready.exchange(nullptr);
+        delete spare.exchange(nullptr);
+    }
+
+    bool Start(SnapshotReadyFn onSnapshot, void* context) {
+        notify = onSnapshot;
+        notifyContext = context;
+        hStopEvent = CreateEventW(NULL, TRUE, FALSE, NULL);
+        hSampleNowEvent = CreateEventW(NULL, FALSE, FALSE, NULL);
+        hReconfigureEvent = CreateEventW(NULL, FALSE, FALSE, NULL);
+        // High-resolution waitable timers (Windows 10 1803+) avoid the 15.6 ms tick quantum.
+        hTimer = CreateWaitableTimerExW(NULL, NULL, CREATE_WAITABLE_TIMER_HIGH_RESOLUTION, TIMER_ALL_ACCESS);
+        if (!hTimer) hTimer = CreateWaitableTimerExW(NULL, NULL, 0, TIMER_ALL_ACCESS);
+        if (!hStopEvent || !hSampleNowEvent || !hReconfigureEvent || !hTimer) return false;
+
+        historyLogger.Start(HISTORY_FILE_NAME, ALERT_LOG_FILE_NAME, &profiler.Phase(PROFILE_WRITER));
+        processEvents.Start();
+        // Not fatal: another monitor may already be exporting.
+        if (exportShared) sharedSnapshot.Open();
+        hThread = CreateThread(NULL, 0, ThreadProc, this, 0, NULL);
+        return hThread != NULL;
+    }
+
+    void Stop() {
+        if (hThread) {
+            SetEvent(hStopEvent);
+            WaitForSingleObject(hThread, INFINITE);
+            CloseHandle(hThread);
+            hThread = NULL;
+        }
+        processEvents.Stop();
+        sharedSnapshot.Close();
+        historyLogger.Stop();
+        HANDLE* handles[] = { &hStopEvent, &hSampleNowEvent, &hReconfigureEvent, &hTimer };
+        for (HANDLE* h : handles) {
+            if (*h) CloseHandle(*h);
+            *h = NULL;
+        }
+    }
+
+    // Any thread: the hardware may have changed (hot-add, VM resize, resume from sleep).
+    void InvalidateTopology() {
+        topology.Invalidate();
+    }
+
+    // Before Start, or from the sampler thread.
+    const SystemTopology& GetTopology() const {
+        return topology.Get();
+    }
+
+    void RequestSample() {
+        if (hSampleNowEvent) SetEvent(hSampleNowEvent);
+    }
+
+    void SetInterval(DWORD ms) {
+        if (ms < MIN_SAMPLE_INTERVAL_MS) ms = MIN_SAMPLE_INTERVAL_MS;
+        if (intervalMs.exchange(ms) != ms && hReconfigureEvent) SetEvent(hReconfigureEvent);
+    }
+
+    // Takes effect from the next sample; the window applies to the averages and peaks.
+    void SetHistoryWindow(HistoryWindow window) {
+        if (window < 0 || window >= HISTORY_WINDOW_COUNT) return;
+        historyWindow.store(window, std::memory_order_relaxed);
+    }
+
+    // Takes effect from the next sample. Adds private bytes, I/O, handles, threads and page
+    // faults (with rates) to every ProcessInfo, of those SampledMetrics has; a build with
+    // none of them never reads the counters.
+    void SetExtendedCounters(bool enabled) {
+        enabled = enabled && (SampledStorage::Uses(METRIC_COUNTER) || SampledStorage::Uses(METRIC_RATE));
+        extendedCounters.store(enabled, std::memory_order_relaxed);
+    }
+
+    // Before Start. When enabled (the default) every snapshot is also published into the
+    // SHARED_SNAPSHOT_NAME section for local readers; see shared_snapshot.h.
+    void SetSharedExport(bool enabled) {
+        exportShared = enabled;
+    }
+
+    // False if export was disabled, or the section is owned by another running monitor.
+    bool IsSharedExportActive() const {
+        return sharedSnapshot.IsOpen();
+    }
+
+    // Takes effect from the next sample. When enabled (the default), processes that stay
+    // idle for TIER_IDLE_SAMPLES samples are refreshed every TIER_SLOW_TICKS ticks instead
+    // of every tick; system-wide totals are still taken every tick.
+    void SetAdaptiveSampling(bool enabled) {
+        adaptiveSampling.store(enabled, std::memory_order_relaxed);
+    }
+
+    // Before Start. Limits the per-process alert rules to processes matching 'expression'
+    // (see process_filter.h); an empty one covers every process again. On failure the
+    // rules cover every process and 'error' says why.
+    bool SetAlertFilter(const wchar_t* expression, std::wstring& error) {
+        return alertFilter.Compile(expression, error);
+    }
+
+    void SetCpuAlertThreshold(double threshold) {
+        cpuAlertThreshold.store(threshold, std::memory_order_relaxed);
+    }
+
+    // Called on the front end's thread after the SnapshotReadyFn fired.
+    Snapshot* TakeLatest() {
+        return ready.exchange(nullptr, std::memory_order_acq_rel);
+    }
+
+    void Recycle(Snapshot* snap) {
+        Snapshot* expected = nullptr;
+        if (!spare.compare_exchange_strong(expected, snap, std::memory_order_acq_rel)) delete snap;
+    }
+
+    LoggerStats GetLoggerStats() const {
+        return historyLogger.GetStats();
+    }
+
+    const AlertEngine& GetAlertEngine() const {
+        return alertEngine;
+    }
+
+    ULONGLONG GetOverruns() const {
+        return overruns;
+    }
+
+    // Ticks on which no process source worked and nothing was published.
+    ULONGLONG GetFailedSamples() const {
+        return failedSamples;
+    }
+
+    // Any thread; 'active' is false when lifecycle events are unavailable and only polling runs.
+    ProcessEventStats GetProcessEventStats() const {
+        return processEvents.Stats();
+    }
+
+    const PidEnumeratorStats& GetPidEnumeratorStats() const {
+        return perPid.Stats();
+    }
+
+    // Any thread. Front ends record their own phases (PROFILE_LIST_VIEW and so on) here too.
+    Profiler& GetProfiler() {
+        return profiler;
+    }
+};
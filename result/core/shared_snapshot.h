@@ -0,0 +1,250 @@
+// Live export of the latest snapshot into a named shared-memory section, so local
+// consumers (dashboards, scripts) can read current usage at any rate without parsing
+// files or asking the monitor for anything.
+//
+// The section is named SHARED_SNAPSHOT_NAME and laid out as:
+//
+//   SharedSnapshotHeader
+//   SharedProcessRecord[recordCapacity]   the first processCount are valid
+//
+// All fields are little-endian with natural alignment; the static_asserts below pin the
+// sizes. Consumers should check magic, version, headerSize and recordSize, and find the
+// records at headerSize bytes from the start.
+//
+// Updates are guarded by a seqlock on 'sequence': the monitor makes it odd, rewrites the
+// totals and the records that changed, then makes it even again. A reader copies what it
+// needs between two reads of 'sequence' and keeps the copy only if both reads returned
+// the same even value; otherwise it retries. Readers never write to the section and
+// never block the monitor. Aligned 64-bit loads are atomic on x64 and ARM64.
+#pragma once
+
+#include <windows.h>
+#include <vector>
+#include <cstring>
+
+#include "process_types.h"
+
+#define SHARED_SNAPSHOT_NAME L"Local\\ProcessMonitorSnapshot"
+#define SHARED_SNAPSHOT_MAGIC 0x31534D50 // "PMS1"
+#define SHARED_SNAPSHOT_VERSION 1
+#define SHARED_SNAPSHOT_CAPACITY 8192    // records; later processes are counted but not exported
+#define SHARED_NAME_CHARS 64             // including the terminating NUL
+#define SHARED_READ_ATTEMPTS 1000
+
+struct SharedSnapshotHeader {
+    DWORD magic;
+    DWORD version;
+    DWORD headerSize;            // byte offset of the first record
+    DWORD recordSize;
+    DWORD recordCapacity;
+    DWORD writerPid;             // the monitor publishing into the section
+    volatile LONG64 sequence;    // odd while an update is in progress
+    // Everything below is covered by 'sequence'.
+    ULONGLONG snapshotSequence;  // increases by one per sample
+    ULONGLONG sampleTime;        // FILETIME, UTC
+    double totalCpuUsage;        // percent of all logical processors
+    double kernelCpuUsage;
+    ULONGLONG totalMemoryUsage;  // bytes, sum of working sets
+    DWORD processCount;          // valid records
+    DWORD totalProcesses;        // processes in the snapshot; above processCount when truncated
+    DWORD historyWindow;         // HistoryWindow the records' averages cover
+    DWORD reserved;
+};
+
+struct SharedProcessRecord {
+    DWORD pid;
+    DWORD parentPid;
+    ULONGLONG createTime;        // FILETIME; with pid identifies the process
+    ULONGLONG memoryUsage;       // working set, bytes
+    double cpuUsage;             // percent of all logical processors
+    double avgCpuUsage;          // over historyWindow
+    double avgMemoryUsage;
+    double peakCpuUsage;
+    DWORD sessionId;
+    DWORD nameLength;            // characters, without the NUL
+    WCHAR name[SHARED_NAME_CHARS];
+};
+
+static_assert(sizeof(SharedSnapshotHeader) == 88, "shared snapshot header layout");
+static_assert(sizeof(SharedProcessRecord) == 192, "shared snapshot record layout");
+
+inline SIZE_T SharedSnapshotBytes(DWORD capacity) {
+    return sizeof(SharedSnapshotHeader) + (SIZE_T)capacity * sizeof(SharedProcessRecord);
+}
+
+// Sampler thread only. After the first full write, a sample whose rows are where they
+// were in the previous one rewrites only its changed rows.
+class SharedSnapshotWriter {
+private:
+    HANDLE hMapping = NULL;
+    SharedSnapshotHeader* header = nullptr;
+    SharedProcessRecord* records = nullptr;
+    ULONGLONG lastSequence = 0;
+    bool written = false;
+
+    // A section left open by a reader after its monitor exited may be taken over.
+    static bool WriterAlive(DWORD pid) {
+        if (!pid || pid == GetCurrentProcessId()) return false;
+        HANDLE hProcess = OpenProcess(SYNCHRONIZE, FALSE, pid);
+        if (!hProcess) return false;
+        bool alive = WaitForSingleObject(hProcess, 0) == WAIT_TIMEOUT;
+        CloseHandle(hProcess);
+        return alive;
+    }
+
+    static void Fill(SharedProcessRecord& record, const ProcessInfo& proc) {
+        record.pid = proc.pid;
+        record.parentPid = proc.parentPid;
+        record.createTime = proc.createTime;
+        record.sessionId = proc.sessionId;
+        size_t length = proc.name->size() < SHARED_NAME_CHARS - 1 ? proc.name->size() : SHARED_NAME_CHARS - 1;
+        memcpy(record.name, proc.name->data(), length * sizeof(WCHAR));
+        record.name[length] = L'\0';
+        record.nameLength = (DWORD)length;
+        FillUsage(record, proc);
+        FillAverages(record, proc);
+    }
+
+    static void FillUsage(SharedProcessRecord& record, const ProcessInfo& proc) {
+        record.cpuUsage = proc.cpuUsage;
+        record.memoryUsage = proc.memoryUsage;
+    }
+
+    static void FillAverages(SharedProcessRecord& record, const ProcessInfo& proc) {
+        // The layout keeps the fields when the build does not collect the metrics.
+        record.avgCpuUsage = MetricValueOr<MetricAvgCpu>(proc, 0.0);
+        record.avgMemoryUsage = MetricValueOr<MetricAvgMemory>(proc, 0.0);
+        record.peakCpuUsage = MetricValueOr<MetricPeakCpu>(proc, 0.0);
+    }
+
+public:
+    SharedSnapshotWriter() {}
+    SharedSnapshotWriter(const SharedSnapshotWriter&) = delete;
+    SharedSnapshotWriter& operator=(const SharedSnapshotWriter&) = delete;
+
+    ~SharedSnapshotWriter() {
+        Close();
+    }
+
+    // Returns false if the section cannot be created or another running monitor is
+    // already publishing into it.
+    bool Open(const wchar_t* name = SHARED_SNAPSHOT_NAME) {
+        Close();
+        SIZE_T bytes = SharedSnapshotBytes(SHARED_SNAPSHOT_CAPACITY);
+        hMapping = CreateFileMappingW(INVALID_HANDLE_VALUE, NULL, PAGE_READWRITE,
+            (DWORD)((ULONGLONG)bytes >> 32), (DWORD)bytes, name);
+        if (!hMapping) return false;
+        bool existed = GetLastError() == ERROR_ALREADY_EXISTS;
+        header = static_cast<SharedSnapshotHeader*>(MapViewOfFile(hMapping, FILE_MAP_WRITE, 0, 0, bytes));
+        if (!header || (existed && (header->magic != SHARED_SNAPSHOT_MAGIC || WriterAlive(header->writerPid)))) {
+            Close();
+            return false;
+        }
+        records = reinterpret_cast<SharedProcessRecord*>(header + 1);
+        // Readers see an odd sequence until the first Publish completes.
+        if (!(header->sequence & 1)) InterlockedIncrement64(&header->sequence);
+        header->magic = SHARED_SNAPSHOT_MAGIC;
+        header->version = SHARED_SNAPSHOT_VERSION;
+        header->headerSize = sizeof(SharedSnapshotHeader);
+        header->recordSize = sizeof(SharedProcessRecord);
+        header->recordCapacity = SHARED_SNAPSHOT_CAPACITY;
+        header->writerPid = GetCurrentProcessId();
+        written = false;
+        return true;
+    }
+
+    void Close() {
+        if (header) UnmapViewOfFile(header);
+        if (hMapping) CloseHandle(hMapping);
+        header = nullptr;
+        records = nullptr;
+        hMapping = NULL;
+    }
+
+    bool IsOpen() const {
+        return header != nullptr;
+    }
+
+    void Publish(const Snapshot& snap) {
+        if (!header) return;
+        DWORD count = snap.processes.size() < SHARED_SNAPSHOT_CAPACITY ? (DWORD)snap.processes.size() : SHARED_SNAPSHOT_CAPACITY;
+        bool incremental = written && snap.rowsStable && snap.sequence == lastSequence + 1 && count == header->processCount;
+
+        if (!(header->sequence & 1)) InterlockedIncrement64(&header->sequence);
+        header->snapshotSequence = snap.sequence;
+        header->sampleTime = snap.sampleTime;
+        header->totalCpuUsage = snap.totalCpuUsage;
+        header->kernelCpuUsage = snap.kernelCpuUsage;
+        header->totalMemoryUsage = snap.totalMemoryUsage;
+        header->processCount = count;
+        header->totalProcesses = (DWORD)snap.processes.size();
+        header->historyWindow = (DWORD)snap.historyWindow;
+        if (incremental) {
+            for (UINT row : snap.changedRows) {
+                if (row < count) FillUsage(records[row], snap.processes[row]);
+            }
+            for (UINT row : snap.changedAverageRows) {
+                if (row < count) FillAverages(records[row], snap.processes[row]);
+            }
+        } else {
+            for (DWORD row = 0; row < count; row++) Fill(records[row], snap.processes[row]);
+        }
+        InterlockedIncrement64(&header->sequence);
+        lastSequence = snap.sequence;
+        written = true;
+    }
+};
+
+// Any process: maps the section read-only and copies consistent snapshots out of it.
+class SharedSnapshotReader {
+private:
+    HANDLE hMapping = NULL;
+    const SharedSnapshotHeader* header = nullptr;
+
+    LONG64 Sequence() const {
+        LONG64 sequence = header->sequence;
+        MemoryBarrier();
+        return sequence;
+    }
+
+public:
+    SharedSnapshotReader() {}
+    SharedSnapshotReader(const SharedSnapshotReader&) = delete;
+    SharedSnapshotReader& operator=(const SharedSnapshotReader&) = delete;
+
+    ~SharedSnapshotReader() {
+        if (header) UnmapViewOfFile(header);
+        if (hMapping) CloseHandle(hMapping);
+    }
+
+    // Fails if no monitor has created the section or its layout is not this version's.
+    bool Open(const wchar_t* name = SHARED_SNAPSHOT_NAME) {
+        hMapping = OpenFileMappingW(FILE_MAP_READ, FALSE, name);
+        if (!hMapping) return false;
+        header = static_cast<const SharedSnapshotHeader*>(MapViewOfFile(hMapping, FILE_MAP_READ, 0, 0, 0));
+        if (!header) return false;
+        return header->magic == SHARED_SNAPSHOT_MAGIC && header->version == SHARED_SNAPSHOT_VERSION
+            && header->headerSize == sizeof(SharedSnapshotHeader) && header->recordSize == sizeof(SharedProcessRecord);
+    }
+
+    // Copies the header and the valid records. Returns false if the monitor kept the
+    // section busy for SHARED_READ_ATTEMPTS tries, or has not published yet.
+    bool Read(SharedSnapshotHeader& totals, std::vector<SharedProcessRecord>& out) const {
+        const SharedProcessRecord* records = reinterpret_cast<const SharedProcessRecord*>(
+            reinterpret_cast<const BYTE*>(header) + header->headerSize);
+        for (int attempt = 0; attempt < SHARED_READ_ATTEMPTS; attempt++) {
+            LONG64 before = Sequence();
+            if (before & 1) {
+                YieldProcessor();
+                continue;
+            }
+            memcpy(&totals, header, sizeof(totals));
+            DWORD count = totals.processCount < header->recordCapacity ? totals.processCount : header->recordCapacity;
+            out.resize(count);
+            if (count) memcpy(out.data(), records, count * sizeof(SharedProcessRecord));
+            MemoryBarrier();
+            if (Sequence() == before) return true;
+        }
+        return false;
+    }
+};
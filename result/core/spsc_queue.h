@@ -0,0 +1,62 @@
+// Lock-free hand-off between one producer thread and one consumer thread.
+#pragma once
+
+#include <vector>
+#include <atomic>
+#include <algorithm>
+
+// Bounded single-producer/single-consumer ring. The producer publishes a whole batch
+// with one release store, so the consumer never observes half of a batch.
+template <typename T>
+class SpscQueue {
+private:
+    std::vector<T> slots;
+    size_t mask;
+    alignas(64) std::atomic<size_t> head{ 0 }; // next slot the consumer reads
+    alignas(64) std::atomic<size_t> tail{ 0 }; // next slot the producer writes
+
+public:
+    explicit SpscQueue(size_t capacity) : slots(capacity), mask(capacity - 1) {}
+
+    size_t Capacity() const {
+        return slots.size();
+    }
+
+    size_t Size() const {
+        return tail.load(std::memory_order_acquire) - head.load(std::memory_order_acquire);
+    }
+
+    // Producer only. Either the whole batch fits and is published, or nothing is.
+    bool TryPush(const T* items, size_t count) {
+        size_t t = tail.load(std::memory_order_relaxed);
+        if (slots.size() - (t - head.load(std::memory_order_acquire)) < count) return false;
+        size_t first = t & mask;
+        size_t run = slots.size() - first < count ? slots.size() - first : count;
+        std::copy(items, items + run, slots.data() + first);
+        std::copy(items + run, items + count, slots.data());
+        tail.store(t + count, std::memory_order_release);
+        return true;
+    }
+
+    // Consumer only.
+    bool TryPop(T& item) {
+        size_t h = head.load(std::memory_order_relaxed);
+        if (h == tail.load(std::memory_order_acquire)) return false;
+        item = slots[h & mask];
+        head.store(h + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Consumer only. Copies 'count' items in at most two contiguous runs, or nothing if
+    // fewer are queued.
+    bool Pop(T* items, size_t count) {
+        size_t h = head.load(std::memory_order_relaxed);
+        if (tail.load(std::memory_order_acquire) - h < count) return false;
+        size_t first = h & mask;
+        size_t run = slots.size() - first < count ? slots.size() - first : count;
+        std::copy(slots.data() + first, slots.data() + first + run, items);
+        std::copy(slots.data(), slots.data() + (count - run), items + run);
+        head.store(h + count, std::memory_order_release);
+        return true;
+    }
+};
@@ -0,0 +1,134 @@
+// System-wide and per-core CPU utilisation from the kernel's own idle/kernel/user
+// counters, independent of which processes could be opened.
+#pragma once
+
+#include <windows.h>
+#include <winternl.h>
+#include <vector>
+
+#include "process_types.h"
+
+#define SYSTEM_PROCESSOR_PERFORMANCE_CLASS ((SYSTEM_INFORMATION_CLASS)8)
+
+// SystemProcessorPerformanceInformation record; one per logical processor of a group.
+struct NtProcessorTimes {
+    LARGE_INTEGER IdleTime;
+    LARGE_INTEGER KernelTime;       // includes IdleTime, DPC and interrupt time
+    LARGE_INTEGER UserTime;
+    LARGE_INTEGER DpcTime;
+    LARGE_INTEGER InterruptTime;
+    ULONG InterruptCount;
+};
+
+typedef NTSTATUS (NTAPI* NtQuerySystemInformationExFn)(SYSTEM_INFORMATION_CLASS, PVOID, ULONG, PVOID, ULONG, PULONG);
+
+// Samples GetSystemTimes and the per-processor counters once per refresh; both are a
+// fixed-cost query whatever the process count. Processors are queried group by group
+// through NtQuerySystemInformationEx so hosts with more than 64 logical CPUs are covered;
+// without it only the calling thread's group is reported per core.
+class SystemCpuEngine {
+private:
+    typedef NTSTATUS (NTAPI* QueryFn)(SYSTEM_INFORMATION_CLASS, PVOID, ULONG, PULONG);
+
+    QueryFn queryFn = NULL;
+    NtQuerySystemInformationExFn queryExFn = NULL;
+    std::vector<DWORD> groupSizes;
+    std::vector<NtProcessorTimes> current;
+    std::vector<NtProcessorTimes> previous;
+    ULONGLONG lastIdle = 0;
+    ULONGLONG lastKernel = 0;
+    ULONGLONG lastUser = 0;
+    bool havePrevious = false;
+    bool haveCores = false;
+
+    static ULONGLONG ToUInt64(const FILETIME& ft) {
+        return ((ULONGLONG)ft.dwHighDateTime << 32) | ft.dwLowDateTime;
+    }
+
+    static double Busy(ULONGLONG idle, ULONGLONG total) {
+        if (total == 0 || idle > total) return 0.0;
+        return (total - idle) * 100.0 / total;
+    }
+
+    bool ReadCores() {
+        if (current.empty()) return false;
+        NtProcessorTimes* cursor = current.data();
+        for (size_t group = 0; group < groupSizes.size(); group++) {
+            ULONG size = (ULONG)(groupSizes[group] * sizeof(NtProcessorTimes));
+            ULONG returned = 0;
+            NTSTATUS status;
+            if (queryExFn) {
+                USHORT groupNumber = (USHORT)group;
+                status = queryExFn(SYSTEM_PROCESSOR_PERFORMANCE_CLASS, &groupNumber, sizeof(groupNumber), cursor, size, &returned);
+            } else {
+                status = queryFn(SYSTEM_PROCESSOR_PERFORMANCE_CLASS, cursor, size, &returned);
+            }
+            if (!NT_SUCCESS(status) || returned != size) return false;
+            cursor += groupSizes[group];
+        }
+        return true;
+    }
+
+public:
+    // 'groupSizes' holds the active logical processor count of each processor group.
+    void Configure(const std::vector<DWORD>& sizes) {
+        HMODULE ntdll = GetModuleHandleW(L"ntdll.dll");
+        if (ntdll) {
+            queryFn = reinterpret_cast<QueryFn>(GetProcAddress(ntdll, "NtQuerySystemInformation"));
+            queryExFn = reinterpret_cast<NtQuerySystemInformationExFn>(GetProcAddress(ntdll, "NtQuerySystemInformationEx"));
+        }
+        groupSizes = sizes;
+        if (!queryExFn && groupSizes.size() > 1) groupSizes.resize(1);
+        size_t total = 0;
+        for (DWORD size : groupSizes) total += size;
+        current.assign(queryFn ? total : 0, NtProcessorTimes());
+        previous.clear();
+        haveCores = false;
+    }
+
+    // Fills the system CPU fields of 'snap'. Returns false until two samples exist or if
+    // GetSystemTimes fails, in which case the caller keeps its own estimate.
+    bool Sample(Snapshot& snap) {
+        snap.coreUsage.clear();
+        snap.maxCoreUsage = 0.0;
+        snap.coreImbalance = 0.0;
+
+        bool coresRead = ReadCores();
+        if (coresRead && haveCores && previous.size() == current.size()) {
+            double sum = 0.0;
+            for (size_t i = 0; i < current.size(); i++) {
+                ULONGLONG idle = current[i].IdleTime.QuadPart - previous[i].IdleTime.QuadPart;
+                ULONGLONG total = (current[i].KernelTime.QuadPart - previous[i].KernelTime.QuadPart)
+                    + (current[i].UserTime.QuadPart - previous[i].UserTime.QuadPart);
+                double busy = Busy(idle, total);
+                snap.coreUsage.push_back(busy);
+                sum += busy;
+                if (busy > snap.maxCoreUsage) snap.maxCoreUsage = busy;
+            }
+            // How far the hottest core runs above the mean core; 0 means perfectly even.
+            snap.coreImbalance = snap.maxCoreUsage - sum / current.size();
+        }
+        if (coresRead) {
+            previous.swap(current);
+            current.resize(previous.size());
+            haveCores = true;
+        }
+
+        FILETIME ftIdle, ftKernel, ftUser;
+        if (!GetSystemTimes(&ftIdle, &ftKernel, &ftUser)) return false;
+        ULONGLONG idle = ToUInt64(ftIdle), kernel = ToUInt64(ftKernel), user = ToUInt64(ftUser);
+        bool valid = havePrevious && kernel >= lastKernel && user >= lastUser && idle >= lastIdle;
+        if (valid) {
+            ULONGLONG idleDiff = idle - lastIdle;
+            ULONGLONG kernelDiff = kernel - lastKernel;
+            ULONGLONG total = kernelDiff + (user - lastUser);
+            snap.totalCpuUsage = Busy(idleDiff, total);
+            snap.kernelCpuUsage = total && kernelDiff >= idleDiff ? (kernelDiff - idleDiff) * 100.0 / total : 0.0;
+        }
+        lastIdle = idle;
+        lastKernel = kernel;
+        lastUser = user;
+        havePrevious = true;
+        return valid;
+    }
+};
@@ -0,0 +1,77 @@
+// Processor groups, NUMA nodes and physical memory, read once and re-read only when the
+// hardware may have changed, so the sampling loop itself makes no topology calls.
+#pragma once
+
+#include <windows.h>
+#include <vector>
+#include <atomic>
+
+#define TOPOLOGY_MAX_AGE_MS 300000 // re-read at least this often, for hosts without window messages
+
+struct SystemTopology {
+    DWORD logicalProcessors = 1;       // across all processor groups
+    std::vector<DWORD> groupSizes;     // active logical processors per group
+    ULONG numaNodes = 1;
+    ULONGLONG totalPhysicalMemory = 0;
+
+    bool operator==(const SystemTopology& other) const {
+        return logicalProcessors == other.logicalProcessors && groupSizes == other.groupSizes
+            && numaNodes == other.numaNodes && totalPhysicalMemory == other.totalPhysicalMemory;
+    }
+};
+
+// Owned by the sampler thread. Any thread may call Invalidate (the GUI does on
+// WM_DEVICECHANGE and WM_POWERBROADCAST); the next refresh then re-reads the topology.
+class TopologyCache {
+private:
+    SystemTopology topology;
+    std::atomic<bool> dirty{ true };
+    ULONGLONG loadedMs = 0;
+
+    static SystemTopology Read() {
+        SystemTopology result;
+        WORD groups = GetActiveProcessorGroupCount();
+        DWORD total = 0;
+        for (WORD group = 0; group < groups; group++) {
+            DWORD count = GetActiveProcessorCount(group);
+            result.groupSizes.push_back(count);
+            total += count;
+        }
+        if (total == 0) {
+            SYSTEM_INFO sysInfo;
+            GetSystemInfo(&sysInfo);
+            total = sysInfo.dwNumberOfProcessors;
+            result.groupSizes.assign(1, total);
+        }
+        result.logicalProcessors = total;
+
+        ULONG highestNode = 0;
+        if (GetNumaHighestNodeNumber(&highestNode)) result.numaNodes = highestNode + 1;
+
+        MEMORYSTATUSEX memInfo;
+        memInfo.dwLength = sizeof(memInfo);
+        if (GlobalMemoryStatusEx(&memInfo)) result.totalPhysicalMemory = memInfo.ullTotalPhys;
+        return result;
+    }
+
+public:
+    void Invalidate() {
+        dirty.store(true, std::memory_order_release);
+    }
+
+    // Re-reads the topology if it was invalidated or has aged out; returns true if it
+    // changed (always true for the first call).
+    bool Refresh(ULONGLONG nowMs) {
+        bool first = loadedMs == 0;
+        if (!dirty.exchange(false, std::memory_order_acq_rel) && nowMs - loadedMs < TOPOLOGY_MAX_AGE_MS) return false;
+        loadedMs = nowMs ? nowMs : 1;
+        SystemTopology fresh = Read();
+        if (!first && fresh == topology) return false;
+        topology = fresh;
+        return true;
+    }
+
+    const SystemTopology& Get() const {
+        return topology;
+    }
+};
@@ -0,0 +1,369 @@
+// Compact binary wire format for streaming snapshots from collectors to an aggregator.
+// A stream is a sequence of frames; each frame carries a batch of messages, optionally
+// XPRESS-compressed as a whole. Messages reuse the sampler's diff: after one full table
+// every sample sends only the processes that were added, changed or exited, and names
+// go over the wire once per connection.
+//
+//   frame    WireFrameHeader, then payloadBytes of (possibly compressed) messages
+//   message  varint kind, then
+//              WIRE_HELLO        host name, logical processors
+//              WIRE_SAMPLE       sampleTime, cpu (hundredths of a percent), memory, records
+//              WIRE_FULL_SAMPLE  the same; the receiver first forgets the host's table and names
+//   record   varint kind, then
+//              WIRE_RECORD_NAME     id (the next unused one), name
+//              WIRE_RECORD_ADDED    pid, createTime, name id, cpu, memory
+//              WIRE_RECORD_CHANGED  pid, cpu, memory
+//              WIRE_RECORD_EXITED   pid
+//              WIRE_RECORD_END
+//
+// Integers are unsigned LEB128 varints; strings are a varint length and that many
+// varint UTF-16 code units, so ASCII names cost one byte per character. Exits are sent
+// before additions, so a PID reused within one sample is unambiguous per host.
+#pragma once
+
+#include <windows.h>
+#include <compressapi.h>
+#include <string>
+#include <vector>
+#include <unordered_map>
+
+#include "process_types.h"
+#include "name_pool.h"
+
+#pragma comment(lib, "cabinet.lib")
+
+#define WIRE_MAGIC 0x31574D50               // "PMW1"
+#define WIRE_VERSION 2
+#define WIRE_FLAG_COMPRESSED 0x0001
+#define WIRE_MAX_FRAME_BYTES (16 * 1024 * 1024)
+#define WIRE_MAX_NAME_CHARS 1024
+#define WIRE_MAX_NAMES (1 << 20)
+#define WIRE_DEFAULT_PORT 47211
+
+enum WireMessage {
+    WIRE_HELLO = 1,
+    WIRE_SAMPLE = 2,
+    WIRE_FULL_SAMPLE = 3
+};
+
+enum WireRecord {
+    WIRE_RECORD_END = 0,
+    WIRE_RECORD_NAME = 1,
+    WIRE_RECORD_ADDED = 2,
+    WIRE_RECORD_CHANGED = 3,
+    WIRE_RECORD_EXITED = 4
+};
+
+#pragma pack(push, 1)
+struct WireFrameHeader {
+    DWORD magic;
+    WORD version;
+    WORD flags;
+    DWORD payloadBytes;     // as sent
+    DWORD rawBytes;         // after decompression
+    DWORD messages;
+};
+#pragma pack(pop)
+
+inline ULONGLONG WireCpu(double percent) {
+    return percent > 0.0 ? (ULONGLONG)(percent * 100.0 + 0.5) : 0;
+}
+
+class WireWriter {
+private:
+    std::vector<BYTE>& out;
+
+public:
+    explicit WireWriter(std::vector<BYTE>& buffer) : out(buffer) {}
+
+    void Varint(ULONGLONG value) {
+        while (value >= 0x80) {
+            out.push_back((BYTE)(value | 0x80));
+            value >>= 7;
+        }
+        out.push_back((BYTE)value);
+    }
+
+    void String(const std::wstring& text) {
+        Varint(text.size());
+        for (wchar_t c : text) Varint((WORD)c);
+    }
+};
+
+// Bounds-checked; once anything is out of range every later read fails too.
+class WireReader {
+private:
+    const BYTE* next;
+    const BYTE* end;
+    bool ok = true;
+
+public:
+    WireReader(const BYTE* data, size_t size) : next(data), end(data + size) {}
+
+    bool Varint(ULONGLONG& value) {
+        value = 0;
+        for (int shift = 0; ok && shift < 64; shift += 7) {
+            if (next == end) break;
+            BYTE b = *next++;
+            value |= (ULONGLONG)(b & 0x7F) << shift;
+            if (!(b & 0x80)) return true;
+        }
+        ok = false;
+        return false;
+    }
+
+    bool String(std::wstring& text) {
+        ULONGLONG length;
+        if (!Varint(length) || length > WIRE_MAX_NAME_CHARS) return ok = false;
+        text.resize((size_t)length);
+        for (size_t i = 0; i < text.size(); i++) {
+            ULONGLONG c;
+            if (!Varint(c) || c > 0xFFFF) return ok = false;
+            text[i] = (wchar_t)c;
+        }
+        return true;
+    }
+
+    bool AtEnd() const {
+        return ok && next == end;
+    }
+};
+
+// Sender side, one per connection: remembers which names the receiver already knows and
+// whether the next sample can be a delta.
+class WireEncoder {
+private:
+    std::unordered_map<const std::wstring*, ULONGLONG> nameIds;
+    ULONGLONG lastSequence = 0;
+    bool resync = true;
+
+    ULONGLONG NameId(WireWriter& writer, const std::wstring* name) {
+        auto it = nameIds.find(name);
+        if (it != nameIds.end()) return it->second;
+        ULONGLONG id = nameIds.size();
+        nameIds.emplace(name, id);
+        writer.Varint(WIRE_RECORD_NAME);
+        writer.Varint(id);
+        writer.String(*name);
+        return id;
+    }
+
+    void Added(WireWriter& writer, const ProcessInfo& proc) {
+        ULONGLONG nameId = NameId(writer, proc.name);
+        writer.Varint(WIRE_RECORD_ADDED);
+        writer.Varint(proc.pid);
+        writer.Varint(proc.createTime);
+        writer.Varint(nameId);
+        writer.Varint(WireCpu(proc.cpuUsage));
+        writer.Varint(proc.memoryUsage);
+    }
+
+public:
+    // A new connection, or the receiver missed something: the next sample is a full table.
+    void Reset() {
+        resync = true;
+    }
+
+    void Hello(const std::wstring& host, DWORD logicalProcessors, std::vector<BYTE>& out) {
+        WireWriter writer(out);
+        writer.Varint(WIRE_HELLO);
+        writer.String(host);
+        writer.Varint(logicalProcessors);
+    }
+
+    // A gap in snapshot sequence numbers means the diff no longer applies to what the
+    // receiver holds, so that sample goes out whole.
+    void Sample(const Snapshot& snap, std::vector<BYTE>& out) {
+        bool full = resync || snap.sequence != lastSequence + 1;
+        lastSequence = snap.sequence;
+        resync = false;
+
+        WireWriter writer(out);
+        writer.Varint(full ? WIRE_FULL_SAMPLE : WIRE_SAMPLE);
+        writer.Varint(snap.sampleTime);
+        writer.Varint(WireCpu(snap.totalCpuUsage));
+        writer.Varint(snap.totalMemoryUsage);
+        if (full) {
+            nameIds.clear();
+            for (const auto& proc : snap.processes) Added(writer, proc);
+        } else {
+            for (const auto& key : snap.exited) {
+                writer.Varint(WIRE_RECORD_EXITED);
+                writer.Varint(key.pid);
+            }
+            for (UINT row : snap.addedRows) Added(writer, snap.processes[row]);
+            for (UINT row : snap.changedRows) {
+                const ProcessInfo& proc = snap.processes[row];
+                writer.Varint(WIRE_RECORD_CHANGED);
+                writer.Varint(proc.pid);
+                writer.Varint(WireCpu(proc.cpuUsage));
+                writer.Varint(proc.memoryUsage);
+            }
+        }
+        writer.Varint(WIRE_RECORD_END);
+    }
+};
+
+struct RemoteProcess {
+    ULONGLONG createTime;
+    const std::wstring* name;   // interned in the aggregator's NamePool
+    double cpuUsage;
+    ULONGLONG memoryUsage;
+};
+
+// Receiver side, one per connection: the host's current table, rebuilt from the stream.
+class WireDecoder {
+private:
+    NamePool& pool;
+    std::vector<const std::wstring*> names;   // by wire id
+    std::wstring text;
+
+public:
+    std::wstring host;
+    DWORD logicalProcessors = 1;    // the host's totalCpuUsage is a percentage of these
+    std::unordered_map<DWORD, RemoteProcess> processes;
+    ULONGLONG sampleTime = 0;
+    double totalCpuUsage = 0.0;
+    ULONGLONG totalMemoryUsage = 0;
+    ULONGLONG samples = 0;
+
+    explicit WireDecoder(NamePool& namePool) : pool(namePool) {}
+
+    // Applies a frame's decompressed messages. False means the stream is corrupt and the
+    // connection should be dropped.
+    bool Apply(const BYTE* data, size_t size, DWORD messages) {
+        WireReader reader(data, size);
+        for (DWORD m = 0; m < messages; m++) {
+            ULONGLONG kind;
+            if (!reader.Varint(kind)) return false;
+            if (kind == WIRE_HELLO) {
+                ULONGLONG processors;
+                if (!reader.String(host) || !reader.Varint(processors) || processors > MAXDWORD) return false;
+                logicalProcessors = processors ? (DWORD)processors : 1;
+                continue;
+            }
+            if (kind != WIRE_SAMPLE && kind != WIRE_FULL_SAMPLE) return false;
+
+            ULONGLONG cpu;
+            if (!reader.Varint(sampleTime) || !reader.Varint(cpu) || !reader.Varint(totalMemoryUsage)) return false;
+            totalCpuUsage = cpu / 100.0;
+            if (kind == WIRE_FULL_SAMPLE) {
+                processes.clear();
+                names.clear();
+            }
+            for (;;) {
+                ULONGLONG record, pid, value, createTime, nameId, memory;
+                if (!reader.Varint(record)) return false;
+                if (record == WIRE_RECORD_END) break;
+                switch (record) {
+                case WIRE_RECORD_NAME:
+                    if (!reader.Varint(value) || value != names.size() || value >= WIRE_MAX_NAMES) return false;
+                    if (!reader.String(text)) return false;
+                    names.push_back(pool.Intern(text));
+                    break;
+                case WIRE_RECORD_ADDED:
+                    if (!reader.Varint(pid) || !reader.Varint(createTime) || !reader.Varint(nameId)
+                        || !reader.Varint(cpu) || !reader.Varint(memory) || nameId >= names.size()) return false;
+                    processes[(DWORD)pid] = { createTime, names[(size_t)nameId], cpu / 100.0, memory };
+                    break;
+                case WIRE_RECORD_CHANGED: {
+                    if (!reader.Varint(pid) || !reader.Varint(cpu) || !reader.Varint(memory)) return false;
+                    auto it = processes.find((DWORD)pid);
+                    if (it == processes.end()) return false;
+                    it->second.cpuUsage = cpu / 100.0;
+                    it->second.memoryUsage = memory;
+                    break;
+                }
+                case WIRE_RECORD_EXITED:
+                    if (!reader.Varint(pid)) return false;
+                    processes.erase((DWORD)pid);
+                    break;
+                default:
+                    return false;
+                }
+            }
+            samples++;
+        }
+        return reader.AtEnd();
+    }
+};
+
+// XPRESS through the Windows Compression API (Windows 8+). Without it frames go raw.
+class WireCompressor {
+private:
+    COMPRESSOR_HANDLE compressor = NULL;
+    DECOMPRESSOR_HANDLE decompressor = NULL;
+
+public:
+    ~WireCompressor() {
+        if (compressor) CloseCompressor(compressor);
+        if (decompressor) CloseDecompressor(decompressor);
+    }
+
+    // False when the data did not shrink or compression is unavailable; send it raw then.
+    bool Compress(const std::vector<BYTE>& in, std::vector<BYTE>& out) {
+        if (!compressor && !CreateCompressor(COMPRESS_ALGORITHM_XPRESS, NULL, &compressor)) {
+            compressor = NULL;
+            return false;
+        }
+        out.resize(in.size());
+        SIZE_T size = 0;
+        if (in.empty() || !::Compress(compressor, in.data(), in.size(), out.data(), out.size(), &size) || size >= in.size()) {
+            return false;
+        }
+        out.resize(size);
+        return true;
+    }
+
+    bool Decompress(const BYTE* data, size_t size, size_t rawBytes, std::vector<BYTE>& out) {
+        if (!decompressor && !CreateDecompressor(COMPRESS_ALGORITHM_XPRESS, NULL, &decompressor)) {
+            decompressor = NULL;
+            return false;
+        }
+        out.resize(rawBytes);
+        SIZE_T written = 0;
+        return ::Decompress(decompressor, data, size, out.data(), out.size(), &written) && written == rawBytes;
+    }
+};
+
+// Collects messages into one frame so a batch costs one header and one send.
+class WireFramer {
+private:
+    std::vector<BYTE> payload;
+    std::vector<BYTE> compressed;
+    DWORD messages = 0;
+
+public:
+    // Message bodies are appended here; call Commit after each one.
+    std::vector<BYTE>& Buffer() {
+        return payload;
+    }
+
+    void Commit() {
+        messages++;
+    }
+
+    DWORD Messages() const {
+        return messages;
+    }
+
+    void Discard() {
+        payload.clear();
+        messages = 0;
+    }
+
+    // Writes the header and payload to 'frame' and starts a new batch.
+    void Finish(std::vector<BYTE>& frame, WireCompressor* compressor) {
+        WireFrameHeader header = { WIRE_MAGIC, WIRE_VERSION, 0, 0, (DWORD)payload.size(), messages };
+        const std::vector<BYTE>* body = &payload;
+        if (compressor && compressor->Compress(payload, compressed)) {
+            header.flags |= WIRE_FLAG_COMPRESSED;
+            body = &compressed;
+        }
+        header.payloadBytes = (DWORD)body->size();
+        const BYTE* bytes = reinterpret_cast<const BYTE*>(&header);
+        frame.insert(frame.end(), bytes, bytes + sizeof(header));
+        frame.insert(frame.end(), body->begin(), body->end());
+        Discard();
+    }
+};
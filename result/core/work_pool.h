@@ -0,0 +1,173 @@
+// Small work-stealing pool for fanning a batch of independent, mostly kernel-bound items
+// (one per process) out over the logical processors.
+#pragma once
+
+#include <windows.h>
+#include <vector>
+#include <atomic>
+
+#define POOL_GRAIN 4 // items an owner takes from its own range per step
+
+typedef void (*PoolItemFn)(void* context, size_t worker, size_t item);
+
+// Each worker owns a contiguous slice of the item range, packed as (end << 32 | begin)
+// in one atomic so owner and thieves agree on it with a single CAS. The owner takes
+// POOL_GRAIN items from the front; an idle worker steals the back half of the fullest
+// victim it finds. The calling thread works as worker 0, so a one-thread pool has no
+// helper threads and Run is a plain loop. Helpers are numbered 1..WorkerCount()-1 without
+// gaps, whatever threads failed to start, and each has its own wake-up event, so every
+// round wakes each helper exactly once.
+class WorkStealingPool {
+private:
+    struct alignas(64) Slice {
+        std::atomic<ULONGLONG> range{ 0 };
+    };
+
+    struct Helper {
+        WorkStealingPool* pool;
+        size_t worker;
+        HANDLE hWake;       // auto-reset; set once per round
+        HANDLE hThread;
+    };
+
+    std::vector<Slice> slices;
+    std::vector<Helper> helpers;    // reserved up front, so thread parameters stay put
+    HANDLE hDone = NULL;
+    std::atomic<bool> stopping{ false };
+    std::atomic<size_t> finished{ 0 };
+    PoolItemFn itemFn = NULL;
+    void* itemContext = NULL;
+
+    static ULONGLONG Pack(DWORD begin, DWORD end) {
+        return ((ULONGLONG)end << 32) | begin;
+    }
+
+    static DWORD Begin(ULONGLONG range) {
+        return (DWORD)range;
+    }
+
+    static DWORD End(ULONGLONG range) {
+        return (DWORD)(range >> 32);
+    }
+
+    bool TakeOwn(size_t worker, DWORD& first, DWORD& last) {
+        std::atomic<ULONGLONG>& range = slices[worker].range;
+        ULONGLONG current = range.load(std::memory_order_acquire);
+        for (;;) {
+            DWORD begin = Begin(current), end = End(current);
+            if (begin >= end) return false;
+            DWORD take = end - begin < POOL_GRAIN ? end - begin : POOL_GRAIN;
+            if (range.compare_exchange_weak(current, Pack(begin + take, end), std::memory_order_acq_rel)) {
+                first = begin;
+                last = begin + take;
+                return true;
+            }
+        }
+    }
+
+    // Moves the back half of some other worker's slice into this worker's (empty) slice.
+    bool Steal(size_t worker) {
+        size_t count = slices.size();
+        for (size_t offset = 1; offset < count; offset++) {
+            std::atomic<ULONGLONG>& victim = slices[(worker + offset) % count].range;
+            ULONGLONG current = victim.load(std::memory_order_acquire);
+            for (;;) {
+                DWORD begin = Begin(current), end = End(current);
+                if (begin >= end) break;
+                DWORD split = end - (end - begin + 1) / 2;
+                if (victim.compare_exchange_weak(current, Pack(begin, split), std::memory_order_acq_rel)) {
+                    // Only the owner refills its own slice, and thieves skip empty ones.
+                    slices[worker].range.store(Pack(split, end), std::memory_order_release);
+                    return true;
+                }
+            }
+        }
+        return false;
+    }
+
+    void Work(size_t worker) {
+        DWORD first, last;
+        for (;;) {
+            while (TakeOwn(worker, first, last)) {
+                for (DWORD i = first; i < last; i++) itemFn(itemContext, worker, i);
+            }
+            if (!Steal(worker)) return;
+        }
+    }
+
+    void HelperLoop(const Helper& helper) {
+        for (;;) {
+            WaitForSingleObject(helper.hWake, INFINITE);
+            if (stopping.load(std::memory_order_acquire)) return;
+            Work(helper.worker);
+            if (finished.fetch_add(1, std::memory_order_acq_rel) + 1 == helpers.size()) SetEvent(hDone);
+        }
+    }
+
+    static DWORD WINAPI ThreadProc(LPVOID param) {
+        const Helper* helper = static_cast<const Helper*>(param);
+        helper->pool->HelperLoop(*helper);
+        return 0;
+    }
+
+    void WakeHelpers() {
+        for (const Helper& helper : helpers) SetEvent(helper.hWake);
+    }
+
+public:
+    explicit WorkStealingPool(size_t workerCount) : slices(workerCount ? workerCount : 1) {
+        if (slices.size() == 1) return;
+        hDone = CreateEventW(NULL, FALSE, FALSE, NULL);
+        if (!hDone) return;
+        helpers.reserve(slices.size() - 1);
+        for (size_t i = 1; i < slices.size(); i++) {
+            // A helper that fails to start leaves its number to the next one.
+            Helper helper = { this, helpers.size() + 1, CreateEventW(NULL, FALSE, FALSE, NULL), NULL };
+            if (!helper.hWake) continue;
+            helpers.push_back(helper);
+            helpers.back().hThread = CreateThread(NULL, 0, ThreadProc, &helpers.back(), 0, NULL);
+            if (!helpers.back().hThread) {
+                CloseHandle(helper.hWake);
+                helpers.pop_back();
+            }
+        }
+    }
+
+    ~WorkStealingPool() {
+        stopping.store(true, std::memory_order_release);
+        WakeHelpers();
+        for (const Helper& helper : helpers) {
+            WaitForSingleObject(helper.hThread, INFINITE);
+            CloseHandle(helper.hThread);
+            CloseHandle(helper.hWake);
+        }
+        if (hDone) CloseHandle(hDone);
+    }
+
+    size_t WorkerCount() const {
+        return helpers.size() + 1;
+    }
+
+    // Calls fn(context, worker, i) once for every i in [0, itemCount) and returns when all
+    // calls have finished. 'worker' is below WorkerCount() and stable for one call.
+    void Run(size_t itemCount, PoolItemFn fn, void* context) {
+        itemFn = fn;
+        itemContext = context;
+        size_t workers = WorkerCount();
+        for (size_t i = 0; i < slices.size(); i++) {
+            DWORD begin = i < workers ? (DWORD)(itemCount * i / workers) : 0;
+            DWORD end = i < workers ? (DWORD)(itemCount * (i + 1) / workers) : 0;
+            slices[i].range.store(Pack(begin, end), std::memory_order_relaxed);
+        }
+        if (helpers.empty()) {
+            Work(0);
+            return;
+        }
+
+        finished.store(0, std::memory_order_relaxed);
+        // SetEvent orders the stores above before any helper starts.
+        WakeHelpers();
+        Work(0);
+        WaitForSingleObject(hDone, INFINITE);
+    }
+};
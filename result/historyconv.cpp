@@ -0,0 +1,228 @@
+// Converts process_history.bin into the legacy process_history.txt layout or into CSV.
+//
+//   historyconv <input.bin> [--text | --csv] [output]
+//
+// Without an output path the result goes to stdout.
+#define _UNICODE
+#define UNICODE
+#include <windows.h>
+#include <vector>
+#include <string>
+#include <map>
+#include <deque>
+#include <fstream>
+#include <iostream>
+#include <ctime>
+#include <cstdio>
+
+#include "core/history_format.h"
+
+#define MAX_HISTORY 60 // Matches the monitor's in-memory history per process
+#define FILETIME_UNIX_EPOCH 116444736000000000ULL
+
+struct HistoryPoint {
+    float cpuUsage;
+    ULONGLONG workingSet;
+};
+
+static std::string ToUtf8(const std::wstring& text) {
+    if (text.empty()) return std::string();
+    int bytes = WideCharToMultiByte(CP_UTF8, 0, text.data(), (int)text.size(), NULL, 0, NULL, NULL);
+    std::string out(bytes, '\0');
+    WideCharToMultiByte(CP_UTF8, 0, text.data(), (int)text.size(), &out[0], bytes, NULL, NULL);
+    return out;
+}
+
+static std::string FormatNumber(double value) {
+    char buffer[64];
+    snprintf(buffer, sizeof(buffer), "%g", value);
+    return buffer;
+}
+
+static std::string FormatCsvField(const std::string& field) {
+    if (field.find_first_of(",\"\r\n") == std::string::npos) return field;
+    std::string quoted = "\"";
+    for (char c : field) {
+        if (c == '"') quoted += '"';
+        quoted += c;
+    }
+    return quoted + "\"";
+}
+
+static std::string FormatIsoTime(ULONGLONG fileTime) {
+    FILETIME ft;
+    ft.dwLowDateTime = (DWORD)fileTime;
+    ft.dwHighDateTime = (DWORD)(fileTime >> 32);
+    SYSTEMTIME st;
+    if (!FileTimeToSystemTime(&ft, &st)) return "";
+    char buffer[32];
+    snprintf(buffer, sizeof(buffer), "%04u-%02u-%02uT%02u:%02u:%02u.%03uZ",
+        st.wYear, st.wMonth, st.wDay, st.wHour, st.wMinute, st.wSecond, st.wMilliseconds);
+    return buffer;
+}
+
+class HistoryConverter {
+private:
+    std::ostream& out;
+    bool csv;
+    std::vector<std::wstring> names;
+    std::map<std::pair<DWORD, ULONGLONG>, HistoryProcessRecord> table;
+    std::map<std::pair<DWORD, ULONGLONG>, std::deque<HistoryPoint>> histories;
+    std::vector<HistoryProcessRecord> rows;
+
+    const std::wstring& NameOf(DWORD id) {
+        static const std::wstring unknown = L"<unknown>";
+        return id < names.size() ? names[id] : unknown;
+    }
+
+    void ReadString(const std::vector<BYTE>& payload) {
+        if (payload.size() < 2 * sizeof(DWORD)) return;
+        DWORD id, length;
+        memcpy(&id, payload.data(), sizeof(id));
+        memcpy(&length, payload.data() + sizeof(id), sizeof(length));
+        if (payload.size() < 2 * sizeof(DWORD) + (size_t)length * sizeof(WCHAR)) return;
+
+        std::wstring name(length, L'\0');
+        memcpy(&name[0], payload.data() + 2 * sizeof(DWORD), length * sizeof(WCHAR));
+        if (names.size() <= id) names.resize(id + 1);
+        names[id] = name;
+    }
+
+    // Rebuilds the rolling per-process history the text format used to dump every refresh.
+    void WriteTextSample(const HistorySampleHeader& header, const std::vector<HistoryProcessRecord>& records) {
+        std::map<std::pair<DWORD, ULONGLONG>, std::deque<HistoryPoint>> live;
+        for (const auto& record : records) {
+            auto key = std::make_pair(record.pid, record.createTime);
+            auto it = histories.find(key);
+            std::deque<HistoryPoint>& points = live[key];
+            if (it != histories.end()) points.swap(it->second);
+            points.push_back({ record.cpuUsage, record.workingSet });
+            if (points.size() > MAX_HISTORY) points.pop_front();
+        }
+        histories.swap(live);
+
+        time_t unixTime = (time_t)((header.timestamp - FILETIME_UNIX_EPOCH) / 10000000ULL);
+        out << "Timestamp: " << std::ctime(&unixTime) << "\n";
+        out << "Total CPU Usage: " << FormatNumber(header.totalCpuUsage) << "%\n";
+        out << "Total Memory Usage: " << FormatNumber(header.totalMemoryUsage / (1024.0 * 1024.0)) << " MB\n";
+
+        for (const auto& record : records) {
+            const std::deque<HistoryPoint>& points = histories[std::make_pair(record.pid, record.createTime)];
+            out << "Process: " << ToUtf8(NameOf(record.nameId)) << " (PID: " << record.pid << ")\n";
+            out << "CPU History: ";
+            for (const auto& point : points) out << FormatNumber(point.cpuUsage) << ", ";
+            out << "\nMemory History (MB): ";
+            for (const auto& point : points) out << FormatNumber(point.workingSet / (1024.0 * 1024.0)) << ", ";
+            out << "\n\n";
+        }
+        out << "------------------------\n";
+    }
+
+    void WriteCsvSample(const HistorySampleHeader& header, const std::vector<HistoryProcessRecord>& records) {
+        std::string timestamp = FormatIsoTime(header.timestamp);
+        for (const auto& record : records) {
+            out << timestamp << ',' << record.pid << ',' << record.createTime << ','
+                << FormatCsvField(ToUtf8(NameOf(record.nameId))) << ','
+                << FormatNumber(record.cpuUsage) << ',' << record.workingSet << '\n';
+        }
+    }
+
+    // Applies a keyframe or delta sample to the process table, then emits the full table.
+    void ReadSample(const std::vector<BYTE>& payload) {
+        if (payload.size() < sizeof(HistorySampleHeader)) return;
+        HistorySampleHeader header;
+        memcpy(&header, payload.data(), sizeof(header));
+        size_t available = (payload.size() - sizeof(header)) / sizeof(HistoryProcessRecord);
+        size_t count = header.processCount < available ? header.processCount : available;
+
+        if (!(header.flags & HISTORY_SAMPLE_DELTA)) table.clear();
+        const BYTE* cursor = payload.data() + sizeof(header);
+        for (size_t i = 0; i < count; i++, cursor += sizeof(HistoryProcessRecord)) {
+            HistoryProcessRecord record;
+            memcpy(&record, cursor, sizeof(record));
+            auto key = std::make_pair(record.pid, record.createTime);
+            if (record.flags & HISTORY_RECORD_EXITED) table.erase(key);
+            else table[key] = record;
+        }
+
+        rows.clear();
+        for (const auto& entry : table) rows.push_back(entry.second);
+
+        if (csv) WriteCsvSample(header, rows);
+        else WriteTextSample(header, rows);
+    }
+
+public:
+    HistoryConverter(std::ostream& output, bool asCsv) : out(output), csv(asCsv) {}
+
+    bool Convert(std::istream& in) {
+        HistoryFileHeader fileHeader;
+        if (!in.read(reinterpret_cast<char*>(&fileHeader), sizeof(fileHeader))) return false;
+        // Version 1 files only contain keyframes, which version 2 readers handle as-is.
+        if (fileHeader.magic != HISTORY_FILE_MAGIC || fileHeader.version < 1 || fileHeader.version > HISTORY_FILE_VERSION) return false;
+
+        if (csv) out << "timestamp,pid,create_time,name,cpu_percent,working_set_bytes\n";
+
+        std::vector<BYTE> payload;
+        HistoryBlockHeader block;
+        while (in.read(reinterpret_cast<char*>(&block), sizeof(block))) {
+            payload.resize(block.size);
+            if (block.size && !in.read(reinterpret_cast<char*>(payload.data()), block.size)) break; // truncated tail
+
+            switch (block.kind) {
+            case HISTORY_BLOCK_SESSION:
+                names.clear();
+                table.clear();
+                histories.clear();
+                break;
+            case HISTORY_BLOCK_STRING:
+                ReadString(payload);
+                break;
+            case HISTORY_BLOCK_SAMPLE:
+                ReadSample(payload);
+                break;
+            }
+        }
+        return true;
+    }
+};
+
+int wmain(int argc, wchar_t* argv[]) {
+    const wchar_t* inputPath = NULL;
+    const wchar_t* outputPath = NULL;
+    bool csv = false;
+
+    for (int i = 1; i < argc; i++) {
+        std::wstring arg = argv[i];
+        if (arg == L"--csv") csv = true;
+        else if (arg == L"--text") csv = false;
+        else if (!inputPath) inputPath = argv[i];
+        else if (!outputPath) outputPath = argv[i];
+    }
+    if (!inputPath) {
+        std::wcerr << L"usage: historyconv <input.bin> [--text | --csv] [output]\n";
+        return 2;
+    }
+
+    std::ifstream in(inputPath, std::ios::binary);
+    if (!in.is_open()) {
+        std::wcerr << L"historyconv: cannot open " << inputPath << L"\n";
+        return 1;
+    }
+
+    std::ofstream file;
+    if (outputPath) {
+        file.open(outputPath, std::ios::binary);
+        if (!file.is_open()) {
+            std::wcerr << L"historyconv: cannot create " << outputPath << L"\n";
+            return 1;
+        }
+    }
+
+    HistoryConverter converter(outputPath ? file : std::cout, csv);
+    if (!converter.Convert(in)) {
+        std::wcerr << L"historyconv: " << inputPath << L" is not a process history file\n";
+        return 1;
+    }
+    return 0;
+}
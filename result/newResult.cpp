@@ -1,20 +1,22 @@
 #define _UNICODE
 #define UNICODE
 #include <windows.h>
-#include <psapi.h>
 #include <vector>
 #include <string>
-#include <map>
-#include <algorithm>
 #include <commctrl.h>
+#include <shellapi.h>
 #include <strsafe.h>
-#include <chrono>
-#include <fstream>
-#include <sstream>
+
+#include "core/sampler.h"
+#include "core/process_view.h"
+#include "core/process_tree.h"
+#include "core/process_filter.h"
+#include "core/metric_columns.h"
+#include "core/alloc_counter.h"
 
 #pragma comment(lib, "user32.lib")
 #pragma comment(lib, "comctl32.lib")
-#pragma comment(lib, "psapi.lib")
+#pragma comment(lib, "shell32.lib")
 
 #define ID_LISTVIEW 1001
 #define ID_HISTORY_LISTVIEW 1007
@@ -23,17 +25,26 @@
 #define ID_ALERT_EDIT 1004
 #define ID_TOTAL_CPU 1005
 #define ID_TOTAL_MEM 1006
-#define MAX_HISTORY 60 // Store 60 seconds of history
-
-struct ProcessInfo {
-    DWORD pid;
-    std::wstring name;
-    double cpuUsage;
-    SIZE_T memoryUsage;
-    ULONGLONG lastCpuTime;
-    std::vector<double> cpuHistory;
-    std::vector<SIZE_T> memHistory;
-};
+#define ID_INTERVAL_LABEL 1008
+#define ID_INTERVAL_EDIT 1009
+#define ID_CORE_CPU 1010
+#define ID_WINDOW_COMBO 1011
+#define ID_WINDOW_SUMMARY 1012
+#define ID_TOP_LABEL 1013
+#define ID_TOP_EDIT 1014
+#define ID_INTERESTING_CHECK 1015
+#define ID_STATUS_BAR 1016
+#define ID_EXTENDED_CHECK 1017
+#define ID_GROUP_COMBO 1018
+#define ID_FILTER_LABEL 1019
+#define ID_FILTER_EDIT 1020
+
+#define BASE_PROCESS_COLUMNS (1 + (int)ProcessTableMetrics::count) // the name, then the metrics
+#define EXTENDED_PROCESS_COLUMNS ((int)ExtendedMetrics::count)
+#define WM_APP_SNAPSHOT (WM_APP + 1)
+#define WM_APP_TRAY (WM_APP + 2)
+#define WM_APP_START (WM_APP + 3)
+#define ID_TRAY_ICON 1
 
 class ProcessMonitor {
 private:
@@ -42,36 +53,69 @@ private:
     HWND hHistoryListView;
     HWND hRefreshButton;
     HWND hAlertEdit;
+    HWND hIntervalEdit;
     HWND hTotalCpuLabel;
     HWND hTotalMemLabel;
-    std::vector<ProcessInfo> processes;
-    std::map<DWORD, ULONGLONG> lastSystemTimes;
-    double cpuAlertThreshold = 80.0;
-    SIZE_T memoryAlertThreshold = 0; // Will be set based on system memory
-    ULONGLONG lastUpdateTime;
-    double totalCpuUsage = 0.0;
-    SIZE_T totalMemoryUsage = 0;
-
-    DWORD GetNumberOfProcessors() {
-        SYSTEM_INFO sysInfo;
-        GetSystemInfo(&sysInfo);
-        return sysInfo.dwNumberOfProcessors;
+    HWND hCoreCpuLabel;
+    HWND hWindowCombo;
+    HWND hWindowSummary;
+    HWND hTopEdit;
+    HWND hInterestingCheck;
+    HWND hExtendedCheck;
+    HWND hGroupCombo;
+    HWND hFilterEdit;
+    HWND hStatusBar;
+    Sampler sampler;
+    Snapshot* current = nullptr;
+    ProcessView processView;
+    ProcessView historyView;
+    ViewOptions processOptions;
+    ViewOptions historyOptions;
+    ProcessTree processTree;
+    GroupMode groupMode = GROUP_NONE;
+    std::vector<UINT> changedGroupRows;
+    ProcessFilter rowFilter;         // shared by both tables
+    std::wstring filterError;
+    NOTIFYICONDATAW trayIcon;
+    bool trayAdded = false;
+    LONGLONG launchQpc;
+    bool painted = false;
+
+    void InitTray(HWND hwnd) {
+        ZeroMemory(&trayIcon, sizeof(trayIcon));
+        trayIcon.cbSize = sizeof(trayIcon);
+        trayIcon.hWnd = hwnd;
+        trayIcon.uID = ID_TRAY_ICON;
+        trayIcon.uFlags = NIF_ICON | NIF_TIP | NIF_MESSAGE;
+        trayIcon.uCallbackMessage = WM_APP_TRAY;
+        trayIcon.hIcon = LoadIconW(NULL, IDI_APPLICATION);
+        StringCchCopyW(trayIcon.szTip, ARRAYSIZE(trayIcon.szTip), L"Process Monitor");
+        trayAdded = Shell_NotifyIconW(NIM_ADD, &trayIcon) != FALSE;
     }
 
-    SIZE_T GetTotalSystemMemory() {
-        MEMORYSTATUSEX memInfo;
-        memInfo.dwLength = sizeof(memInfo);
-        GlobalMemoryStatusEx(&memInfo);
-        return memInfo.ullTotalPhys;
+    // Balloon notifications are queued by the shell, so this returns immediately.
+    void ShowAlerts(const std::vector<Alert>& alerts) {
+        if (!trayAdded || alerts.empty()) return;
+        trayIcon.uFlags = NIF_INFO;
+        trayIcon.dwInfoFlags = NIIF_WARNING;
+        StringCchCopyW(trayIcon.szInfoTitle, ARRAYSIZE(trayIcon.szInfoTitle), L"Usage Alert");
+        if (alerts.size() == 1) {
+            StringCchCopyW(trayIcon.szInfo, ARRAYSIZE(trayIcon.szInfo), alerts[0].message.c_str());
+        } else {
+            StringCchPrintfW(trayIcon.szInfo, ARRAYSIZE(trayIcon.szInfo), L"%s\n(+%u more, see alerts.log)",
+                alerts[0].message.c_str(), (UINT)(alerts.size() - 1));
+        }
+        Shell_NotifyIconW(NIM_MODIFY, &trayIcon);
     }
 
     void InitGUI(HWND hwnd) {
-        INITCOMMONCONTROLSEX icex = { sizeof(INITCOMMONCONTROLSEX), ICC_LISTVIEW_CLASSES };
+        INITCOMMONCONTROLSEX icex = { sizeof(INITCOMMONCONTROLSEX), ICC_LISTVIEW_CLASSES | ICC_BAR_CLASSES };
         InitCommonControlsEx(&icex);
 
         hListView = CreateWindowW(WC_LISTVIEWW, L"", 
-            WS_CHILD | WS_VISIBLE | LVS_REPORT | LVS_SHOWSELALWAYS,
+            WS_CHILD | WS_VISIBLE | LVS_REPORT | LVS_SHOWSELALWAYS | LVS_OWNERDATA,
             10, 10, 580, 200, hwnd, (HMENU)ID_LISTVIEW, GetModuleHandleW(NULL), NULL);
+        ListView_SetExtendedListViewStyle(hListView, LVS_EX_FULLROWSELECT | LVS_EX_DOUBLEBUFFER);
 
         LVCOLUMNW lvCol = { 0 };
         lvCol.mask = LVCF_TEXT | LVCF_WIDTH | LVCF_SUBITEM;
@@ -80,35 +124,12 @@ private:
         lvCol.pszText = const_cast<LPWSTR>(processName);
         ListView_InsertColumn(hListView, 0, &lvCol);
         
-        lvCol.cx = 100;
-        const wchar_t* pid = L"PID";
-        lvCol.pszText = const_cast<LPWSTR>(pid);
-        ListView_InsertColumn(hListView, 1, &lvCol);
-        
-        const wchar_t* cpuUsage = L"CPU Usage (%)";
-        lvCol.pszText = const_cast<LPWSTR>(cpuUsage);
-        ListView_InsertColumn(hListView, 2, &lvCol);
-        
-        const wchar_t* memUsage = L"Memory Usage (MB)";
-        lvCol.pszText = const_cast<LPWSTR>(memUsage);
-        ListView_InsertColumn(hListView, 3, &lvCol);
+        InsertMetricColumns<ProcessTableMetrics>(hListView, 1, LVCFMT_LEFT);
 
         hHistoryListView = CreateWindowW(WC_LISTVIEWW, L"", 
-            WS_CHILD | WS_VISIBLE | LVS_REPORT | LVS_SHOWSELALWAYS,
+            WS_CHILD | WS_VISIBLE | LVS_REPORT | LVS_SHOWSELALWAYS | LVS_OWNERDATA,
             10, 220, 580, 100, hwnd, (HMENU)ID_HISTORY_LISTVIEW, GetModuleHandleW(NULL), NULL);
-
-        lvCol.cx = 150;
-        const wchar_t* avgName = L"Process Name";
-        lvCol.pszText = const_cast<LPWSTR>(avgName);
-        ListView_InsertColumn(hHistoryListView, 0, &lvCol);
-        
-        const wchar_t* avgCpu = L"Avg CPU (%)";
-        lvCol.pszText = const_cast<LPWSTR>(avgCpu);
-        ListView_InsertColumn(hHistoryListView, 1, &lvCol);
-        
-        const wchar_t* avgMem = L"Avg Memory (MB)";
-        lvCol.pszText = const_cast<LPWSTR>(avgMem);
-        ListView_InsertColumn(hHistoryListView, 2, &lvCol);
+        ListView_SetExtendedListViewStyle(hHistoryListView, LVS_EX_FULLROWSELECT | LVS_EX_DOUBLEBUFFER);
 
         hRefreshButton = CreateWindowW(L"BUTTON", L"Refresh", 
             WS_CHILD | WS_VISIBLE | BS_PUSHBUTTON,
@@ -116,12 +137,54 @@ private:
 
         CreateWindowW(L"STATIC", L"CPU Alert Threshold (%):", 
             WS_CHILD | WS_VISIBLE,
-            120, 330, 150, 20, hwnd, NULL, GetModuleHandleW(NULL), NULL);
+            120, 330, 150, 20, hwnd, (HMENU)ID_ALERT_THRESHOLD, GetModuleHandleW(NULL), NULL);
         
         hAlertEdit = CreateWindowW(L"EDIT", L"80.0", 
             WS_CHILD | WS_VISIBLE | WS_BORDER,
             270, 330, 60, 20, hwnd, (HMENU)ID_ALERT_EDIT, GetModuleHandleW(NULL), NULL);
 
+        CreateWindowW(L"STATIC", L"Interval (ms):", 
+            WS_CHILD | WS_VISIBLE,
+            340, 330, 90, 20, hwnd, (HMENU)ID_INTERVAL_LABEL, GetModuleHandleW(NULL), NULL);
+
+        WCHAR intervalText[16];
+        StringCchPrintfW(intervalText, 16, L"%d", DEFAULT_SAMPLE_INTERVAL_MS);
+        hIntervalEdit = CreateWindowW(L"EDIT", intervalText, 
+            WS_CHILD | WS_VISIBLE | WS_BORDER | ES_NUMBER,
+            430, 330, 60, 20, hwnd, (HMENU)ID_INTERVAL_EDIT, GetModuleHandleW(NULL), NULL);
+
+        hWindowCombo = CreateWindowW(L"COMBOBOX", L"",
+            WS_CHILD | WS_VISIBLE | WS_VSCROLL | CBS_DROPDOWNLIST,
+            500, 330, 100, 120, hwnd, (HMENU)ID_WINDOW_COMBO, GetModuleHandleW(NULL), NULL);
+        for (int window = 0; window < HISTORY_WINDOW_COUNT; window++) {
+            SendMessageW(hWindowCombo, CB_ADDSTRING, 0, (LPARAM)HistoryWindowName(window));
+        }
+        SendMessageW(hWindowCombo, CB_SETCURSEL, HISTORY_WINDOW_MINUTE, 0);
+
+        hWindowSummary = CreateWindowW(L"STATIC", L"",
+            WS_CHILD | WS_VISIBLE,
+            10, 305, 330, 20, hwnd, (HMENU)ID_WINDOW_SUMMARY, GetModuleHandleW(NULL), NULL);
+
+        CreateWindowW(L"STATIC", L"Filter:",
+            WS_CHILD | WS_VISIBLE,
+            345, 305, 40, 20, hwnd, (HMENU)ID_FILTER_LABEL, GetModuleHandleW(NULL), NULL);
+
+        hFilterEdit = CreateWindowW(L"EDIT", L"",
+            WS_CHILD | WS_VISIBLE | WS_BORDER | ES_AUTOHSCROLL,
+            385, 305, 110, 20, hwnd, (HMENU)ID_FILTER_EDIT, GetModuleHandleW(NULL), NULL);
+
+        CreateWindowW(L"STATIC", L"Top:",
+            WS_CHILD | WS_VISIBLE,
+            500, 305, 35, 20, hwnd, (HMENU)ID_TOP_LABEL, GetModuleHandleW(NULL), NULL);
+
+        hTopEdit = CreateWindowW(L"EDIT", L"0",
+            WS_CHILD | WS_VISIBLE | WS_BORDER | ES_NUMBER,
+            540, 305, 40, 20, hwnd, (HMENU)ID_TOP_EDIT, GetModuleHandleW(NULL), NULL);
+
+        hInterestingCheck = CreateWindowW(L"BUTTON", L"Changed or over alert",
+            WS_CHILD | WS_VISIBLE | BS_AUTOCHECKBOX,
+            590, 305, 155, 20, hwnd, (HMENU)ID_INTERESTING_CHECK, GetModuleHandleW(NULL), NULL);
+
         hTotalCpuLabel = CreateWindowW(L"STATIC", L"Total CPU Usage: 0.00%", 
             WS_CHILD | WS_VISIBLE,
             10, 370, 150, 20, hwnd, (HMENU)ID_TOTAL_CPU, GetModuleHandleW(NULL), NULL);
@@ -130,201 +193,474 @@ private:
             WS_CHILD | WS_VISIBLE,
             170, 370, 200, 20, hwnd, (HMENU)ID_TOTAL_MEM, GetModuleHandleW(NULL), NULL);
 
-        memoryAlertThreshold = GetTotalSystemMemory() * 0.8; // 80% of total system memory
-    }
-
-    void UpdateProcessList() {
-        processes.clear();
-        ListView_DeleteAllItems(hListView);
-        ListView_DeleteAllItems(hHistoryListView);
-        totalCpuUsage = 0.0;
-        totalMemoryUsage = 0;
-
-        DWORD processesIds[1024], cbNeeded;
-        if (!EnumProcesses(processesIds, sizeof(processesIds), &cbNeeded)) return;
-
-        ULONGLONG currentTime;
-        FILETIME ftSystem, ftUser, ftKernel;
-        GetSystemTimeAsFileTime(&ftSystem);
-        currentTime = ((ULONGLONG)ftSystem.dwHighDateTime << 32) | ftSystem.dwLowDateTime;
-
-        DWORD processCount = cbNeeded / sizeof(DWORD);
-        for (DWORD i = 0; i < processCount; i++) {
-            if (processesIds[i] == 0) continue;
-
-            HANDLE hProcess = OpenProcess(PROCESS_QUERY_INFORMATION | PROCESS_VM_READ, FALSE, processesIds[i]);
-            if (hProcess == NULL) continue;
-
-            WCHAR szProcessName[MAX_PATH] = L"<unknown>";
-            GetModuleBaseNameW(hProcess, NULL, szProcessName, MAX_PATH);
-
-            FILETIME ftCreate, ftExit, ftKernelTime, ftUserTime;
-            if (GetProcessTimes(hProcess, &ftCreate, &ftExit, &ftKernelTime, &ftUserTime)) {
-                ULONGLONG kernel = ((ULONGLONG)ftKernelTime.dwHighDateTime << 32) | ftKernelTime.dwLowDateTime;
-                ULONGLONG user = ((ULONGLONG)ftUserTime.dwHighDateTime << 32) | ftUserTime.dwLowDateTime;
-                ULONGLONG totalTime = kernel + user;
-
-                double cpuUsage = 0.0;
-                auto it = lastSystemTimes.find(processesIds[i]);
-                if (it != lastSystemTimes.end()) {
-                    ULONGLONG timeDiff = currentTime - lastUpdateTime;
-                    ULONGLONG cpuDiff = totalTime - it->second;
-                    cpuUsage = (cpuDiff * 100.0) / (timeDiff * GetNumberOfProcessors());
-                }
-
-                PROCESS_MEMORY_COUNTERS pmc;
-                SIZE_T memoryUsage = 0;
-                if (GetProcessMemoryInfo(hProcess, &pmc, sizeof(pmc))) {
-                    memoryUsage = pmc.WorkingSetSize;
-                }
-
-                ProcessInfo info;
-                info.pid = processesIds[i];
-                info.name = szProcessName;
-                info.cpuUsage = cpuUsage;
-                info.memoryUsage = memoryUsage;
-                info.lastCpuTime = totalTime;
-                
-                info.cpuHistory.push_back(cpuUsage);
-                info.memHistory.push_back(memoryUsage);
-                if (info.cpuHistory.size() > MAX_HISTORY) {
-                    info.cpuHistory.erase(info.cpuHistory.begin());
-                    info.memHistory.erase(info.memHistory.begin());
-                }
-
-                processes.push_back(info);
-                lastSystemTimes[processesIds[i]] = totalTime;
-
-                totalCpuUsage += cpuUsage;
-                totalMemoryUsage += memoryUsage;
-
-                if (cpuUsage > cpuAlertThreshold || totalMemoryUsage > memoryAlertThreshold) {
-                    WCHAR alertMsg[256];
-                    StringCchPrintfW(alertMsg, 256, L"Alert: %s (PID: %d) - CPU: %.2f%%, Total CPU: %.2f%%, Total Mem: %.2f MB (Threshold Exceeded)",
-                        szProcessName, processesIds[i], cpuUsage, totalCpuUsage, totalMemoryUsage / (1024.0 * 1024.0));
-                    MessageBoxW(hWnd, alertMsg, L"Usage Alert", MB_OK | MB_ICONWARNING);
-                }
-            }
+        hCoreCpuLabel = CreateWindowW(L"STATIC", L"",
+            WS_CHILD | WS_VISIBLE,
+            380, 370, 400, 20, hwnd, (HMENU)ID_CORE_CPU, GetModuleHandleW(NULL), NULL);
+
+        hExtendedCheck = CreateWindowW(L"BUTTON", L"Extended columns",
+            WS_CHILD | WS_VISIBLE | BS_AUTOCHECKBOX,
+            610, 330, 130, 20, hwnd, (HMENU)ID_EXTENDED_CHECK, GetModuleHandleW(NULL), NULL);
+
+        // Items are in GroupMode order.
+        hGroupCombo = CreateWindowW(L"COMBOBOX", L"",
+            WS_CHILD | WS_VISIBLE | WS_VSCROLL | CBS_DROPDOWNLIST,
+            750, 330, 110, 120, hwnd, (HMENU)ID_GROUP_COMBO, GetModuleHandleW(NULL), NULL);
+        static const wchar_t* groupNames[] = { L"Flat list", L"Process tree", L"By name", L"By session" };
+        for (const wchar_t* name : groupNames) SendMessageW(hGroupCombo, CB_ADDSTRING, 0, (LPARAM)name);
+        SendMessageW(hGroupCombo, CB_SETCURSEL, GROUP_NONE, 0);
+
+        // Sizes and positions itself along the bottom edge.
+        hStatusBar = CreateWindowW(STATUSCLASSNAMEW, L"",
+            WS_CHILD | WS_VISIBLE | SBARS_SIZEGRIP,
+            0, 0, 0, 0, hwnd, (HMENU)ID_STATUS_BAR, GetModuleHandleW(NULL), NULL);
+    }
+
+    // Titles and widths come from the metric list, starting at column 'first'.
+    template <typename Metrics>
+    static void InsertMetricColumns(HWND hList, int first, int format) {
+        LVCOLUMNW lvCol = { 0 };
+        lvCol.mask = LVCF_TEXT | LVCF_WIDTH | LVCF_SUBITEM | LVCF_FMT;
+        lvCol.fmt = format;
+        int column = first;
+        Metrics::ForEach([&](auto metric) {
+            typedef decltype(metric) Metric;
+            lvCol.pszText = const_cast<LPWSTR>(Metric::title);
+            lvCol.cx = Metric::width;
+            lvCol.iSubItem = column;
+            ListView_InsertColumn(hList, column, &lvCol);
+            column++;
+        });
+    }
 
-            CloseHandle(hProcess);
+    // Deferred until after the first paint; the table is empty until the first snapshot.
+    void InitHistoryColumns() {
+        LVCOLUMNW lvCol = { 0 };
+        lvCol.mask = LVCF_TEXT | LVCF_WIDTH | LVCF_SUBITEM;
+        lvCol.cx = 150;
+        const wchar_t* avgName = L"Process Name";
+        lvCol.pszText = const_cast<LPWSTR>(avgName);
+        ListView_InsertColumn(hHistoryListView, 0, &lvCol);
+        InsertMetricColumns<HistoryTableMetrics>(hHistoryListView, 1, LVCFMT_LEFT);
+    }
+
+    // Both tables are LVS_OWNERDATA: the control only asks for the cells it is about to
+    // paint (LVN_GETDISPINFO), through a view that maps list items to snapshot rows. In
+    // snapshot order with stable rows only the changed rows are invalidated; a sorted,
+    // filtered or top-N view can move rows, so its item count is reset in one call.
+    void RefreshRows(HWND hList, ProcessView& view, const ViewOptions& options,
+                     const std::vector<UINT>& changedRows, bool rowsStable) {
+        view.Build(*current, options);
+        if (!rowsStable || !options.IsIdentity()) {
+            ListView_SetItemCountEx(hList, (int)view.Size(), LVSICF_NOSCROLL);
+            return;
         }
+        for (UINT row : changedRows) ListView_RedrawItems(hList, (int)row, (int)row);
+    }
 
-        lastUpdateTime = currentTime;
-        UpdateListView();
-        UpdateHistoryListView();
-        UpdateTotalUsage();
+    // Grouped views keep their totals in processTree, which only follows the snapshots
+    // while a grouping is shown; switching to one starts it with a rebuild.
+    void UpdateListView(bool rowsStable) {
+        if (groupMode != GROUP_NONE) {
+            processTree.Apply(*current);
+            UpdateGroupRows();
+            return;
+        }
+        RefreshRows(hListView, processView, processOptions, current->changedRows, rowsStable);
     }
 
-    void UpdateListView() {
-        ListView_DeleteAllItems(hListView);
-        
-        for (size_t i = 0; i < processes.size(); i++) {
-            LVITEMW lvItem = { 0 };
-            lvItem.mask = LVIF_TEXT;
-            lvItem.iItem = (int)i;
+    // The tree keeps its order across refreshes; while no row moves, only the rows whose
+    // totals changed are redrawn.
+    void UpdateGroupRows() {
+        if (processTree.Refresh(groupMode, processOptions, changedGroupRows)) {
+            ListView_SetItemCountEx(hListView, (int)processTree.Rows().size(), LVSICF_NOSCROLL);
+            InvalidateRect(hListView, NULL, FALSE);
+            return;
+        }
+        for (UINT row : changedGroupRows) ListView_RedrawItems(hListView, (int)row, (int)row);
+    }
+
+    void SetColumnTitle(HWND hList, int column, const wchar_t* title) {
+        LVCOLUMNW lvCol = { 0 };
+        lvCol.mask = LVCF_TEXT;
+        lvCol.pszText = const_cast<LPWSTR>(title);
+        ListView_SetColumn(hList, column, &lvCol);
+    }
+
+    void SetGroupMode(GroupMode mode) {
+        groupMode = mode;
+        SetColumnTitle(hListView, 0, mode == GROUP_SESSION ? L"Session" : L"Process Name");
+        SetColumnTitle(hListView, 1, mode == GROUP_NAME || mode == GROUP_SESSION ? L"Processes" : L"PID");
+        ReapplyViews();
+    }
+
+    // Double-clicking a tree row with children collapses or expands it.
+    void ToggleTreeRow(int item) {
+        if (groupMode != GROUP_TREE || item < 0 || (size_t)item >= processTree.Rows().size()) return;
+        if (processTree.Toggle(processTree.Rows()[item].node)) UpdateGroupRows();
+    }
 
-            WCHAR buffer[256];
-            lvItem.pszText = (LPWSTR)processes[i].name.c_str();
-            ListView_InsertItem(hListView, &lvItem);
+    void UpdateHistoryListView(bool rowsStable) {
+        RefreshRows(hHistoryListView, historyView, historyOptions, current->changedAverageRows, rowsStable);
+    }
 
-            StringCchPrintfW(buffer, 256, L"%d", processes[i].pid);
-            ListView_SetItemText(hListView, i, 1, buffer);
+    // The expression is compiled once per edit. One that does not compile shows every row,
+    // and its error takes the place of the window summary until it is fixed.
+    void ApplyFilter() {
+        WCHAR buffer[256];
+        GetWindowTextW(hFilterEdit, buffer, 256);
+        rowFilter.Compile(buffer, filterError);
+        ReapplyViews();
+        if (current) UpdateTotalUsage();
+    }
 
-            StringCchPrintfW(buffer, 256, L"%.2f", processes[i].cpuUsage);
-            ListView_SetItemText(hListView, i, 2, buffer);
+    // Re-applies the view options to the snapshot already on screen.
+    void ReapplyViews() {
+        if (!current) return;
+        UpdateListView(false);
+        UpdateHistoryListView(false);
+        InvalidateRect(hListView, NULL, FALSE);
+        InvalidateRect(hHistoryListView, NULL, FALSE);
+    }
 
-            StringCchPrintfW(buffer, 256, L"%.2f", processes[i].memoryUsage / (1024.0 * 1024.0));
-            ListView_SetItemText(hListView, i, 3, buffer);
+    // Extended counters are opt-in: the columns exist only while the sampler reads them.
+    void ShowExtendedColumns(bool show) {
+        if (show) {
+            InsertMetricColumns<ExtendedMetrics>(hListView, BASE_PROCESS_COLUMNS, LVCFMT_RIGHT);
+        } else {
+            for (int i = EXTENDED_PROCESS_COLUMNS; i-- > 0;) ListView_DeleteColumn(hListView, BASE_PROCESS_COLUMNS + i);
+            if (processOptions.key >= SORT_PRIVATE) processOptions.key = SORT_NONE;
         }
+        sampler.SetExtendedCounters(show);
+        sampler.RequestSample();
     }
 
-    void UpdateHistoryListView() {
-        ListView_DeleteAllItems(hHistoryListView);
-        
-        for (size_t i = 0; i < processes.size(); i++) {
-            LVITEMW lvItem = { 0 };
-            lvItem.mask = LVIF_TEXT;
-            lvItem.iItem = (int)i;
-
-            WCHAR buffer[256];
-            lvItem.pszText = (LPWSTR)processes[i].name.c_str();
-            ListView_InsertItem(hHistoryListView, &lvItem);
-
-            double avgCpu = 0.0;
-            for (double cpu : processes[i].cpuHistory) avgCpu += cpu;
-            avgCpu /= processes[i].cpuHistory.size();
-            StringCchPrintfW(buffer, 256, L"%.2f", avgCpu);
-            ListView_SetItemText(hHistoryListView, i, 1, buffer);
-
-            SIZE_T avgMem = 0;
-            for (SIZE_T mem : processes[i].memHistory) avgMem += mem;
-            avgMem /= processes[i].memHistory.size();
-            StringCchPrintfW(buffer, 256, L"%.2f", avgMem / (1024.0 * 1024.0));
-            ListView_SetItemText(hHistoryListView, i, 2, buffer);
+    static SortKey ColumnSortKey(bool history, int column) {
+        if (column < 0) return SORT_NONE;
+        if (column == 0) return SORT_NAME;
+        if (history) return HistoryTableMetrics::Sort(column - 1);
+        if (column < BASE_PROCESS_COLUMNS) return ProcessTableMetrics::Sort(column - 1);
+        return ExtendedMetrics::Sort(column - BASE_PROCESS_COLUMNS);
+    }
+
+    // A click sorts by the column, a second click reverses it. Numbers start with the
+    // largest first, names and PIDs in ascending order.
+    void SortByColumn(HWND hList, ViewOptions& options, bool history, int column) {
+        SortKey key = ColumnSortKey(history, column);
+        if (key == SORT_NONE) return;
+        if (options.key == key) options.descending = !options.descending;
+        else options.descending = key != SORT_NAME && key != SORT_PID;
+        options.key = key;
+
+        HWND header = ListView_GetHeader(hList);
+        int columns = Header_GetItemCount(header);
+        for (int i = 0; i < columns; i++) {
+            HDITEMW hdItem = { 0 };
+            hdItem.mask = HDI_FORMAT;
+            Header_GetItem(header, i, &hdItem);
+            hdItem.fmt &= ~(HDF_SORTUP | HDF_SORTDOWN);
+            if (i == column) hdItem.fmt |= options.descending ? HDF_SORTDOWN : HDF_SORTUP;
+            Header_SetItem(header, i, &hdItem);
+        }
+        ReapplyViews();
+    }
+
+    void FormatProcessCell(LVITEMW& item) {
+        const ProcessInfo& proc = current->processes[processView.Row(item.iItem)];
+        int column = item.iSubItem;
+        if (column == 0) StringCchCopyW(item.pszText, item.cchTextMax, proc.name->c_str());
+        else if (column < BASE_PROCESS_COLUMNS) ProcessTableMetrics::FormatCell(column - 1, proc, item.pszText, item.cchTextMax);
+        else ExtendedMetrics::FormatCell(column - BASE_PROCESS_COLUMNS, proc, item.pszText, item.cchTextMax);
+    }
+
+    // Tree rows show each process with its descendants' CPU and memory added in; group
+    // rows show the totals of their members.
+    void FormatGroupCell(LVITEMW& item) {
+        const GroupRow& row = processTree.Rows()[item.iItem];
+        if (item.mask & LVIF_INDENT) item.iIndent = row.depth;
+        if (!(item.mask & LVIF_TEXT)) return;
+        double cpu;
+        ULONGLONG memory;
+        if (row.group) {
+            cpu = row.group->cpu;
+            memory = row.group->memory;
+        } else {
+            const TreeNode& node = processTree.Node(row.node);
+            cpu = node.subtreeCpu;
+            memory = node.subtreeMemory;
+        }
+        switch (item.iSubItem) {
+        case 0:
+            if (groupMode == GROUP_SESSION) {
+                StringCchPrintfW(item.pszText, item.cchTextMax, L"Session %lu", row.group->sessionId);
+            } else if (row.group) {
+                StringCchCopyW(item.pszText, item.cchTextMax, row.group->name->c_str());
+            } else {
+                const wchar_t* marker = !processTree.HasChildren(row.node) ? L""
+                    : processTree.Node(row.node).collapsed ? L"[+] " : L"[-] ";
+                StringCchPrintfW(item.pszText, item.cchTextMax, L"%s%s", marker, processTree.Node(row.node).name->c_str());
+            }
+            break;
+        case 1:
+            if (row.group) StringCchPrintfW(item.pszText, item.cchTextMax, L"%u", row.group->count);
+            else StringCchPrintfW(item.pszText, item.cchTextMax, L"%lu", processTree.Node(row.node).key.pid);
+            break;
+        case 2:
+            // Incremental sums can leave a rounding residue just below zero.
+            StringCchPrintfW(item.pszText, item.cchTextMax, L"%.2f", cpu > 0.0 ? cpu : 0.0);
+            break;
+        case 3:
+            StringCchPrintfW(item.pszText, item.cchTextMax, L"%.2f", memory / (1024.0 * 1024.0));
+            break;
+        default:
+            item.pszText[0] = L'\0';
+            break;
+        }
+    }
+
+    void FormatHistoryCell(LVITEMW& item) {
+        const ProcessInfo& proc = current->processes[historyView.Row(item.iItem)];
+        if (item.iSubItem == 0) StringCchCopyW(item.pszText, item.cchTextMax, proc.name->c_str());
+        else HistoryTableMetrics::FormatCell(item.iSubItem - 1, proc, item.pszText, item.cchTextMax);
+    }
+
+    static const wchar_t* HistoryWindowName(int window) {
+        switch (window) {
+        case HISTORY_WINDOW_HOUR: return L"Last hour";
+        case HISTORY_WINDOW_DAY: return L"Last day";
+        case HISTORY_WINDOW_WEEK: return L"Last week";
+        default: return L"Last minute";
         }
     }
 
     void UpdateTotalUsage() {
         WCHAR buffer[256];
-        StringCchPrintfW(buffer, 256, L"Total CPU Usage: %.2f%%", totalCpuUsage);
+        StringCchPrintfW(buffer, 256, L"Total CPU Usage: %.2f%%", current->totalCpuUsage);
         SetWindowTextW(hTotalCpuLabel, buffer);
 
-        StringCchPrintfW(buffer, 256, L"Total Memory Usage: %.2f MB", totalMemoryUsage / (1024.0 * 1024.0));
+        StringCchPrintfW(buffer, 256, L"Total Memory Usage: %.2f MB", current->totalMemoryUsage / (1024.0 * 1024.0));
         SetWindowTextW(hTotalMemLabel, buffer);
+
+        if (current->coreUsage.empty()) {
+            buffer[0] = L'\0';
+        } else {
+            StringCchPrintfW(buffer, 256, L"Kernel: %.2f%%  Cores: %u  Busiest: %.2f%%  Imbalance: %.2f",
+                current->kernelCpuUsage, (unsigned)current->coreUsage.size(), current->maxCoreUsage, current->coreImbalance);
+        }
+        SetWindowTextW(hCoreCpuLabel, buffer);
+
+        if (!filterError.empty()) {
+            StringCchPrintfW(buffer, 256, L"Filter: %s", filterError.c_str());
+        } else {
+            StringCchPrintfW(buffer, 256, L"%s: avg CPU %.2f%%, peak %.2f%%; avg memory %.2f MB, peak %.2f MB",
+                HistoryWindowName(current->historyWindow), current->windowAvgCpu, current->windowPeakCpu,
+                current->windowAvgMemory / (1024.0 * 1024.0), current->windowPeakMemory / (1024.0 * 1024.0));
+        }
+        SetWindowTextW(hWindowSummary, buffer);
+    }
+
+    // The monitor's own overhead: its CPU and memory, and p50/p99 of each refresh phase.
+    void UpdateStatusBar() {
+        Profiler& profiler = sampler.GetProfiler();
+        WCHAR buffer[256];
+        StringCchPrintfW(buffer, 256, L"Monitor: CPU %.2f%%, WS %.1f MB, private %.1f MB, %llu allocs/refresh, %u of %u sampled",
+            current->selfCpuUsage, current->selfWorkingSet / (1024.0 * 1024.0), current->selfPrivateBytes / (1024.0 * 1024.0),
+            current->allocations, current->sampledProcesses, (unsigned)current->processes.size());
+        SendMessageW(hStatusBar, SB_SETTEXTW, 0, (LPARAM)buffer);
+
+        LatencySummary sample = profiler.Summarize(PROFILE_SAMPLE);
+        LatencySummary writer = profiler.Summarize(PROFILE_WRITER);
+        LatencySummary firstPaint = profiler.Summarize(PROFILE_FIRST_PAINT);
+        LatencySummary firstData = profiler.Summarize(PROFILE_FIRST_DATA);
+        StringCchPrintfW(buffer, 256, L"Sample p50 %.2f / p99 %.2f ms; writer p50 %.2f / p99 %.2f ms; startup paint %.0f / data %.0f ms",
+            sample.p50Us / 1000.0, sample.p99Us / 1000.0, writer.p50Us / 1000.0, writer.p99Us / 1000.0,
+            firstPaint.maxUs / 1000.0, firstData.maxUs / 1000.0);
+        SendMessageW(hStatusBar, SB_SETTEXTW, 1, (LPARAM)buffer);
+
+        LatencySummary list = profiler.Summarize(PROFILE_LIST_VIEW);
+        LatencySummary historyList = profiler.Summarize(PROFILE_HISTORY_VIEW);
+        ProcessEventStats events = sampler.GetProcessEventStats();
+        if (events.active) {
+            StringCchPrintfW(buffer, 256, L"Lists p99 %.2f / %.2f ms; %llu short-lived",
+                list.p99Us / 1000.0, historyList.p99Us / 1000.0, events.transient);
+        } else {
+            StringCchPrintfW(buffer, 256, L"Lists p99 %.2f / %.2f ms; polling only",
+                list.p99Us / 1000.0, historyList.p99Us / 1000.0);
+        }
+        SendMessageW(hStatusBar, SB_SETTEXTW, 2, (LPARAM)buffer);
     }
 
     void ResizeControls(int width, int height) {
+        SendMessageW(hStatusBar, WM_SIZE, 0, 0);
+        RECT statusRect;
+        GetWindowRect(hStatusBar, &statusRect);
+        height -= statusRect.bottom - statusRect.top;
+        int parts[] = { width * 35 / 100, width * 80 / 100, -1 };
+        SendMessageW(hStatusBar, SB_SETPARTS, 3, (LPARAM)parts);
+
         MoveWindow(hListView, 10, 10, width - 20, 200, TRUE);
-        MoveWindow(hHistoryListView, 10, 220, width - 20, 100, TRUE);
+        int historyHeight = height - 325 > 40 ? height - 325 : 40;
+        MoveWindow(hHistoryListView, 10, 220, width - 20, historyHeight, TRUE);
+        MoveWindow(hWindowSummary, 10, 225 + historyHeight, width - 525, 20, TRUE);
+        MoveWindow(GetDlgItem(hWnd, ID_FILTER_LABEL), width - 510, 225 + historyHeight, 40, 20, TRUE);
+        MoveWindow(hFilterEdit, width - 465, 225 + historyHeight, 210, 20, TRUE);
+        MoveWindow(GetDlgItem(hWnd, ID_TOP_LABEL), width - 250, 225 + historyHeight, 35, 20, TRUE);
+        MoveWindow(hTopEdit, width - 210, 225 + historyHeight, 40, 20, TRUE);
+        MoveWindow(hInterestingCheck, width - 165, 225 + historyHeight, 155, 20, TRUE);
         MoveWindow(hRefreshButton, 10, height - 70, 100, 30, TRUE);
-        MoveWindow(GetDlgItem(hWnd, 0), 120, height - 70, 150, 20, TRUE); // CPU Alert Threshold label
+        MoveWindow(GetDlgItem(hWnd, ID_ALERT_THRESHOLD), 120, height - 70, 150, 20, TRUE);
         MoveWindow(hAlertEdit, 270, height - 70, 60, 20, TRUE);
+        MoveWindow(GetDlgItem(hWnd, ID_INTERVAL_LABEL), 340, height - 70, 90, 20, TRUE);
+        MoveWindow(hIntervalEdit, 430, height - 70, 60, 20, TRUE);
+        MoveWindow(hWindowCombo, 500, height - 70, 100, 120, TRUE);
+        MoveWindow(hExtendedCheck, 610, height - 70, 130, 20, TRUE);
+        MoveWindow(hGroupCombo, 750, height - 70, 110, 120, TRUE);
         MoveWindow(hTotalCpuLabel, 10, height - 40, 150, 20, TRUE);
         MoveWindow(hTotalMemLabel, 170, height - 40, 200, 20, TRUE);
+        MoveWindow(hCoreCpuLabel, 380, height - 40, width - 390, 20, TRUE);
     }
 
-    void SaveHistoricalData() {
-        std::wofstream file(L"process_history.txt", std::ios::app);
-        if (!file.is_open()) return;
-
-        auto now = std::chrono::system_clock::now();
-        auto now_c = std::chrono::system_clock::to_time_t(now);
-        file << L"Timestamp: " << std::ctime(&now_c) << L"\n";
-        file << L"Total CPU Usage: " << totalCpuUsage << L"%\n";
-        file << L"Total Memory Usage: " << (totalMemoryUsage / (1024.0 * 1024.0)) << L" MB\n";
-        
-        for (const auto& proc : processes) {
-            file << L"Process: " << proc.name << L" (PID: " << proc.pid << L")\n";
-            file << L"CPU History: ";
-            for (double cpu : proc.cpuHistory) {
-                file << cpu << L", ";
-            }
-            file << L"\nMemory History (MB): ";
-            for (SIZE_T mem : proc.memHistory) {
-                file << (mem / (1024.0 * 1024.0)) << L", ";
-            }
-            file << L"\n\n";
-        }
-        file << L"------------------------\n";
-        file.close();
+    // Sampler thread: hand the snapshot over to the UI thread.
+    static void OnSnapshotReady(void* context) {
+        PostMessageW(static_cast<HWND>(context), WM_APP_SNAPSHOT, 0, 0);
     }
 
 public:
-    ProcessMonitor(HWND hwnd) : hWnd(hwnd), lastUpdateTime(0) {
+    // Startup is staged so the window shows at once: WM_CREATE only builds the controls,
+    // the first paint posts WM_APP_START, and that starts the sampler, whose first
+    // snapshot replaces the placeholder. 'qpcAtLaunch' is taken on entry to wWinMain.
+    ProcessMonitor(HWND hwnd, LONGLONG qpcAtLaunch) : hWnd(hwnd), launchQpc(qpcAtLaunch) {
+        processOptions.cpuThreshold = historyOptions.cpuThreshold = 80.0;
+        processOptions.filter = historyOptions.filter = &rowFilter;
         InitGUI(hwnd);
-        UpdateProcessList();
+        SendMessageW(hStatusBar, SB_SETTEXTW, 0, (LPARAM)L"Collecting first sample...");
+    }
+
+    void HandlePaint() {
+        if (painted) return;
+        painted = true;
+        sampler.GetProfiler().RecordSince(PROFILE_FIRST_PAINT, launchQpc);
+        PostMessageW(hWnd, WM_APP_START, 0, 0);
+    }
+
+    // Lets the child controls finish painting before the slower setup runs.
+    void HandleStart() {
+        RedrawWindow(hWnd, NULL, NULL, RDW_UPDATENOW | RDW_ALLCHILDREN);
+        InitHistoryColumns();
+        InitTray(hWnd);
+        if (!sampler.Start(OnSnapshotReady, hWnd)) {
+            SendMessageW(hStatusBar, SB_SETTEXTW, 0, (LPARAM)L"Cannot start sampling");
+        }
+    }
+
+    ~ProcessMonitor() {
+        sampler.Stop();
+        if (trayAdded) Shell_NotifyIconW(NIM_DELETE, &trayIcon);
+        delete current;
     }
 
     void HandleCommand(WPARAM wParam) {
         if (LOWORD(wParam) == ID_REFRESH) {
-            UpdateProcessList();
-            SaveHistoricalData();
+            sampler.RequestSample();
         }
         else if (LOWORD(wParam) == ID_ALERT_EDIT && HIWORD(wParam) == EN_CHANGE) {
             WCHAR buffer[32];
             GetWindowTextW(hAlertEdit, buffer, 32);
-            cpuAlertThreshold = _wtof(buffer);
+            double threshold = _wtof(buffer);
+            sampler.SetCpuAlertThreshold(threshold);
+            processOptions.cpuThreshold = historyOptions.cpuThreshold = threshold;
+            if (processOptions.onlyInteresting) ReapplyViews();
+        }
+        else if (LOWORD(wParam) == ID_TOP_EDIT && HIWORD(wParam) == EN_CHANGE) {
+            WCHAR buffer[32];
+            GetWindowTextW(hTopEdit, buffer, 32);
+            int top = _wtoi(buffer);
+            processOptions.topN = historyOptions.topN = top > 0 ? (size_t)top : 0;
+            ReapplyViews();
+        }
+        else if (LOWORD(wParam) == ID_FILTER_EDIT && HIWORD(wParam) == EN_CHANGE) {
+            ApplyFilter();
+        }
+        else if (LOWORD(wParam) == ID_INTERESTING_CHECK && HIWORD(wParam) == BN_CLICKED) {
+            bool checked = SendMessageW(hInterestingCheck, BM_GETCHECK, 0, 0) == BST_CHECKED;
+            processOptions.onlyInteresting = historyOptions.onlyInteresting = checked;
+            ReapplyViews();
+        }
+        else if (LOWORD(wParam) == ID_EXTENDED_CHECK && HIWORD(wParam) == BN_CLICKED) {
+            ShowExtendedColumns(SendMessageW(hExtendedCheck, BM_GETCHECK, 0, 0) == BST_CHECKED);
+            ReapplyViews();
+        }
+        else if (LOWORD(wParam) == ID_INTERVAL_EDIT && HIWORD(wParam) == EN_CHANGE) {
+            WCHAR buffer[32];
+            GetWindowTextW(hIntervalEdit, buffer, 32);
+            int interval = _wtoi(buffer);
+            if (interval > 0) sampler.SetInterval((DWORD)interval);
+        }
+        else if (LOWORD(wParam) == ID_WINDOW_COMBO && HIWORD(wParam) == CBN_SELCHANGE) {
+            int window = (int)SendMessageW(hWindowCombo, CB_GETCURSEL, 0, 0);
+            if (window != CB_ERR) {
+                sampler.SetHistoryWindow((HistoryWindow)window);
+                sampler.RequestSample();
+            }
+        }
+        else if (LOWORD(wParam) == ID_GROUP_COMBO && HIWORD(wParam) == CBN_SELCHANGE) {
+            int mode = (int)SendMessageW(hGroupCombo, CB_GETCURSEL, 0, 0);
+            if (mode != CB_ERR) SetGroupMode((GroupMode)mode);
+        }
+    }
+
+    void HandleSnapshot() {
+        Snapshot* latest = sampler.TakeLatest();
+        if (!latest) return;
+        // Change lists are relative to the sampler's previous snapshot; if the UI skipped
+        // one (it was recycled unseen) they cannot be applied incrementally.
+        bool rowsStable = current && latest->rowsStable && latest->processes.size() == current->processes.size()
+            && latest->sequence == current->sequence + 1;
+        bool first = current == nullptr;
+        if (current) sampler.Recycle(current);
+        current = latest;
+
+        {
+            ScopedTimer timer(sampler.GetProfiler().Phase(PROFILE_LIST_VIEW));
+            UpdateListView(rowsStable);
+        }
+        {
+            ScopedTimer timer(sampler.GetProfiler().Phase(PROFILE_HISTORY_VIEW));
+            UpdateHistoryListView(rowsStable);
+        }
+        UpdateTotalUsage();
+        if (first) sampler.GetProfiler().RecordSince(PROFILE_FIRST_DATA, launchQpc);
+        UpdateStatusBar();
+        ShowAlerts(current->alerts);
+    }
+
+    LRESULT HandleNotify(LPARAM lParam) {
+        NMHDR* hdr = reinterpret_cast<NMHDR*>(lParam);
+        if (hdr->code == LVN_GETDISPINFOW) {
+            LVITEMW& item = reinterpret_cast<NMLVDISPINFOW*>(lParam)->item;
+            if (!current || item.iItem < 0) return 0;
+            if (hdr->hwndFrom == hListView && groupMode != GROUP_NONE) {
+                if ((size_t)item.iItem < processTree.Rows().size()) FormatGroupCell(item);
+                return 0;
+            }
+            if (!(item.mask & LVIF_TEXT)) return 0;
+            if (hdr->hwndFrom == hListView && (size_t)item.iItem < processView.Size()) FormatProcessCell(item);
+            else if (hdr->hwndFrom == hHistoryListView && (size_t)item.iItem < historyView.Size()) FormatHistoryCell(item);
+        }
+        else if (hdr->code == LVN_COLUMNCLICK) {
+            int column = reinterpret_cast<NMLISTVIEW*>(lParam)->iSubItem;
+            if (hdr->hwndFrom == hListView) SortByColumn(hListView, processOptions, false, column);
+            else if (hdr->hwndFrom == hHistoryListView) SortByColumn(hHistoryListView, historyOptions, true, column);
+        }
+        else if (hdr->code == LVN_GETEMPTYMARKUP && !current) {
+            NMLVEMPTYMARKUP* markup = reinterpret_cast<NMLVEMPTYMARKUP*>(lParam);
+            markup->dwFlags = EMF_CENTERED;
+            StringCchCopyW(markup->szMarkup, ARRAYSIZE(markup->szMarkup), L"Collecting first sample...");
+            return TRUE;
+        }
+        else if (hdr->code == NM_DBLCLK && hdr->hwndFrom == hListView) {
+            ToggleTreeRow(reinterpret_cast<NMITEMACTIVATE*>(lParam)->iItem);
         }
+        return 0;
     }
 
     void HandleResize(WPARAM wParam, LPARAM lParam) {
@@ -334,27 +670,57 @@ public:
     }
 
     void Refresh() {
-        UpdateProcessList();
-        SaveHistoricalData();
+        sampler.RequestSample();
+    }
+
+    void HandleHardwareChange() {
+        sampler.InvalidateTopology();
+    }
+
+    const PidEnumeratorStats& GetPidEnumeratorStats() const {
+        return sampler.GetPidEnumeratorStats();
     }
 };
 
+static LONGLONG launchQpc = 0;
+
 LRESULT CALLBACK WndProc(HWND hwnd, UINT msg, WPARAM wParam, LPARAM lParam) {
     static ProcessMonitor* monitor = nullptr;
 
     switch (msg) {
     case WM_CREATE:
-        monitor = new ProcessMonitor(hwnd);
+        monitor = new ProcessMonitor(hwnd, launchQpc);
+        break;
+
+    case WM_PAINT:
+        if (monitor) monitor->HandlePaint();
+        return DefWindowProcW(hwnd, msg, wParam, lParam);
+
+    case WM_APP_START:
+        if (monitor) monitor->HandleStart();
         break;
 
     case WM_COMMAND:
         if (monitor) monitor->HandleCommand(wParam);
         break;
 
+    case WM_APP_SNAPSHOT:
+        if (monitor) monitor->HandleSnapshot();
+        break;
+
+    case WM_NOTIFY:
+        if (monitor) return monitor->HandleNotify(lParam);
+        break;
+
     case WM_SIZE:
         if (monitor) monitor->HandleResize(wParam, lParam);
         break;
 
+    case WM_DEVICECHANGE:
+    case WM_POWERBROADCAST:
+        if (monitor) monitor->HandleHardwareChange();
+        return DefWindowProcW(hwnd, msg, wParam, lParam);
+
     case WM_DESTROY:
         if (monitor) delete monitor;
         PostQuitMessage(0);
@@ -367,6 +733,10 @@ LRESULT CALLBACK WndProc(HWND hwnd, UINT msg, WPARAM wParam, LPARAM lParam) {
 }
 
 int WINAPI wWinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, PWSTR lpCmdLine, int nCmdShow) {
+    LARGE_INTEGER now;
+    QueryPerformanceCounter(&now);
+    launchQpc = now.QuadPart;
+
     WNDCLASSEXW wc = { sizeof(WNDCLASSEXW) };
     wc.lpfnWndProc = WndProc;
     wc.hInstance = hInstance;
@@ -375,7 +745,7 @@ int WINAPI wWinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, PWSTR lpCmdLin
     RegisterClassExW(&wc);
 
     HWND hwnd = CreateWindowW(wc.lpszClassName, L"Process Monitor",
-        WS_OVERLAPPEDWINDOW | WS_THICKFRAME, CW_USEDEFAULT, CW_USEDEFAULT, 620, 450,
+        WS_OVERLAPPEDWINDOW | WS_THICKFRAME, CW_USEDEFAULT, CW_USEDEFAULT, 880, 480,
         NULL, NULL, hInstance, NULL);
 
     ShowWindow(hwnd, nCmdShow);